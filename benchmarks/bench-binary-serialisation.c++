@@ -0,0 +1,66 @@
+/* Stream based serialisation against memory sinks and reading from
+   bytes, for bulk data and for many small records.
+
+   Usage: bench-binary-serialisation [number of elements] */
+#include <tanz/binary-serialisation.h++>
+#include "bench-common.h++"
+
+#include <complex>
+#include <sstream>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+using record_t = std::tuple< uint32_t, double, std::array< float, 3 > >;
+
+template< typename T >
+void
+compare( char const * name, T const & data, size_t bytes_hint )
+{
+    std::string streamed;
+    auto t_stream_out = tz::bench::best_of( 3, [ & ]() {
+        std::stringstream str;
+        tz::serialiser_t ser{ &str };
+        ser << data;
+        streamed = str.str();
+    });
+    auto t_stream_in = tz::bench::best_of( 3, [ & ]() {
+        std::stringstream str( streamed );
+        tz::deserialiser_t des{ &str };
+        T back;
+        des >> back;
+    });
+
+    tz::memory_sink_t sink( bytes_hint );
+    auto t_sink_out = tz::bench::best_of( 3, [ & ]() {
+        sink.clear();
+        auto ser = tz::make_serialiser( sink );
+        ser << data;
+    });
+    auto t_span_in = tz::bench::best_of( 3, [ & ]() {
+        auto des = tz::make_deserialiser( sink.bytes() );
+        T back;
+        des >> back;
+    });
+
+    double mb = sink.size() * 1e-6;
+    std::printf( "%-22s write stream %8.1f MB/s  sink %8.1f MB/s\n",
+                 name, mb / t_stream_out, mb / t_sink_out );
+    std::printf( "%-22s read  stream %8.1f MB/s  span %8.1f MB/s\n",
+                 name, mb / t_stream_in, mb / t_span_in );
+}
+}
+
+int
+main( int argc, char ** argv )
+{
+    auto n = tz::bench::argument_or( argc, argv, 1, 4000000 );
+
+    std::vector< std::complex< float > > spectrum( n, { 1.0f, -2.0f } );
+    compare( "vector<complex<float>>", spectrum, n * 8 + 8 );
+
+    std::vector< record_t > records( n / 4, record_t{ 1, 2.0, { 3, 4, 5 } } );
+    compare( "vector<record>", records, n * 6 );
+    return 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#ifndef FILE_2CFEBC29CC46CB0_6F611C8EF2D7F460_INCLUDED
+#define FILE_2CFEBC29CC46CB0_6F611C8EF2D7F460_INCLUDED
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+/* Tiny helpers shared by the benchmark programs.  No framework on
+   purpose: every benchmark is a plain executable printing a table. */
+
+namespace tz::bench {
+
+using clock_t = std::chrono::steady_clock;
+
+inline
+double
+seconds_since( clock_t::time_point start )
+{
+    return std::chrono::duration< double >( clock_t::now() - start ).count();
+}
+
+inline
+double
+percentile( std::vector< double > values, double p )
+/* Nearest rank, takes a copy on purpose. */
+{
+    if( values.empty() ) {
+        return 0.0;
+    }
+    auto rank = static_cast< size_t >( p * (values.size() - 1) + 0.5 );
+    std::nth_element( values.begin(), values.begin() + rank, values.end());
+    return values[ rank ];
+}
+
+inline
+size_t
+argument_or( int argc, char ** argv, int idx, size_t fallback )
+{
+    if( argc > idx ) {
+        return std::strtoull( argv[ idx ], nullptr, 10 );
+    }
+    return fallback;
+}
+
+template< typename F >
+double
+best_of( int runs, F const & f )
+/* Runs f several times and returns the smallest duration in
+   seconds. */
+{
+    double best = 1e300;
+    for( int k = 0; k < runs; k = k + 1 ) {
+        auto start = clock_t::now();
+        f();
+        best = std::min( best, seconds_since( start ));
+    }
+    return best;
+}
+}
+#endif
@@ -0,0 +1,72 @@
+/* Row and column convolution: the element-wise Eigen block code that
+   tz::convolve used before, against the direct and FFT kernels of
+   the engine, for several kernel lengths.
+
+   Usage: bench-dsp [rows] [columns] [threads] */
+#include <tanz/dsp.h++>
+#include "bench-common.h++"
+
+namespace {
+
+Eigen::MatrixXf
+previous_convolve( Eigen::MatrixXf const & a, Eigen::VectorXf const & b )
+{
+    Eigen::MatrixXf h( a.rows(), a.cols() - b.size() + 1);
+    for( Eigen::Index row = 0; row < h.rows(); row = row + 1 ) {
+        for( Eigen::Index c = 0; c < h.cols(); c = c + 1 ) {
+            h( row, c ) = (a.block( row, c, 1, b.size()).array() * b.transpose().reverse().array()).matrix().sum();
+        }
+    }
+    return h;
+}
+
+double
+ns_per_output( double seconds, Eigen::MatrixXf const & h )
+{
+    return 1e9 * seconds / double( std::max< Eigen::Index >( 1, h.size() ));
+}
+}
+
+int
+main( int argc, char ** argv )
+{
+    auto rows = Eigen::Index( tz::bench::argument_or( argc, argv, 1, 256 ));
+    auto cols = Eigen::Index( tz::bench::argument_or( argc, argv, 2, 4096 ));
+    auto threads = tz::bench::argument_or( argc, argv, 3, 0 );
+
+    Eigen::MatrixXf a = Eigen::MatrixXf::Random( rows, cols );
+    Eigen::MatrixXf at = a.transpose();
+
+    std::printf( "%lld x %lld, %zu threads (0: all), ns per output sample\n\n",
+                 static_cast< long long >( rows ), static_cast< long long >( cols ), threads );
+    std::printf( "%8s %10s %10s %10s %10s %10s %10s\n",
+                 "kernel", "previous", "direct", "fft", "auto", "auto x1", "cols auto" );
+    for( Eigen::Index k : { 3, 7, 15, 31, 63, 127, 255, 1023 } ) {
+        Eigen::VectorXf b = Eigen::VectorXf::Random( k );
+        tz::convolution_options_t options;
+        options.threads = threads;
+
+        Eigen::MatrixXf h;
+        double previous = 0.0;
+        if( k <= 63 ) {
+            previous = ns_per_output( tz::bench::best_of( 1, [ & ]() { h = previous_convolve( a, b ); } ), h );
+        }
+        options.method = tz::CONV_METHOD_DIRECT;
+        auto direct = ns_per_output( tz::bench::best_of( 3, [ & ]() { h = tz::convolve_rows( a, b, options ); } ), h );
+        options.method = tz::CONV_METHOD_FFT;
+        auto fft = ns_per_output( tz::bench::best_of( 3, [ & ]() { h = tz::convolve_rows( a, b, options ); } ), h );
+        options.method = tz::CONV_METHOD_AUTO;
+        auto automatic = ns_per_output( tz::bench::best_of( 3, [ & ]() { h = tz::convolve_rows( a, b, options ); } ), h );
+        auto serial_options = options;
+        serial_options.threads = 1;
+        auto serial = ns_per_output( tz::bench::best_of( 3, [ & ]() { h = tz::convolve_rows( a, b, serial_options ); } ), h );
+        auto columns = ns_per_output( tz::bench::best_of( 3, [ & ]() { h = tz::convolve_cols( at, b, options ); } ), h );
+        if( k <= 63 ) {
+            std::printf( "%8lld %10.2f", static_cast< long long >( k ), previous );
+        } else {
+            std::printf( "%8lld %10s", static_cast< long long >( k ), "-" );
+        }
+        std::printf( " %10.2f %10.2f %10.2f %10.2f %10.2f\n", direct, fft, automatic, serial, columns );
+    }
+    return 0;
+}
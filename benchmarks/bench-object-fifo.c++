@@ -0,0 +1,135 @@
+/* Throughput and latency of tz::object_fifo with its backends.
+
+   Usage: bench-object-fifo [elements per producer] */
+#include <tanz/object-fifo.h++>
+#include "bench-common.h++"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace {
+
+template< typename backend >
+double
+throughput( size_t producers, size_t consumers, size_t n, size_t batch )
+/* Returns million elements per second. */
+{
+    tz::object_fifo< uint64_t, backend > fifo( 1024 );
+    std::atomic< uint64_t > received( 0 );
+
+    auto start = tz::bench::clock_t::now();
+
+    std::vector< std::thread > readers;
+    for( size_t c = 0; c < consumers; c = c + 1 ) {
+        readers.emplace_back(
+            [ &fifo, &received, batch ]()
+            {
+                std::vector< uint64_t > buffer( batch );
+                uint64_t local = 0;
+                try {
+                    for( ;; ) {
+                        if( batch == 1 ) {
+                            fifo.read_blockingly();
+                            local = local + 1;
+                        } else {
+                            local = local + fifo.read_batch( buffer.begin(), batch );
+                        }
+                    }
+                } catch( tz::fifo_is_closed const & ) {
+                }
+                received += local;
+            });
+    }
+
+    std::vector< std::thread > writers;
+    for( size_t p = 0; p < producers; p = p + 1 ) {
+        writers.emplace_back(
+            [ &fifo, n, batch ]()
+            {
+                std::vector< uint64_t > buffer( batch );
+                for( size_t k = 0; k < n; k = k + batch ) {
+                    if( batch == 1 ) {
+                        fifo.write_blockingly( k );
+                    } else {
+                        fifo.write_batch( buffer.begin(), buffer.end());
+                    }
+                }
+            });
+    }
+    for( auto & t : writers ) {
+        t.join();
+    }
+    fifo.close();
+    for( auto & t : readers ) {
+        t.join();
+    }
+
+    return received.load() / tz::bench::seconds_since( start ) * 1e-6;
+}
+
+template< typename backend >
+std::pair< double, double >
+ping_pong_latency( size_t rounds )
+/* Returns median and 99th percentile of a round trip in µs. */
+{
+    tz::object_fifo< uint64_t, backend > ping( 1 );
+    tz::object_fifo< uint64_t, backend > pong( 1 );
+
+    std::thread echo(
+        [ & ]()
+        {
+            try {
+                for( ;; ) {
+                    pong.write_blockingly( ping.read_blockingly());
+                }
+            } catch( tz::fifo_is_closed const & ) {
+            }
+        });
+
+    std::vector< double > samples;
+    samples.reserve( rounds );
+    for( size_t k = 0; k < rounds; k = k + 1 ) {
+        auto start = tz::bench::clock_t::now();
+        ping.write_blockingly( k );
+        pong.read_blockingly();
+        samples.push_back( tz::bench::seconds_since( start ) * 1e6 );
+    }
+    ping.close();
+    echo.join();
+
+    return { tz::bench::percentile( samples, 0.5 ),
+             tz::bench::percentile( samples, 0.99 ) };
+}
+
+template< typename backend >
+void
+report( char const * name, size_t n, bool multi )
+{
+    std::vector< std::pair< size_t, size_t > > configurations = { { 1, 1 } };
+    if( multi ) {
+        configurations.push_back( { 2, 2 } );
+        configurations.push_back( { 4, 4 } );
+    }
+    for( auto [ p, c ] : configurations ) {
+        for( size_t batch : { size_t( 1 ), size_t( 32 ) } ) {
+            std::printf( "%-8s %2zuP/%-2zuC batch %3zu  %8.2f Melem/s\n",
+                         name, p, c, batch, throughput< backend >( p, c, n, batch ));
+        }
+    }
+    auto [ median, p99 ] = ping_pong_latency< backend >( 20000 );
+    std::printf( "%-8s round trip  median %6.2f µs  p99 %6.2f µs\n", name, median, p99 );
+}
+}
+
+int
+main( int argc, char ** argv )
+{
+    auto n = tz::bench::argument_or( argc, argv, 1, 1000000 );
+
+    report< tz::fifo_backend_locked >( "locked", n, true );
+    report< tz::fifo_backend_spsc_ring >( "spsc", n, false );
+    report< tz::fifo_backend_mpmc_ring >( "mpmc", n, true );
+    return 0;
+}
@@ -0,0 +1,159 @@
+/* optional_threaded_t while scrolling: every frame a window of lazy
+   values is rescheduled, most computations get superseded before
+   they finish.  Compares a thread per computation, as std::async
+   does, against the shared pool with cancellation.  Prints the
+   latency from the last assignment to SET and the peak number of
+   threads of the process.
+
+   Usage: bench-optional-threaded [frames] [work in us] */
+#include <tanz/optional-queued-promise.h++>
+#include "bench-common.h++"
+#include <atomic>
+#include <fstream>
+#include <thread>
+
+namespace {
+
+struct thread_per_task_t
+    : public tz::executor_t
+/* What std::async( std::launch::async, ... ) does. */
+{
+    std::atomic< size_t > running{ 0 };
+
+    void
+    submit( task_type task, tz::executor_priority_t ) override
+    {
+        running += 1;
+        std::thread(
+            [ this, task = std::move( task ) ]()
+            {
+                task();
+                running -= 1;
+            } ).detach();
+    }
+
+    ~thread_per_task_t()
+    {
+        while( running.load() ) {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ));
+        }
+    }
+};
+
+size_t
+thread_count()
+{
+    std::ifstream status( "/proc/self/status" );
+    std::string line;
+    while( std::getline( status, line )) {
+        if( line.rfind( "Threads:", 0 ) == 0 ) {
+            return std::strtoull( line.c_str() + 8, nullptr, 10 );
+        }
+    }
+    return 0;
+}
+
+int
+busy( std::chrono::microseconds work, std::stop_token const * token )
+{
+    auto end = tz::bench::clock_t::now() + work;
+    int n = 0;
+    while( tz::bench::clock_t::now() < end ) {
+        n = n + 1;
+        if( token and token->stop_requested() ) {
+            break;
+        }
+    }
+    return n;
+}
+
+struct result_t {
+    std::vector< double > latencies;
+    size_t peak_threads = 0;
+    double seconds = 0.0;
+};
+
+result_t
+scroll( tz::executor_t & executor, bool cancellable, size_t frames, std::chrono::microseconds work )
+{
+    constexpr size_t items = 256;
+    constexpr size_t visible = 24;
+
+    result_t r;
+    std::vector< tz::optional_threaded_t< int > > values;
+    std::vector< tz::bench::clock_t::time_point > assigned( items );
+    std::vector< bool > measured( items, false );
+    for( size_t k = 0; k < items; k = k + 1 ) {
+        values.emplace_back( executor );
+    }
+
+    auto start = tz::bench::clock_t::now();
+    for( size_t frame = 0; frame < frames + items; frame = frame + 1 ) {
+        /* Scrolling for the first frames, then standing still until
+           everything is done. */
+        if( frame < frames ) {
+            auto first = frame % (items - visible);
+            for( size_t k = first; k < first + visible; k = k + 1 ) {
+                auto & v = values[ k ];
+                if( v.state() == tz::optional_threaded_t< int >::SET ) {
+                    continue;
+                }
+                if( cancellable ) {
+                    v = [ work ]( std::stop_token token ) { return busy( work, &token ); };
+                } else {
+                    v = [ work ]() { return busy( work, nullptr ); };
+                }
+                assigned[ k ] = tz::bench::clock_t::now();
+                measured[ k ] = true;
+            }
+        }
+        bool waiting = false;
+        for( size_t k = 0; k < items; k = k + 1 ) {
+            values[ k ].update();
+            if( measured[ k ] and values[ k ].state() == tz::optional_threaded_t< int >::SET ) {
+                r.latencies.push_back( 1e3 * tz::bench::seconds_since( assigned[ k ] ));
+                measured[ k ] = false;
+            }
+            waiting = waiting or measured[ k ];
+        }
+        r.peak_threads = std::max( r.peak_threads, thread_count() );
+        if( (frame >= frames) and not waiting ) {
+            break;
+        }
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ));
+    }
+    r.seconds = tz::bench::seconds_since( start );
+    return r;
+}
+
+void
+row( char const * name, result_t const & r )
+{
+    std::printf( "%-28s %8zu %10.2f %10.2f %10.2f %8zu %8.2f\n",
+                 name,
+                 r.latencies.size(),
+                 tz::bench::percentile( r.latencies, 0.5 ),
+                 tz::bench::percentile( r.latencies, 0.99 ),
+                 r.latencies.empty() ? 0.0 : *std::max_element( r.latencies.begin(), r.latencies.end() ),
+                 r.peak_threads,
+                 r.seconds );
+}
+}
+
+int
+main( int argc, char ** argv )
+{
+    auto frames = tz::bench::argument_or( argc, argv, 1, 300 );
+    auto work = std::chrono::microseconds( tz::bench::argument_or( argc, argv, 2, 2000 ));
+
+    std::printf( "%zu frames, %lld us per computation, %u hardware threads\n\n",
+                 frames, static_cast< long long >( work.count() ), std::thread::hardware_concurrency() );
+    std::printf( "%-28s %8s %10s %10s %10s %8s %8s\n",
+                 "", "values", "p50 ms", "p99 ms", "max ms", "threads", "total s" );
+    {
+        thread_per_task_t executor;
+        row( "thread per task (std::async)", scroll( executor, false, frames, work ));
+    }
+    row( "shared pool, cancellation", scroll( tz::default_executor(), true, frames, work ));
+    return 0;
+}
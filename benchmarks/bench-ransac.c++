@@ -0,0 +1,208 @@
+/* Robust homography and conic estimation on synthetic observations
+   with a controlled outlier ratio.  "previous" is a RANSAC loop
+   around the former solvers, a dynamic DLT matrix and a JacobiSVD
+   per hypothesis, scored point by point.
+
+   Usage: bench-ransac [observations] [threads] */
+#include <tanz/conics.h++>
+#include <tanz/homography.h++>
+#include "bench-common.h++"
+#include <random>
+
+namespace {
+
+Eigen::Matrix3d
+previous_homography( std::vector< Eigen::Vector2d > const & l, std::vector< Eigen::Vector2d > const & r )
+{
+    Eigen::MatrixXd dlt( l.size() * 3, 9 );
+    for( size_t k = 0; k < l.size(); k = k + 1 ) {
+        auto b = r[ k ].homogeneous().transpose();
+        dlt.block< 1, 3 >( k * 3, 0 ) = Eigen::Vector3d::Zero().transpose();
+        dlt.block< 1, 3 >( k * 3, 3 ) = - b;
+        dlt.block< 1, 3 >( k * 3, 6 ) = l[ k ]( 1 ) * b;
+        dlt.block< 1, 3 >( k * 3 + 1, 0 ) = b;
+        dlt.block< 1, 3 >( k * 3 + 1, 3 ) = Eigen::Vector3d::Zero().transpose();
+        dlt.block< 1, 3 >( k * 3 + 1, 6 ) = - l[ k ]( 0 ) * b;
+        dlt.block< 1, 3 >( k * 3 + 2, 0 ) = - l[ k ]( 1 ) * b;
+        dlt.block< 1, 3 >( k * 3 + 2, 3 ) = l[ k ]( 0 ) * b;
+        dlt.block< 1, 3 >( k * 3 + 2, 6 ) = Eigen::Vector3d::Zero().transpose();
+    }
+    Eigen::JacobiSVD< Eigen::MatrixXd > svd( dlt, Eigen::ComputeThinU | Eigen::ComputeFullV );
+    Eigen::VectorXd h = svd.matrixV().col( 8 );
+    Eigen::Matrix3d m = Eigen::Map< Eigen::Matrix< double, 3, 3, Eigen::RowMajor > >( h.data() );
+    return m * (1 / m( 2, 2 ));
+}
+
+Eigen::Matrix3d
+previous_conic( std::vector< Eigen::Vector2d > const & obs )
+{
+    Eigen::MatrixXd c( obs.size(), 6 );
+    for( size_t k = 0; k < obs.size(); k = k + 1 ) {
+        double x = obs[ k ]( 0 );
+        double y = obs[ k ]( 1 );
+        c.block< 1, 6 >( k, 0 ) << x * x, 2.0 * x * y, y * y, 2.0 * x, 2.0 * y, 1.0;
+    }
+    Eigen::JacobiSVD< Eigen::MatrixXd > svd( c, Eigen::ComputeThinU | Eigen::ComputeFullV );
+    Eigen::VectorXd p = svd.matrixV().col( 5 );
+    Eigen::Matrix3d q;
+    q << p( 0 ), p( 1 ), p( 3 ), p( 1 ), p( 2 ), p( 4 ), p( 3 ), p( 4 ), p( 5 );
+    return q;
+}
+
+template< size_t sample_size, typename Fit, typename Inlier >
+size_t
+previous_ransac( size_t n, tz::ransac_options_t const & options, Fit const & fit, Inlier const & inlier )
+/* Returns the number of hypotheses. */
+{
+    std::mt19937 rng( 1 );
+    std::uniform_int_distribution< size_t > pick( 0, n - 1 );
+    size_t best = 0;
+    size_t limit = options.max_hypotheses;
+    size_t h = 0;
+    for( ; h < limit; h = h + 1 ) {
+        std::vector< size_t > sample;
+        while( sample.size() < sample_size ) {
+            auto k = pick( rng );
+            if( std::find( sample.begin(), sample.end(), k ) == sample.end() ) {
+                sample.push_back( k );
+            }
+        }
+        auto model = fit( sample );
+        size_t count = 0;
+        for( size_t k = 0; k < n; k = k + 1 ) {
+            count = count + (inlier( model, k ) ? 1 : 0);
+        }
+        if( count > best ) {
+            best = count;
+            limit = std::min( limit, tz::impl::ransac_required_hypotheses(
+                                  count, n, sample_size, options.confidence, options.max_hypotheses ));
+        }
+    }
+    return h;
+}
+
+void
+row( char const * name, double outliers, double seconds, size_t hypotheses, size_t inliers, double error )
+{
+    std::printf( "%-10s %8.2f %10.3f %10zu %10.2f %8zu %12.2e\n",
+                 name, outliers, 1e3 * seconds, hypotheses,
+                 1e6 * seconds / double( std::max< size_t >( 1, hypotheses )), inliers, error );
+}
+}
+
+int
+main( int argc, char ** argv )
+{
+    auto n = tz::bench::argument_or( argc, argv, 1, 1000 );
+    auto threads = tz::bench::argument_or( argc, argv, 2, 0 );
+
+    Eigen::Matrix3d truth;
+    truth <<
+        0.9, 0.1, 30.0,
+        -0.05, 1.1, -20.0,
+        1e-4, -5e-5, 1.0;
+
+    std::printf( "%zu observations, %zu threads (0: all)\n\n", n, threads );
+    std::printf( "%-10s %8s %10s %10s %10s %8s %12s\n",
+                 "homography", "outliers", "ms", "hypotheses", "us / hyp", "inliers", "rel. error" );
+    for( double ratio : { 0.1, 0.3, 0.5, 0.7 } ) {
+        std::mt19937 rng( 7 );
+        std::uniform_real_distribution< double > position( 0.0, 1000.0 );
+        std::normal_distribution< double > jitter( 0.0, 0.5 );
+        std::bernoulli_distribution is_outlier( ratio );
+        std::vector< Eigen::Vector2d > left;
+        std::vector< Eigen::Vector2d > right;
+        for( size_t k = 0; k < n; k = k + 1 ) {
+            Eigen::Vector2d r( position( rng ), position( rng ));
+            Eigen::Vector2d l = (truth * r.homogeneous()).hnormalized();
+            l = is_outlier( rng )
+                ? Eigen::Vector2d( position( rng ), position( rng ))
+                : Eigen::Vector2d( l + Eigen::Vector2d( jitter( rng ), jitter( rng )));
+            left.push_back( l );
+            right.push_back( r );
+        }
+        tz::ransac_options_t options;
+        options.threshold = 2.0;
+
+        size_t hypotheses = 0;
+        auto previous = tz::bench::best_of( 1, [ & ]() {
+            hypotheses = previous_ransac< 4 >(
+                n, options,
+                [ & ]( std::vector< size_t > const & s ) {
+                    std::vector< Eigen::Vector2d > l, r;
+                    for( auto k : s ) {
+                        l.push_back( left[ k ] );
+                        r.push_back( right[ k ] );
+                    }
+                    return previous_homography( l, r );
+                },
+                [ & ]( Eigen::Matrix3d const & h, size_t k ) {
+                    return ((h * right[ k ].homogeneous()).hnormalized() - left[ k ]).squaredNorm()
+                        <= options.threshold * options.threshold;
+                } );
+        });
+        row( "previous", ratio, previous, hypotheses, 0, 0.0 );
+
+        for( size_t t : { size_t( 1 ), threads } ) {
+            options.threads = t;
+            tz::robust_homography_t result;
+            auto seconds = tz::bench::best_of( 3, [ & ]() {
+                result = tz::estimate_homography_2d( left, right, options );
+            });
+            row( (t == 1) ? "ransac x1" : "ransac", ratio, seconds, result.hypotheses, result.inliers.size(),
+                 (result.homography - truth).norm() / truth.norm() );
+        }
+    }
+
+    std::printf( "\n%-10s %8s %10s %10s %10s %8s %12s\n",
+                 "conic", "outliers", "ms", "hypotheses", "us / hyp", "inliers", "center err" );
+    for( double ratio : { 0.1, 0.3, 0.5 } ) {
+        std::mt19937 rng( 11 );
+        std::uniform_real_distribution< double > angle( 0.0, 2.0 * M_PI );
+        std::uniform_real_distribution< double > position( -200.0, 200.0 );
+        std::normal_distribution< double > jitter( 0.0, 0.2 );
+        std::bernoulli_distribution is_outlier( ratio );
+        Eigen::Vector2d center( 20.0, -40.0 );
+        std::vector< Eigen::Vector2d > obs;
+        for( size_t k = 0; k < n; k = k + 1 ) {
+            auto t = angle( rng );
+            Eigen::Vector2d p = center + Eigen::Rotation2Dd( 0.3 ) * Eigen::Vector2d( 60 * std::cos( t ), 100 * std::sin( t ));
+            obs.push_back( is_outlier( rng )
+                           ? Eigen::Vector2d( position( rng ), position( rng ))
+                           : Eigen::Vector2d( p + Eigen::Vector2d( jitter( rng ), jitter( rng ))));
+        }
+        tz::ransac_options_t options;
+        options.threshold = 1.0;
+
+        size_t hypotheses = 0;
+        auto previous = tz::bench::best_of( 1, [ & ]() {
+            hypotheses = previous_ransac< 5 >(
+                n, options,
+                [ & ]( std::vector< size_t > const & s ) {
+                    std::vector< Eigen::Vector2d > p;
+                    for( auto k : s ) {
+                        p.push_back( obs[ k ] );
+                    }
+                    return previous_conic( p );
+                },
+                [ & ]( Eigen::Matrix3d const & q, size_t k ) {
+                    Eigen::Vector3d x = obs[ k ].homogeneous();
+                    Eigen::Vector3d g = q * x;
+                    auto v = x.dot( g );
+                    return v * v <= 4.0 * g.head< 2 >().squaredNorm() * options.threshold * options.threshold;
+                } );
+        });
+        row( "previous", ratio, previous, hypotheses, 0, 0.0 );
+
+        for( size_t t : { size_t( 1 ), threads } ) {
+            options.threads = t;
+            tz::robust_conic_t result;
+            auto seconds = tz::bench::best_of( 3, [ & ]() {
+                result = tz::estimate_conic_params( obs, options );
+            });
+            row( (t == 1) ? "ransac x1" : "ransac", ratio, seconds, result.hypotheses, result.inliers.size(),
+                 (tz::conic_center( result.params ) - center).norm() );
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+/* Cost of a trace span: disabled, with the TSC, with steady_clock
+   and with CPU time, against the time_marker_t pair it replaces.
+
+   Usage: bench-tracing [number of spans] */
+#include <tanz/tracing.h++>
+#include "bench-common.h++"
+
+namespace {
+
+template< typename F >
+double
+ns_per_call( size_t n, F const & f )
+{
+    return 1e9 * tz::bench::best_of( 5, [ & ]() {
+        for( size_t k = 0; k < n; k = k + 1 ) {
+            f();
+        }
+    }) / n;
+}
+
+template< typename F >
+double
+ns_per_span( size_t n, tz::trace_collector_t & collector, F const & f )
+/* Spans in batches that fit the ring, draining in between, so only
+   the spans are timed and not the collector. */
+{
+    constexpr size_t batch = 50000;
+    double seconds = 0.0;
+    for( size_t done = 0; done < n; done = done + batch ) {
+        collector.drain();
+        auto start = tz::bench::clock_t::now();
+        for( size_t k = 0; k < batch; k = k + 1 ) {
+            f();
+        }
+        seconds = seconds + tz::bench::seconds_since( start );
+    }
+    return 1e9 * seconds / ((n + batch - 1) / batch * batch);
+}
+
+void
+row( char const * name, double ns )
+{
+    std::printf( "%-34s %8.1f ns\n", name, ns );
+}
+}
+
+int
+main( int argc, char ** argv )
+{
+    auto n = tz::bench::argument_or( argc, argv, 1, 2000000 );
+    volatile size_t sink = 0;
+
+    row( "span, no collector",
+         ns_per_call( n, [ & ]() { tz::trace_span_t span( "x" ); sink = sink + 1; } ));
+
+    for( bool tsc : { true, false } ) {
+        tz::trace_collector_options_t options;
+        options.use_tsc = tsc;
+        options.ring_capacity = 1 << 16;
+        options.interval = std::chrono::hours( 1 );
+        tz::trace_collector_t collector( options );
+
+        row( tsc ? "span, tsc" : "span, steady_clock",
+             ns_per_span( n, collector, [ & ]() { tz::trace_span_t span( "x" ); sink = sink + 1; } ));
+        row( tsc ? "cpu span, tsc" : "cpu span, steady_clock",
+             ns_per_span( n / 10, collector, [ & ]() { tz::trace_cpu_span_t span( "y" ); sink = sink + 1; } ));
+
+        auto stats = collector.statistics();
+        for( auto const & s : stats ) {
+            std::printf( "    %-6s count %9llu  mean %7.1f ns  p50 %7.1f  p99 %7.1f\n",
+                         s.label.c_str(),
+                         static_cast< unsigned long long >( s.wall.count() ),
+                         s.wall.mean(), s.wall.percentile( 0.5 ), s.wall.percentile( 0.99 ));
+        }
+        std::printf( "    dropped %llu, %.4f ns per tick\n",
+                     static_cast< unsigned long long >( collector.dropped() ),
+                     collector.ns_per_tick() );
+    }
+
+    row( "time_marker_t pair",
+         ns_per_call( n / 10, [ & ]() {
+             tz::time_marker_t a;
+             sink = sink + 1;
+             tz::time_marker_t b;
+             auto d = b - a;
+             sink = sink + static_cast< size_t >( d.real_time );
+         }));
+    return 0;
+}
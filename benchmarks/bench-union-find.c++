@@ -0,0 +1,86 @@
+/* Connected components of a random pixel grid: the sequential
+   union_finder_t against concurrent_union_finder_t with growing
+   numbers of threads, for adding the relations and for labelling.
+
+   Usage: bench-union-find [side length] [max threads] */
+#include <tanz/union-find.h++>
+#include "bench-common.h++"
+
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+std::vector< std::pair< size_t, size_t > >
+grid_relations( size_t side )
+/* Neighbours in x and y, each present with probability 0.55, near
+   the percolation threshold, so there are long chains and many
+   components.  Shuffled like the output of a tiled labeller. */
+{
+    std::mt19937_64 gen( 1 );
+    std::bernoulli_distribution present( 0.55 );
+    std::vector< std::pair< size_t, size_t > > relations;
+    for( size_t y = 0; y < side; y = y + 1 ) {
+        for( size_t x = 0; x < side; x = x + 1 ) {
+            auto k = y * side + x;
+            if( (x + 1 < side) and present( gen )) {
+                relations.emplace_back( k, k + 1 );
+            }
+            if( (y + 1 < side) and present( gen )) {
+                relations.emplace_back( k, k + side );
+            }
+        }
+    }
+    std::shuffle( relations.begin(), relations.end(), gen );
+    return relations;
+}
+}
+
+int
+main( int argc, char ** argv )
+{
+    auto side = tz::bench::argument_or( argc, argv, 1, 2048 );
+    auto max_threads = tz::bench::argument_or(
+        argc, argv, 2, std::max< size_t >( 1, std::thread::hardware_concurrency() ));
+
+    auto relations = grid_relations( side );
+    auto n = side * side;
+    std::printf( "%zu elements, %zu relations\n\n", n, relations.size() );
+
+    size_t classes = 0;
+    auto t_relations = tz::bench::best_of( 3, [ & ]() {
+        tz::union_finder_t uf( n );
+        for( auto const & r : relations ) {
+            uf.add_relation( r.first, r.second );
+        }
+    });
+    tz::union_finder_t uf( n );
+    for( auto const & r : relations ) {
+        uf.add_relation( r.first, r.second );
+    }
+    auto t_labels = tz::bench::best_of( 3, [ & ]() {
+        classes = uf.labels().size();
+    });
+    std::printf( "%-14s %8s %13s %10s %13s\n",
+                 "variant", "threads", "relations", "speedup", "labels" );
+    std::printf( "%-14s %8d %10.1f ms %10s %10.1f ms   (%zu classes)\n",
+                 "sequential", 1, 1e3 * t_relations, "1.00", 1e3 * t_labels, classes );
+
+    for( size_t threads = 1; threads <= max_threads; threads = 2 * threads ) {
+        auto t_concurrent = tz::bench::best_of( 3, [ & ]() {
+            tz::concurrent_union_finder_t cuf( n );
+            cuf.add_relations( relations, threads );
+        });
+        tz::concurrent_union_finder_t cuf( n );
+        cuf.add_relations( relations, threads );
+        auto t_concurrent_labels = tz::bench::best_of( 3, [ & ]() {
+            classes = cuf.labels( threads ).size();
+        });
+        std::printf( "%-14s %8zu %10.1f ms %10.2f %10.1f ms   (%zu classes)\n",
+                     "concurrent", threads, 1e3 * t_concurrent, t_relations / t_concurrent,
+                     1e3 * t_concurrent_labels, classes );
+    }
+    return 0;
+}
@@ -7,12 +7,24 @@
 
 namespace tz {
 
+template< typename T, int rows, int cols, int options, int max_rows, int max_cols >
+struct is_bitwise_serialisable< Eigen::Matrix< T, rows, cols, options, max_rows, max_cols > >
+    : public std::bool_constant< is_bitwise_serialisable< T >::value
+                                 and (rows != Eigen::Dynamic)
+                                 and (cols != Eigen::Dynamic)
+                                 and (sizeof( Eigen::Matrix< T, rows, cols, options, max_rows, max_cols > )
+                                      == sizeof( T ) * rows * cols) >
+/* Fixed size matrices, so std::vector< Eigen::Vector3d > is copied
+   in one go. */
+{
+};
+
 template< typename T >
 serialiser_t &
 operator << ( serialiser_t & out, Eigen::Matrix< T, Eigen::Dynamic, Eigen::Dynamic > const & m )
 {
     out << int64_t( m.rows()) << int64_t(m.cols());    
-    (*out.stream).write( reinterpret_cast< char const * >( m.data()), sizeof( T) * m.rows() * m.cols());
+    out.write( m.data(), sizeof( T) * m.rows() * m.cols());
     return out;
 }
 
@@ -21,8 +33,7 @@ serialiser_t &
 operator << ( serialiser_t & out, Eigen::Matrix< T, rspec, Eigen::Dynamic > const & m )
 {
     out << int64_t(m.cols());
-    std::vector< T > buffer( m.rows() * m.cols());
-    (*out.stream).write( reinterpret_cast< char const * >( m.data()), sizeof( T ) * m.rows() * m.cols());
+    out.write( m.data(), sizeof( T ) * m.rows() * m.cols());
     return out;
 }
 
@@ -31,7 +42,7 @@ serialiser_t &
 operator << ( serialiser_t & out, Eigen::Matrix< T, Eigen::Dynamic, cspec > const & m )
 {
     out << int64_t(m.rows());
-    (*out.stream).write( reinterpret_cast< char const * >( m.data()), sizeof( T ) * m.rows() * m.cols());
+    out.write( m.data(), sizeof( T ) * m.rows() * m.cols());
     return out;
 }
 
@@ -39,7 +50,7 @@ template< typename T, int rspec, int cspec >
 serialiser_t &
 operator << ( serialiser_t & out, Eigen::Matrix< T, rspec, cspec > const & m )
 {
-    (*out.stream).write( reinterpret_cast< char const * >( m.data()), sizeof( T ) * m.rows() * m.cols());
+    out.write( m.data(), sizeof( T ) * m.rows() * m.cols());
     return out;
 }
 
@@ -55,19 +66,37 @@ operator << ( serialiser_t & out, Eigen::Affine2d const & m );
 serialiser_t &
 operator << ( serialiser_t & out, Eigen::Affine2f const & m );
 
+namespace impl {
+
+inline
+void
+require_matrix( deserialiser_t & in, int64_t rows, int64_t cols, size_t element_size )
+/* Throws for negative sizes and if there are not rows * cols
+   elements left, before the matrix is resized. */
+{
+    if( (rows < 0) or (cols < 0) ) {
+        throw std::runtime_error( "Negative matrix size." );
+    }
+    if( (cols != 0) and (uint64_t( rows ) > UINT64_MAX / uint64_t( cols )) ) {
+        throw std::runtime_error( "Matrix size overflows." );
+    }
+    in.require( uint64_t( rows ) * uint64_t( cols ), element_size );
+}
+}
+
 template< typename T >
 deserialiser_t &
 operator >> ( deserialiser_t & in, Eigen::Matrix< T, Eigen::Dynamic, Eigen::Dynamic > & m )
 {
-    int64_t rows;
-    int64_t cols;
+    int64_t rows = 0;
+    int64_t cols = 0;
     in >> rows >> cols;
     in.check();
 
+    impl::require_matrix( in, rows, cols, sizeof( T ));
     m.resize( rows, cols );
 
-    in.stream->read( reinterpret_cast< char* >( m.data()),
-                     sizeof( T ) * rows * cols );
+    in.read( m.data(), sizeof( T ) * rows * cols );
     return in;
 }
 
@@ -75,13 +104,13 @@ template< typename T, int rspec >
 deserialiser_t &
 operator >> ( deserialiser_t & in, Eigen::Matrix< T, rspec, Eigen::Dynamic > & m )
 {
-    int64_t cols;
+    int64_t cols = 0;
     in >> cols;
     in.check();
 
+    impl::require_matrix( in, rspec, cols, sizeof( T ));
     m.resize( rspec, cols );
-    in.stream->read( reinterpret_cast< char* >( m.data()),
-                     sizeof( T ) * cols * rspec );
+    in.read( m.data(), sizeof( T ) * cols * rspec );
     return in;
 }
 
@@ -89,13 +118,13 @@ template< typename T, int cspec >
 deserialiser_t &
 operator >> ( deserialiser_t & in, Eigen::Matrix< T, Eigen::Dynamic, cspec > & m )
 {
-    int64_t rows;
+    int64_t rows = 0;
     in >> rows;
     in.check();
 
+    impl::require_matrix( in, rows, cspec, sizeof( T ));
     m.resize( rows, cspec );
-    in.stream->read( reinterpret_cast< char* >( m.data()),
-                      sizeof( T ) * m.rows() * m.cols());
+    in.read( m.data(), sizeof( T ) * m.rows() * m.cols());
     return in;
 }
 
@@ -103,8 +132,7 @@ template< typename T, int rspec, int cspec >
 deserialiser_t &
 operator >> ( deserialiser_t & in, Eigen::Matrix< T, rspec, cspec > & m )
 {
-    in.stream->read( reinterpret_cast< char* >( m.data()),
-                      sizeof( T ) * m.rows() * m.cols());
+    in.read( m.data(), sizeof( T ) * m.rows() * m.cols());
     return in;
 }
 
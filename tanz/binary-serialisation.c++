@@ -1,152 +1,184 @@
 #include <tanz/binary-serialisation.h++>
+#include <algorithm>
+#include <cerrno>
+#include <system_error>
+
+#if __unix__
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#else
+#  error Memory mapped files not implemented for this platform
+#endif
+
 namespace tz {
 namespace {
 
-template< typename T >
-inline
-tz::serialiser_t &
-ser_vector( ::tz::serialiser_t & out, std::vector< T > const & v )
-{
-    out << uint64_t( v.size());
-    out.stream->write( reinterpret_cast< char const *>( v.data()),
-                       sizeof( T ) * v.size());
-    return out;
-}
-
-}
-::tz::serialiser_t &
-operator << ( ::tz::serialiser_t & out, std::vector< float > const & v )
-{
-    return ser_vector(out, v );
-}
-
-::tz::serialiser_t &
-operator << ( ::tz::serialiser_t & out, std::vector< double > const & v )
-{
-    return ser_vector(out, v );
-}
-
-
-::tz::serialiser_t &
-operator << ( ::tz::serialiser_t & out, std::vector< uint8_t > const & v )
-{
-    return ser_vector( out, v );
-}
-
-::tz::serialiser_t &
-operator << ( ::tz::serialiser_t & out, std::vector< uint16_t > const & v )
-{
-    return ser_vector( out, v );
-}
-
-::tz::serialiser_t &
-operator << ( ::tz::serialiser_t & out, std::vector< uint32_t > const & v )
-{
-    return ser_vector( out, v );
-}
-
-::tz::serialiser_t &
-operator << ( ::tz::serialiser_t & out, std::vector< uint64_t > const & v )
+[[noreturn]]
+void
+throw_errno()
 {
-    return ser_vector( out, v );
+    throw std::system_error(
+        std::error_code(
+            errno,
+            std::system_category()));
 }
 
-::tz::serialiser_t &
-operator << ( ::tz::serialiser_t & out, std::vector< int8_t > const & v )
-{
-    return ser_vector( out, v );
-}
+constexpr size_t mapped_file_chunk = size_t( 1 ) << 24;
 
-::tz::serialiser_t &
-operator << ( ::tz::serialiser_t & out, std::vector< int16_t > const & v )
-{
-    return ser_vector( out, v );
 }
 
-::tz::serialiser_t &
-operator << ( ::tz::serialiser_t & out, std::vector< int32_t > const & v )
+memory_sink_t::memory_sink_t( size_t initial_capacity )
+    : data( std::make_unique_for_overwrite< std::byte[] >( initial_capacity )),
+      capacity( initial_capacity )
 {
-    return ser_vector( out, v );
+    cursor = data.get();
+    limit = cursor + capacity;
 }
 
-::tz::serialiser_t &
-operator << ( ::tz::serialiser_t & out, std::vector< int64_t > const & v )
+size_t
+memory_sink_t::size() const
 {
-    return ser_vector( out, v );
+    return static_cast< size_t >( cursor - data.get());
 }
 
-namespace {
-template< typename T >
-::tz::deserialiser_t &
-des( ::tz::deserialiser_t & in, std::vector< T >  & v )
+std::span< std::byte const >
+memory_sink_t::bytes() const
 {
-    uint64_t len;
-    in >> len;
-    in.check();
-    v.resize( len );
-    in.stream->read( reinterpret_cast< char* >( v.data() ), sizeof( T ) * len );
-    return in;
-}
+    return { data.get(), size() };
 }
 
-::tz::deserialiser_t &
-operator >> ( ::tz::deserialiser_t & in, std::vector< float > & v )
+void
+memory_sink_t::clear()
 {
-    return des( in, v );
+    cursor = data.get();
 }
 
-::tz::deserialiser_t &
-operator >> ( ::tz::deserialiser_t & in, std::vector< double > & v )
+void
+memory_sink_t::reserve( size_t n )
 {
-    return des( in, v );
+    auto used = size();
+    auto new_capacity = std::max( 2 * capacity, used + n );
+    auto new_data = std::make_unique_for_overwrite< std::byte[] >( new_capacity );
+    if( used ) {
+        std::memcpy( new_data.get(), data.get(), used );
+    }
+    data = std::move( new_data );
+    capacity = new_capacity;
+    cursor = data.get() + used;
+    limit = data.get() + capacity;
 }
 
-::tz::deserialiser_t &
-operator >> ( ::tz::deserialiser_t & in, std::vector< uint8_t > & v )
+mapped_file_sink_t::mapped_file_sink_t( std::string const & path )
 {
-    return des( in, v );
+    fd = ::open( path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+    if( fd < 0 ) {
+        throw_errno();
+    }
 }
 
-::tz::deserialiser_t &
-operator >> ( ::tz::deserialiser_t & in, std::vector< uint16_t > & v )
+mapped_file_sink_t::~mapped_file_sink_t()
 {
-    return des( in, v );
+    try {
+        close();
+    } catch( ... ) {
+    }
 }
 
-::tz::deserialiser_t &
-operator >> ( ::tz::deserialiser_t & in, std::vector< uint32_t > & v )
+size_t
+mapped_file_sink_t::size() const
 {
-    return des( in, v );
+    return base ? static_cast< size_t >( cursor - base ) : written;
 }
 
-::tz::deserialiser_t &
-operator >> ( ::tz::deserialiser_t & in, std::vector< uint64_t > & v )
+void
+mapped_file_sink_t::reserve( size_t n )
+/* The mapping doubles, so writing a file is linear in its size.
+   The file is extended first, if that fails the old mapping is still
+   in place. */
 {
-    return des( in, v );
-}
+    written = size();
+    auto new_mapped = std::max( { 2 * mapped, written + n, mapped_file_chunk } );
+    new_mapped = ((new_mapped + mapped_file_chunk - 1) / mapped_file_chunk) * mapped_file_chunk;
 
-::tz::deserialiser_t &
-operator >> ( ::tz::deserialiser_t & in, std::vector< int8_t > & v )
-{
-    return des( in, v );
+    if( ::ftruncate( fd, new_mapped ) < 0 ) {
+        throw_errno();
+    }
+#if __linux__
+    auto p =
+        base
+        ? ::mremap( base, mapped, new_mapped, MREMAP_MAYMOVE )
+        : ::mmap( nullptr, new_mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if( p == MAP_FAILED ) {
+        throw_errno();
+    }
+#else
+    if( base ) {
+        ::munmap( base, mapped );
+        base = cursor = limit = nullptr;
+        mapped = 0;
+    }
+    auto p = ::mmap( nullptr, new_mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if( p == MAP_FAILED ) {
+        throw_errno();
+    }
+#endif
+    base = static_cast< std::byte * >( p );
+    mapped = new_mapped;
+    cursor = base + written;
+    limit = base + mapped;
+}
+
+void
+mapped_file_sink_t::close()
+{
+    if( fd < 0 ) {
+        return;
+    }
+    auto used = size();
+    if( base ) {
+        ::munmap( base, mapped );
+    }
+    base = cursor = limit = nullptr;
+    mapped = 0;
+    written = used;
+    auto truncated = ::ftruncate( fd, used );
+    ::close( fd );
+    fd = -1;
+    if( truncated < 0 ) {
+        throw_errno();
+    }
+}
+
+mapped_file_t::mapped_file_t( std::string const & path )
+{
+    int fd = ::open( path.c_str(), O_RDONLY );
+    if( fd < 0 ) {
+        throw_errno();
+    }
+    struct stat st;
+    if( ::fstat( fd, &st ) < 0 ) {
+        ::close( fd );
+        throw_errno();
+    }
+    length = st.st_size;
+    if( length ) {
+        base = ::mmap( nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if( base == MAP_FAILED ) {
+            base = nullptr;
+            ::close( fd );
+            throw_errno();
+        }
+        ::madvise( base, length, MADV_SEQUENTIAL );
+    }
+    ::close( fd );
+}
+
+mapped_file_t::~mapped_file_t()
+{
+    if( base ) {
+        ::munmap( base, length );
+    }
 }
-
-::tz::deserialiser_t &
-operator >> ( ::tz::deserialiser_t & in, std::vector< int16_t > & v )
-{
-    return des( in, v );
-}
-
-::tz::deserialiser_t &
-operator >> ( ::tz::deserialiser_t & in, std::vector< int32_t > & v )
-{
-    return des( in, v );
-}
-
-::tz::deserialiser_t &
-operator >> ( ::tz::deserialiser_t & in, std::vector< int64_t > & v )
-{
-    return des( in, v );
-}
-
 }
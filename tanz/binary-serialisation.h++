@@ -15,6 +15,14 @@
 #include <optional>
 #include <map>
 #include <chrono>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string>
+#include <type_traits>
 
 /* A very simplistic binary serialiser and deserialiser.
    The most important limitations are:
@@ -26,44 +34,329 @@
    
    So: Don't use this in any serious scenario.
    
-   I use this only for data i somehow recorded myself. */
-   
+   I use this only for data i somehow recorded myself.
+
+   Besides streams, a serialiser can write into a byte_sink_t (a
+   growable memory buffer or a memory mapped file) and a
+   deserialiser can read from a span of bytes, e.g. a mapped_file_t.
+   These skip the virtual stream calls per scalar.  The format is
+   the same in all cases.
+
+   Ranges of bitwise serialisable types (see
+   is_bitwise_serialisable) are written and read with a single
+   memcpy, and can be read without copying through array_view_t. */
+
 
 namespace tz {
 
+struct byte_sink_t
+/* Destination of a serialiser_t besides std::ostream.  Writing is
+   an inline memcpy, only running out of space is a virtual call. */
+{
+    std::byte * cursor = nullptr;
+    std::byte * limit = nullptr;
+
+    virtual ~byte_sink_t() = default;
+
+    inline
+    void
+    write( void const * p, size_t n )
+    {
+        if( static_cast< size_t >( limit - cursor ) < n ) {
+            reserve( n );
+        }
+        if( n ) {
+            std::memcpy( cursor, p, n );
+            cursor = cursor + n;
+        }
+    }
+
+protected:
+    virtual
+    void
+    reserve( size_t n ) = 0;
+    /* Afterwards there have to be at least n bytes between cursor
+       and limit. */
+};
+
+struct memory_sink_t
+    : public byte_sink_t
+/* A growable, contiguous buffer. */
+{
+    explicit memory_sink_t( size_t initial_capacity = 4096 );
+
+    size_t
+    size() const;
+
+    std::span< std::byte const >
+    bytes() const;
+
+    void
+    clear();
+
+protected:
+    void
+    reserve( size_t n ) override;
+
+private:
+    std::unique_ptr< std::byte[] > data;
+    size_t capacity = 0;
+};
+
+struct mapped_file_sink_t
+    : public byte_sink_t
+/* Writes into a memory mapped file, which grows geometrically.  On
+   close() or destruction the file is truncated to the bytes
+   written. */
+{
+    explicit mapped_file_sink_t( std::string const & path );
+    ~mapped_file_sink_t();
+
+    mapped_file_sink_t( mapped_file_sink_t const & ) = delete;
+    mapped_file_sink_t & operator = ( mapped_file_sink_t const & ) = delete;
+
+    size_t
+    size() const;
+
+    void
+    close();
+
+protected:
+    void
+    reserve( size_t n ) override;
+
+private:
+    int fd = -1;
+    std::byte * base = nullptr;
+    size_t mapped = 0;
+    size_t written = 0;
+    /* The size while nothing is mapped. */
+};
+
+struct mapped_file_t
+/* A read-only memory mapping of a whole file. */
+{
+    explicit mapped_file_t( std::string const & path );
+    ~mapped_file_t();
+
+    mapped_file_t( mapped_file_t const & ) = delete;
+    mapped_file_t & operator = ( mapped_file_t const & ) = delete;
+
+    std::span< std::byte const >
+    bytes() const
+    {
+        return { static_cast< std::byte const * >( base ), length };
+    }
+
+private:
+    void * base = nullptr;
+    size_t length = 0;
+};
+
 struct serialiser_t {
     std::ostream * stream = nullptr;
+    byte_sink_t * sink = nullptr; /* used instead of the stream if set */
 
     inline
     void
     check()
     {
+        if( sink ) {
+            return;
+        }
         if( (not stream->good()) or stream->bad()) {
             throw std::runtime_error( "couldnot write" );
         }
     }
 
+    inline
+    void
+    write( void const * p, size_t n )
+    {
+        if( sink ) {
+            sink->write( p, n );
+        } else {
+            stream->write( reinterpret_cast< char const * >( p ), n );
+        }
+    }
+
     struct start {};
     struct end {};
 };
 
 struct deserialiser_t {
     std::istream * stream = nullptr;
+    /* Without a stream the bytes between cursor and limit are read. */
+    std::byte const * cursor = nullptr;
+    std::byte const * limit = nullptr;
+    bool failed = false;
 
     inline
     void
     check()
     {
-        if( (not stream->good()) or stream->bad()) {
+        if( stream ) {
+            if( (not stream->good()) or stream->bad()) {
+                throw std::runtime_error( "couldnot read" );
+            }
+        } else if( failed ) {
             throw std::runtime_error( "couldnot read" );
         }
     }
 
+    inline
+    size_t
+    remaining() const
+    {
+        return static_cast< size_t >( limit - cursor );
+    }
+
+    inline
+    void
+    read( void * p, size_t n )
+    {
+        if( stream ) {
+            stream->read( reinterpret_cast< char * >( p ), n );
+        } else if( remaining() < n ) {
+            failed = true;
+            cursor = limit;
+        } else if( n ) {
+            std::memcpy( p, cursor, n );
+            cursor = cursor + n;
+        }
+    }
+
+    inline
+    void
+    require( uint64_t count, size_t element_size )
+    /* Throws if there cannot be count elements of element_size
+       bytes left.  Only checked without a stream. */
+    {
+        if( (not stream) and element_size and (count > remaining() / element_size) ) {
+            failed = true;
+            cursor = limit;
+        }
+        check();
+    }
+
+    inline
+    std::span< std::byte const >
+    view( size_t n )
+    /* Hands out the next n bytes without copying. */
+    {
+        if( stream ) {
+            throw std::logic_error( "Views need a deserialiser reading from bytes." );
+        }
+        require( n, 1 );
+        std::span< std::byte const > result( cursor, n );
+        cursor = cursor + n;
+        return result;
+    }
 
     struct start {};
     struct end {};
 };
 
+inline
+serialiser_t
+make_serialiser( byte_sink_t & sink )
+{
+    return serialiser_t{ nullptr, & sink };
+}
+
+inline
+deserialiser_t
+make_deserialiser( std::span< std::byte const > bytes )
+{
+    return deserialiser_t{ nullptr, bytes.data(), bytes.data() + bytes.size() };
+}
+
+template< typename T, typename = void >
+struct is_bitwise_serialisable
+    : public std::false_type
+/* True if T is serialised as exactly its object representation, so
+   ranges of T can be written and read with a single memcpy.  May be
+   specialised for own trivially copyable types, if their operator <<
+   writes all members in order and there is no padding. */
+{
+};
+
+template< typename T >
+struct is_bitwise_serialisable<
+    T,
+    std::enable_if_t< std::is_arithmetic_v< T > and not std::is_same_v< T, bool > > >
+    : public std::true_type
+{
+};
+
+template< typename T >
+struct is_bitwise_serialisable< std::complex< T > >
+    : public is_bitwise_serialisable< T >
+{
+};
+
+template< typename T, size_t l >
+struct is_bitwise_serialisable< std::array< T, l > >
+    : public std::bool_constant< is_bitwise_serialisable< T >::value
+                                 and (l > 0)
+                                 and (sizeof( std::array< T, l > ) == l * sizeof( T )) >
+{
+};
+
+template< typename T >
+constexpr bool is_bitwise_serialisable_v = is_bitwise_serialisable< T >::value;
+
+template< typename T >
+struct array_view_t
+/* Zero-copy view of a serialised std::vector< T >, for bitwise
+   serialisable T and a deserialiser reading from bytes.  The bytes
+   have to outlive the view.  They are not necessarily aligned for T,
+   element access copies, span() only works if aligned(). */
+{
+    static_assert( is_bitwise_serialisable_v< T > );
+
+    std::span< std::byte const > bytes;
+
+    size_t
+    size() const
+    {
+        return bytes.size() / sizeof( T );
+    }
+
+    bool
+    aligned() const
+    {
+        return (reinterpret_cast< std::uintptr_t >( bytes.data()) % alignof( T )) == 0;
+    }
+
+    std::span< T const >
+    span() const
+    {
+        if( not aligned() ) {
+            throw std::runtime_error( "array_view_t: data not aligned" );
+        }
+        return { reinterpret_cast< T const * >( bytes.data()), size() };
+    }
+
+    T
+    operator[] ( size_t k ) const
+    {
+        T x;
+        std::memcpy( &x, bytes.data() + k * sizeof( T ), sizeof( T ));
+        return x;
+    }
+
+    std::vector< T >
+    to_vector() const
+    {
+        std::vector< T > v( size() );
+        if( not v.empty() ) {
+            std::memcpy( v.data(), bytes.data(), bytes.size());
+        }
+        return v;
+    }
+};
+
 inline
 serialiser_t operator << ( std::ostream & out, serialiser_t::start const & x )
 {
@@ -113,7 +406,7 @@ inline
 ::tz::serialiser_t &
 operator << ( ::tz::serialiser_t & out, uint64_t const & v )
 {
-    out.stream->write( reinterpret_cast< char const * >( &v ), sizeof( v ));
+    out.write( &v, sizeof( v ));
     return out;
 }
 
@@ -121,7 +414,7 @@ inline
 ::tz::serialiser_t &
 operator << ( ::tz::serialiser_t & out, uint32_t const & v )
 {
-    out.stream->write( reinterpret_cast< char const * >( &v ), sizeof( v ));
+    out.write( &v, sizeof( v ));
     return out;
 }
 
@@ -129,7 +422,7 @@ inline
 ::tz::serialiser_t &
 operator << ( ::tz::serialiser_t & out, uint16_t const & v )
 {
-    out.stream->write( reinterpret_cast< char const * >( &v ), sizeof( v ));
+    out.write( &v, sizeof( v ));
     return out;
 }
 
@@ -137,7 +430,7 @@ inline
 ::tz::serialiser_t &
 operator << ( ::tz::serialiser_t & out, uint8_t const & v )
 {
-    out.stream->write( reinterpret_cast< char const * >( &v ), sizeof( v ));
+    out.write( &v, sizeof( v ));
     return out;
 }
 
@@ -145,7 +438,7 @@ inline
 ::tz::serialiser_t &
 operator << ( ::tz::serialiser_t & out, int8_t const & v )
 {
-    out.stream->write( reinterpret_cast< char const * >( &v ), sizeof( v ));
+    out.write( &v, sizeof( v ));
     return out;
 }
 
@@ -153,7 +446,7 @@ inline
 ::tz::serialiser_t &
 operator << ( ::tz::serialiser_t & out, int16_t const & v )
 {
-    out.stream->write( reinterpret_cast< char const * >( &v ), sizeof( v ));
+    out.write( &v, sizeof( v ));
     return out;
 }
 
@@ -161,7 +454,7 @@ inline
 ::tz::serialiser_t &
 operator << ( ::tz::serialiser_t & out, int32_t const & v )
 {
-    out.stream->write( reinterpret_cast< char const * >( &v ), sizeof( v ));
+    out.write( &v, sizeof( v ));
     return out;
 }
 
@@ -169,7 +462,7 @@ inline
 ::tz::serialiser_t &
 operator << ( ::tz::serialiser_t & out, int64_t const & v )
 {
-    out.stream->write( reinterpret_cast< char const * >( &v ), sizeof( v ));
+    out.write( &v, sizeof( v ));
     return out;
 }
 
@@ -177,7 +470,7 @@ inline
 ::tz::serialiser_t &
 operator << ( ::tz::serialiser_t & out, float const & v )
 {
-    out.stream->write( reinterpret_cast< char const * >( &v ), sizeof( v ));
+    out.write( &v, sizeof( v ));
     return out;
 }
 
@@ -185,7 +478,7 @@ inline
 ::tz::serialiser_t &
 operator << ( ::tz::serialiser_t & out, double const & v )
 {
-    out.stream->write( reinterpret_cast< char const * >( &v ), sizeof( v ));
+    out.write( &v, sizeof( v ));
     return out;
 }
 
@@ -194,8 +487,12 @@ template< typename T, size_t l >
 ::tz::serialiser_t &
 operator << ( ::tz::serialiser_t & out, std::array< T, l > const & v )
 {
-    for( auto const & x : v) {
-        out << x;
+    if constexpr ( is_bitwise_serialisable_v< std::array< T, l > > ) {
+        out.write( v.data(), sizeof( v ));
+    } else {
+        for( auto const & x : v) {
+            out << x;
+        }
     }
     return out;
 }
@@ -325,49 +622,23 @@ template< typename T >
 operator << ( ::tz::serialiser_t & out, std::vector< T > const & v )
 {
     out << uint64_t( v.size());
-    for( auto const & x : v) {
-        out << x;
+    if constexpr ( is_bitwise_serialisable_v< T > ) {
+        out.write( v.data(), sizeof( T ) * v.size());
+    } else {
+        for( auto const & x : v) {
+            out << x;
+        }
     }
     return out;
 }
 
-::tz::serialiser_t &
-operator << ( ::tz::serialiser_t & out, std::vector< float > const & v );
-
-::tz::serialiser_t &
-operator << ( ::tz::serialiser_t & out, std::vector< double > const & v );
-
-::tz::serialiser_t &
-operator << ( ::tz::serialiser_t & out, std::vector< uint8_t > const & v );
-
-::tz::serialiser_t &
-operator << ( ::tz::serialiser_t & out, std::vector< uint16_t > const & v );
-
-::tz::serialiser_t &
-operator << ( ::tz::serialiser_t & out, std::vector< uint32_t > const & v );
-
-::tz::serialiser_t &
-operator << ( ::tz::serialiser_t & out, std::vector< uint64_t > const & v );
-
-::tz::serialiser_t &
-operator << ( ::tz::serialiser_t & out, std::vector< int8_t > const & v );
-
-::tz::serialiser_t &
-operator << ( ::tz::serialiser_t & out, std::vector< int16_t > const & v );
-
-::tz::serialiser_t &
-operator << ( ::tz::serialiser_t & out, std::vector< int32_t > const & v );
-
-::tz::serialiser_t &
-operator << ( ::tz::serialiser_t & out, std::vector< int64_t > const & v );
-
 // Deserialisation
 
 inline
 tz::deserialiser_t &
 operator >> ( deserialiser_t & in, uint8_t &v )
 {
-    in.stream->read( reinterpret_cast< char * >( &v ), sizeof( v ));
+    in.read( &v, sizeof( v ));
     return in;
 }
 
@@ -375,7 +646,7 @@ inline
 tz::deserialiser_t &
 operator >> ( deserialiser_t & in, uint16_t &v )
 {
-    in.stream->read( reinterpret_cast< char * >( &v ), sizeof( v ));
+    in.read( &v, sizeof( v ));
     return in;
 }
 
@@ -383,7 +654,7 @@ inline
 tz::deserialiser_t &
 operator >> ( deserialiser_t & in, uint32_t &v )
 {
-    in.stream->read( reinterpret_cast< char * >( &v ), sizeof( v ));
+    in.read( &v, sizeof( v ));
     return in;
 }
 
@@ -391,7 +662,7 @@ inline
 tz::deserialiser_t &
 operator >> ( deserialiser_t & in, uint64_t &v )
 {
-    in.stream->read( reinterpret_cast< char * >( &v ), sizeof( v ));
+    in.read( &v, sizeof( v ));
     return in;
 }
 
@@ -399,7 +670,7 @@ inline
 tz::deserialiser_t &
 operator >> ( deserialiser_t & in, int8_t &v )
 {
-    in.stream->read( reinterpret_cast< char * >( &v ), sizeof( v ));
+    in.read( &v, sizeof( v ));
     return in;
 }
 
@@ -407,7 +678,7 @@ inline
 tz::deserialiser_t &
 operator >> ( deserialiser_t & in, int16_t &v )
 {
-    in.stream->read( reinterpret_cast< char * >( &v ), sizeof( v ));
+    in.read( &v, sizeof( v ));
     return in;
 }
 
@@ -415,7 +686,7 @@ inline
 tz::deserialiser_t &
 operator >> ( deserialiser_t & in, int32_t &v )
 {
-    in.stream->read( reinterpret_cast< char * >( &v ), sizeof( v ));
+    in.read( &v, sizeof( v ));
     return in;
 }
 
@@ -423,7 +694,7 @@ inline
 tz::deserialiser_t &
 operator >> ( deserialiser_t & in, int64_t &v )
 {
-    in.stream->read( reinterpret_cast< char * >( &v ), sizeof( v ));
+    in.read( &v, sizeof( v ));
     return in;
 }
 
@@ -431,7 +702,7 @@ inline
 tz::deserialiser_t &
 operator >> ( deserialiser_t & in, float &v )
 {
-    in.stream->read( reinterpret_cast< char * >( &v ), sizeof( v ));
+    in.read( &v, sizeof( v ));
     return in;
 }
 
@@ -439,7 +710,7 @@ inline
 tz::deserialiser_t &
 operator >> ( deserialiser_t & in, double &v )
 {
-    in.stream->read( reinterpret_cast< char * >( &v ), sizeof( v ));
+    in.read( &v, sizeof( v ));
     return in;
 }
 
@@ -448,8 +719,12 @@ template< typename T, size_t k>
 ::tz::deserialiser_t &
 operator >> ( ::tz::deserialiser_t & out, std::array< T, k >  & v )
 {
-    for( size_t l = 0; l < k; l++ ) {
-        out >> v[l];
+    if constexpr ( is_bitwise_serialisable_v< std::array< T, k > > ) {
+        out.read( v.data(), sizeof( v ));
+    } else {
+        for( size_t l = 0; l < k; l++ ) {
+            out >> v[l];
+        }
     }
     return out;
 }
@@ -470,26 +745,134 @@ template< typename R, typename P >
 tz::deserialiser_t &
 operator >> ( tz::deserialiser_t & in, std::chrono::duration< R, P > & v )
 {
-    R count;
+    R count{};
     in >> count;
     v = std::chrono::duration< R, P >( count );
     return in;
 }
 
+namespace impl {
+
+template< typename T, typename = void >
+struct min_serialised_size
+    : public std::integral_constant< size_t, 0 >
+/* The fewest bytes a T is serialised to, used to reject container
+   lengths the input cannot hold.  An own operator << may write
+   nothing, an empty struct for instance, so unknown types count as
+   zero bytes. */
+{
+};
+
+template< typename T >
+struct min_serialised_size< T, std::enable_if_t< is_bitwise_serialisable_v< T > > >
+    : public std::integral_constant< size_t, sizeof( T ) >
+{
+};
+
+template< typename T, size_t l >
+struct min_serialised_size< std::array< T, l >,
+                            std::enable_if_t< not is_bitwise_serialisable_v< std::array< T, l > > > >
+    : public std::integral_constant< size_t, l * min_serialised_size< T >::value >
+{
+};
+
+template< typename T >
+struct min_serialised_size< std::complex< T >,
+                            std::enable_if_t< not is_bitwise_serialisable_v< std::complex< T > > > >
+    : public std::integral_constant< size_t, 2 * min_serialised_size< T >::value >
+{
+};
+
+template< typename R, typename P >
+struct min_serialised_size< std::chrono::duration< R, P > >
+    : public min_serialised_size< R >
+{
+};
+
+template< typename T >
+struct min_serialised_size< std::optional< T > >
+    : public std::integral_constant< size_t, sizeof( uint8_t ) >
+{
+};
+
+template< typename A, typename B >
+struct min_serialised_size< std::pair< A, B > >
+    : public std::integral_constant< size_t, min_serialised_size< A >::value
+                                             + min_serialised_size< B >::value >
+{
+};
+
+template< typename ... T >
+struct min_serialised_size< std::tuple< T ... > >
+    : public std::integral_constant< size_t, (min_serialised_size< T >::value + ... + 0) >
+{
+};
+
+template< typename ... T >
+struct min_serialised_size< std::variant< T ... > >
+    : public std::integral_constant< size_t, sizeof( uint64_t ) >
+{
+};
+
+template< typename T >
+struct min_serialised_size< std::vector< T > >
+    : public std::integral_constant< size_t, sizeof( uint64_t ) >
+{
+};
+
+template< typename key_t, typename val_t >
+struct min_serialised_size< std::map< key_t, val_t > >
+    : public std::integral_constant< size_t, sizeof( uint64_t ) >
+{
+};
+
+template< typename key_t, typename val_t >
+struct min_serialised_size< std::unordered_map< key_t, val_t > >
+    : public std::integral_constant< size_t, sizeof( uint64_t ) >
+{
+};
+
+template< typename T >
+constexpr size_t min_serialised_size_v = min_serialised_size< T >::value;
+
+inline
+uint64_t
+read_length( ::tz::deserialiser_t & in, size_t min_element_size )
+/* Reads the length of a container and throws if there cannot be as
+   many elements left. */
+{
+    uint64_t len = 0;
+    in >> len;
+    in.check();
+    in.require( len, min_element_size );
+    return len;
+}
+
+inline
+uint64_t
+initial_capacity( ::tz::deserialiser_t const & in, uint64_t len, size_t min_element_size )
+/* Neither a stream nor elements of possibly zero bytes bound the
+   length up front, then the containers grow with the elements
+   read. */
+{
+    return (in.stream or (min_element_size == 0)) ? std::min< uint64_t >( len, 4096 ) : len;
+}
+}
+
 // map
 template< typename key_t, typename val_t >
 ::tz::deserialiser_t &
 operator >> ( ::tz::deserialiser_t & in, std::map< key_t, val_t >  & v )
 {
-    uint64_t len;
-    in >> len;
-    in.check();
+    auto len = impl::read_length(
+        in, impl::min_serialised_size_v< key_t > + impl::min_serialised_size_v< val_t > );
     v.clear();
     for( uint64_t k = 0; k < len; k++ ) {
-        key_t key;
-        val_t val;
+        key_t key{};
+        val_t val{};
         in >> key >> val;
-        v.insert({key, val});
+        in.check();
+        v.insert({ std::move( key ), std::move( val )});
     }
     return in;
 }
@@ -499,7 +882,7 @@ template< typename T >
 ::tz::deserialiser_t &
 operator >> ( ::tz::deserialiser_t & in, ::std::optional< T > & v )
 {
-    uint8_t flag;
+    uint8_t flag = 0;
     in >> flag;
     in.check();
     if( flag ) {
@@ -587,7 +970,7 @@ template< typename ... T >
 ::tz::deserialiser_t &
 operator >> ( ::tz::deserialiser_t & in, ::std::variant< T ... > & var )
 {
-    uint64_t idx;
+    uint64_t idx = 0;
     in >> idx;
     in.check();
     ::tz::impl::deserialise_variant( in, var, idx, std::make_index_sequence< sizeof ... (T) >());
@@ -599,64 +982,53 @@ template< typename T >
 ::tz::deserialiser_t &
 operator >> ( ::tz::deserialiser_t & in, std::vector< T >  & v )
 {
-    uint64_t len;
-    in >> len;
-    in.check();
-    v.resize( 0 );
-    v.reserve( len );
-    for( size_t k = 0; k < len; k = k + 1 ) {
-        T x;
-        in >> x;
-        v.push_back( x );
+    auto len = impl::read_length( in, impl::min_serialised_size_v< T > );
+    if constexpr ( is_bitwise_serialisable_v< T > ) {
+        v.resize( 0 );
+        while( v.size() < len ) {
+            auto k = v.size();
+            v.resize( k + impl::initial_capacity( in, len - k, sizeof( T )));
+            in.read( v.data() + k, sizeof( T ) * (v.size() - k));
+            in.check();
+        }
+    } else {
+        v.resize( 0 );
+        v.reserve( impl::initial_capacity( in, len, impl::min_serialised_size_v< T > ));
+        for( size_t k = 0; k < len; k = k + 1 ) {
+            T x{};
+            in >> x;
+            in.check();
+            v.push_back( std::move( x ));
+        }
     }
     return in;
 }
 
+template< typename T >
 ::tz::deserialiser_t &
-operator >> ( ::tz::deserialiser_t & in, std::vector< float > & v );
-
-::tz::deserialiser_t &
-operator >> ( ::tz::deserialiser_t & in, std::vector< double > & v );
-
-::tz::deserialiser_t &
-operator >> ( ::tz::deserialiser_t & in, std::vector< uint8_t > & v );
-
-::tz::deserialiser_t &
-operator >> ( ::tz::deserialiser_t & in, std::vector< uint16_t > & v );
-
-::tz::deserialiser_t &
-operator >> ( ::tz::deserialiser_t & in, std::vector< uint32_t > & v );
-
-::tz::deserialiser_t &
-operator >> ( ::tz::deserialiser_t & in, std::vector< uint64_t > & v );
-
-::tz::deserialiser_t &
-operator >> ( ::tz::deserialiser_t & in, std::vector< int8_t > & v );
-
-::tz::deserialiser_t &
-operator >> ( ::tz::deserialiser_t & in, std::vector< int16_t > & v );
-
-::tz::deserialiser_t &
-operator >> ( ::tz::deserialiser_t & in, std::vector< int32_t > & v );
-
-::tz::deserialiser_t &
-operator >> ( ::tz::deserialiser_t & in, std::vector< int64_t > & v );
+operator >> ( ::tz::deserialiser_t & in, array_view_t< T > & v )
+/* Reads what was written as std::vector< T > */
+{
+    auto len = impl::read_length( in, sizeof( T ));
+    v.bytes = in.view( sizeof( T ) * len );
+    return in;
+}
 
 // unordered_map
 template< typename key_t, typename val_t >
 ::tz::deserialiser_t &
 operator >> ( ::tz::deserialiser_t & in, std::unordered_map< key_t, val_t >  & v )
 {
-    uint64_t len;
-    in >> len;
-    in.check();
+    auto min_size = impl::min_serialised_size_v< key_t > + impl::min_serialised_size_v< val_t >;
+    auto len = impl::read_length( in, min_size );
     v.clear();
-    v.reserve( len );
+    v.reserve( impl::initial_capacity( in, len, min_size ));
     for( uint64_t k = 0; k < len; k++ ) {
-        key_t key;
-        val_t val;
+        key_t key{};
+        val_t val{};
         in >> key >> val;
-        v.insert({key, val});
+        in.check();
+        v.insert({ std::move( key ), std::move( val )});
     }
     return in;
 }
@@ -1,4 +1,8 @@
 #include <tanz/conics.h++>
+#include <tanz/dlt.h++>
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
 #include <vector>
 #include <stdexcept>
 #include <ciso646>
@@ -8,36 +12,166 @@
 namespace tz {
 namespace {
 
-template< typename T >
-Eigen::MatrixXd
-conics_constraints( std::vector< T > const & obs )
-{
-    Eigen::MatrixXd C( obs.size(), 6 );
-    for( size_t k = 0; k < obs.size(); k = k + 1 ) {
-        auto const & v = obs.at( k );
-        double x = v[0];
-        double y = v[1];
-        C.block< 1, 6 >( k, 0 ) <<
-            std::pow( x, 2.0),
+Eigen::Matrix< double, 1, 6 >
+conic_row( Eigen::Vector2d const & v )
+{
+    double x = v[0];
+    double y = v[1];
+    return (Eigen::Matrix< double, 1, 6 >() <<
+            x * x,
             2.0 * x * y,
-            std::pow( y, 2.0),
+            y * y,
             2.0 * x,
             2.0 * y,
-            1.0;
+            1.0).finished();
+}
+
+Eigen::Matrix3d
+conic_matrix_of( Eigen::Matrix< double, 6, 1 > const & p )
+{
+    Eigen::Matrix3d q;
+    q <<
+        p(0), p(1), p(3),
+        p(1), p(2), p(4),
+        p(3), p(4), p(5);
+    return q;
+}
+
+template< typename F >
+Eigen::Matrix3d
+normalised_conic_fit( size_t n, F const & point )
+/* Algebraic least squares in normalised coordinates. */
+{
+    auto t = point_normalisation_t::of( n, point );
+    null_space_accumulator_t< 6 > lsq;
+    for( size_t k = 0; k < n; k = k + 1 ) {
+        lsq.add( conic_row( t( point( k ))));
     }
-    return C;
+    Eigen::Matrix3d tm = t.matrix();
+    return tm.transpose() * conic_matrix_of( lsq.solve() ) * tm;
 }
 
-conic_params_t
-solve_conic_params( Eigen::MatrixXd const & mat )
+bool
+three_collinear( Eigen::Vector2d const * obs, double distance )
+/* True if, for three of the five points, one is closer than distance
+   to the line through the other two. */
 {
-    Eigen::JacobiSVD< Eigen::MatrixXd > svd( mat, Eigen::ComputeThinU | Eigen::ComputeFullV );
-    Eigen::VectorXd p = svd.matrixV().col( 5 );
+    for( int i = 0; i < 5; i = i + 1 ) {
+        for( int j = i + 1; j < 5; j = j + 1 ) {
+            for( int k = j + 1; k < 5; k = k + 1 ) {
+                Eigen::Vector2d u = obs[ j ] - obs[ i ];
+                Eigen::Vector2d v = obs[ k ] - obs[ i ];
+                Eigen::Vector2d w = obs[ k ] - obs[ j ];
+                auto longest = std::max({ u.norm(), v.norm(), w.norm() });
+                if( std::abs( u( 0 ) * v( 1 ) - u( 1 ) * v( 0 )) <= distance * longest ) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
 
-    return
-        { p(0), p(1), p(2), p(3), p(4), p(5) };
+bool
+minimal_conic( Eigen::Vector2d const * obs, double distance, Eigen::Matrix3d & q )
+/* The conic through five points: the null vector of the 5 x 6
+   constraints, by cofactors.  Fixed size, without allocation.
+
+   No proper conic passes through three collinear points, the conic
+   through them is (nearly) a pair of lines, or a thin conic along
+   one.  Those fit the points of any line in the data, so samples
+   with three points within distance of a line are rejected, with
+   distance the inlier threshold: closer points cannot be told apart
+   from collinear ones anyway.  Any five points on a pair of lines
+   have three on one of them, so this covers degenerate conics. */
+{
+    if( three_collinear( obs, distance )) {
+        return false;
+    }
+    auto t = point_normalisation_t::of( 5, [ obs ]( size_t k ) { return obs[ k ]; } );
+    Eigen::Matrix< double, 5, 6 > m;
+    for( int k = 0; k < 5; k = k + 1 ) {
+        m.row( k ) = conic_row( t( obs[ k ] ));
+    }
+    Eigen::Matrix< double, 6, 1 > p;
+    Eigen::Matrix< double, 5, 5 > minor;
+    for( int j = 0; j < 6; j = j + 1 ) {
+        minor << m.leftCols( j ), m.rightCols( 5 - j );
+        p( j ) = ((j % 2) ? -1.0 : 1.0) * minor.determinant();
+    }
+    auto norm = p.norm();
+    if( not (norm > 0.0) ) {
+        return false;
+    }
+    Eigen::Matrix3d qn = conic_matrix_of( p / norm );
+    Eigen::Matrix3d tm = t.matrix();
+    q = tm.transpose() * qn * tm;
+    q = q / q.norm();
+    return q.allFinite();
 }
 
+struct observations_t
+/* Structure of arrays, so distances are computed vectorised. */
+{
+    Eigen::ArrayXd xs;
+    Eigen::ArrayXd ys;
+
+    template< typename T >
+    explicit observations_t( std::vector< T > const & obs )
+        : xs( obs.size() ), ys( obs.size() )
+    {
+        for( size_t k = 0; k < obs.size(); k = k + 1 ) {
+            xs( k ) = obs[ k ][ 0 ];
+            ys( k ) = obs[ k ][ 1 ];
+        }
+    }
+
+    template< typename F >
+    size_t
+    inliers( Eigen::Matrix3d const & q, double threshold, size_t needed, F const & each ) const
+    /* Sampson distance: the algebraic distance over the length of
+       its gradient.  Calls each( k ) for every inlier k, gives up
+       once needed cannot be reached anymore. */
+    {
+        constexpr Eigen::Index block = 256;
+        Eigen::Array< double, Eigen::Dynamic, 1, 0, block, 1 > d2;
+        auto n = xs.size();
+        auto t2 = threshold * threshold;
+        size_t count = 0;
+        for( Eigen::Index s = 0; s < n; s = s + block ) {
+            auto len = std::min( block, n - s );
+            auto x = xs.segment( s, len );
+            auto y = ys.segment( s, len );
+            auto gx = q( 0, 0 ) * x + q( 0, 1 ) * y + q( 0, 2 );
+            auto gy = q( 1, 0 ) * x + q( 1, 1 ) * y + q( 1, 2 );
+            auto v = gx * x + gy * y + (q( 2, 0 ) * x + q( 2, 1 ) * y + q( 2, 2 ));
+            d2 = v.square() / (4.0 * (gx.square() + gy.square()));
+            if constexpr( std::is_same_v< F, std::nullptr_t > ) {
+                count = count + size_t( (d2 <= t2).count() );
+            } else {
+                for( Eigen::Index k = 0; k < len; k = k + 1 ) {
+                    if( d2( k ) <= t2 ) {
+                        each( size_t( s + k ));
+                        count = count + 1;
+                    }
+                }
+            }
+            if( count + size_t( n - s - len ) < needed ) {
+                return count;
+            }
+        }
+        return count;
+    }
+
+    std::vector< size_t >
+    inlier_indices( Eigen::Matrix3d const & q, double threshold ) const
+    {
+        std::vector< size_t > indices;
+        inliers( q, threshold, 0, [ & ]( size_t k ) { indices.push_back( k ); } );
+        return indices;
+    }
+};
+
 inline
 double
 A( conic_params_t const & p )
@@ -116,22 +250,94 @@ normalised_params( conic_params_t const & p )
 
 }
 
+namespace {
+
+template< typename T >
 conic_params_t
-fit_conic_params( std::vector< Eigen::Vector2f > const & obs )
+fit( std::vector< T > const & obs )
 {
     return
         normalised_params(
-            solve_conic_params(
-                conics_constraints( obs )));
+            conic_params(
+                normalised_conic_fit(
+                    obs.size(),
+                    [ & ]( size_t k ) { return Eigen::Vector2d( obs[ k ][ 0 ], obs[ k ][ 1 ] ); } )));
+}
+
+template< typename T >
+robust_conic_t
+estimate( std::vector< T > const & obs, ransac_options_t const & options )
+{
+    if( obs.size() < 5 ) {
+        throw std::domain_error( "At least five points are needed for conic estimation." );
+    }
+    observations_t points( obs );
+    auto best =
+        ransac< 5, Eigen::Matrix3d >(
+            obs.size(), options,
+            [ & ]( std::array< size_t, 5 > const & sample, Eigen::Matrix3d & q )
+            {
+                Eigen::Vector2d p[ 5 ];
+                for( int k = 0; k < 5; k = k + 1 ) {
+                    p[ k ] = Eigen::Vector2d( obs[ sample[ k ] ][ 0 ], obs[ sample[ k ] ][ 1 ] );
+                }
+                return minimal_conic( p, options.threshold, q );
+            },
+            [ & ]( Eigen::Matrix3d const & q, size_t needed )
+            {
+                return points.inliers( q, options.threshold, needed, nullptr );
+            } );
+    if( not best.found ) {
+        throw std::domain_error( "No conic found." );
+    }
+
+    robust_conic_t result;
+    Eigen::Matrix3d q = best.model;
+    result.inliers = points.inlier_indices( q, options.threshold );
+    result.hypotheses = best.hypotheses;
+    for( size_t k = 0; (k < options.refinements) and (result.inliers.size() >= 5); k = k + 1 ) {
+        auto const & inliers = result.inliers;
+        Eigen::Matrix3d refined_q =
+            normalised_conic_fit(
+                inliers.size(),
+                [ & ]( size_t i )
+                {
+                    return Eigen::Vector2d( obs[ inliers[ i ] ][ 0 ], obs[ inliers[ i ] ][ 1 ] );
+                } );
+        auto refined = points.inlier_indices( refined_q, options.threshold );
+        if( refined.size() < inliers.size() ) {
+            break;
+        }
+        q = refined_q;
+        result.inliers = std::move( refined );
+    }
+    result.params = normalised_params( conic_params( q ));
+    return result;
+}
+}
+
+conic_params_t
+fit_conic_params( std::vector< Eigen::Vector2f > const & obs )
+{
+    return fit( obs );
 }
 
 conic_params_t
 fit_conic_params( std::vector< Eigen::Vector2d > const & obs )
 {
-    return
-        normalised_params(
-            solve_conic_params(
-                conics_constraints( obs )));
+    return fit( obs );
+}
+
+robust_conic_t
+estimate_conic_params( std::vector< Eigen::Vector2f > const & obs, ransac_options_t const & options )
+{
+    return estimate( obs, options );
+}
+
+robust_conic_t
+estimate_conic_params( std::vector< Eigen::Vector2d > const & obs, ransac_options_t const & options )
+{
+    return estimate( obs, options );
 }
 
 Eigen::Matrix3d
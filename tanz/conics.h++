@@ -1,4 +1,12 @@
+#pragma once
+#ifndef FILE_5B2E7C19D04A8F63_E80D3A6C91F2B547_INCLUDED
+#define FILE_5B2E7C19D04A8F63_E80D3A6C91F2B547_INCLUDED
+#include <array>
+#include <limits>
+#include <vector>
 #include <Eigen/Dense>
+#include <Eigen/Geometry>
+#include <tanz/ransac.h++>
 
 namespace tz {
 
@@ -26,6 +34,24 @@ fit_conic_params( std::vector< Eigen::Vector2d > const & obs );
    will be thrown.
 */
 
+struct robust_conic_t {
+    conic_params_t params;
+    std::vector< size_t > inliers;
+    size_t hypotheses = 0;
+};
+
+robust_conic_t
+estimate_conic_params( std::vector< Eigen::Vector2f > const & obs,
+                       ransac_options_t const & options = ransac_options_t() );
+
+robust_conic_t
+estimate_conic_params( std::vector< Eigen::Vector2d > const & obs,
+                       ransac_options_t const & options = ransac_options_t() );
+/* Like fit_conic_params, but robust against outliers.  Hypotheses
+   come from five observations each, an inlier is within
+   options.threshold of the conic (Sampson distance), and the result
+   is refined by least squares on the inliers. */
+
 Eigen::Matrix3d
 conic_matrix( conic_params_t const & );
 
@@ -71,3 +97,4 @@ conic_is_empty( conic_params_t const & ); // imaginary ellipsis
 bool
 conic_is_lines( conic_params_t const &, double eps = 32 * std::numeric_limits< double >::epsilon());
 }
+#endif
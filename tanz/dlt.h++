@@ -0,0 +1,112 @@
+#pragma once
+#ifndef FILE_9D41E6B07A3C2F58_16F0B8C4E2A97D35_INCLUDED
+#define FILE_9D41E6B07A3C2F58_16F0B8C4E2A97D35_INCLUDED
+#include <cmath>
+#include <cstddef>
+#include <Eigen/Dense>
+
+/* Building blocks of the direct linear transformations in
+   homography.c++ and conics.c++, fixed size and without
+   allocation. */
+
+namespace tz {
+
+struct point_normalisation_t
+/* x' = s * (x - c), the points at mean distance sqrt(2) from the
+   origin (Hartley). */
+{
+    Eigen::Vector2d c = Eigen::Vector2d::Zero();
+    double s = 1.0;
+
+    template< typename F >
+    static point_normalisation_t
+    of( size_t n, F const & point )
+    /* point( k ) for k in [0, n) */
+    {
+        point_normalisation_t t;
+        for( size_t k = 0; k < n; k = k + 1 ) {
+            t.c += point( k );
+        }
+        t.c /= double( n );
+        double d = 0.0;
+        for( size_t k = 0; k < n; k = k + 1 ) {
+            d = d + (point( k ) - t.c).norm();
+        }
+        d = d / double( n );
+        if( d > 0.0 ) {
+            t.s = std::sqrt( 2.0 ) / d;
+        }
+        return t;
+    }
+
+    Eigen::Vector2d
+    operator () ( Eigen::Vector2d const & x ) const
+    {
+        return s * (x - c);
+    }
+
+    Eigen::Matrix3d
+    matrix() const
+    {
+        Eigen::Matrix3d t;
+        t <<
+            s, 0, -s * c( 0 ),
+            0, s, -s * c( 1 ),
+            0, 0, 1;
+        return t;
+    }
+
+    Eigen::Matrix3d
+    inverse() const
+    {
+        Eigen::Matrix3d t;
+        t <<
+            1 / s, 0, c( 0 ),
+            0, 1 / s, c( 1 ),
+            0, 0, 1;
+        return t;
+    }
+};
+
+template< int N >
+struct null_space_accumulator_t
+/* Least squares null vector of a matrix given row by row.  The rows
+   are folded into a triangular factor by Givens rotations, so
+   unlike the normal equations the condition is not squared. */
+{
+    using row_t = Eigen::Matrix< double, 1, N >;
+    using vector_t = Eigen::Matrix< double, N, 1 >;
+
+    Eigen::Matrix< double, N, N > r = Eigen::Matrix< double, N, N >::Zero();
+
+    void
+    add( row_t row )
+    {
+        for( int i = 0; i < N; i = i + 1 ) {
+            auto b = row( i );
+            if( b == 0.0 ) {
+                continue;
+            }
+            auto a = r( i, i );
+            auto h = std::hypot( a, b );
+            auto c = a / h;
+            auto s = b / h;
+            for( int j = i; j < N; j = j + 1 ) {
+                auto rij = r( i, j );
+                auto xj = row( j );
+                r( i, j ) = c * rij + s * xj;
+                row( j ) = c * xj - s * rij;
+            }
+        }
+    }
+
+    vector_t
+    solve() const
+    /* Unit vector x minimising |A x|. */
+    {
+        Eigen::JacobiSVD< Eigen::Matrix< double, N, N > > svd( r, Eigen::ComputeFullV );
+        return svd.matrixV().col( N - 1 );
+    }
+};
+}
+#endif
@@ -3,45 +3,481 @@
 #define FILE_54F5C595B12968F_1A73B593251E5C5E_INCLUDED
 
 #include <Eigen/Dense>
-#include <tanz/complex.h++>
+#include <unsupported/Eigen/FFT>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <tanz/executor.h++>
+
+/* Convolution along the rows or columns of a matrix, and spectra.
+
+   Short kernels are applied directly, with Eigen's vectorised
+   arithmetic on whole columns or on contiguous lines.  Long kernels
+   go through the FFT by overlap-save.  The FFT plans are kept per
+   thread and reused by later calls.  CONV_METHOD_AUTO picks the
+   cheaper method from an estimate of the cost per output sample. */
 
 namespace tz {
 
 enum convolution_border_handling_t {
     CONV_BORDER_DISCARD = 1,
-    CONV_BORDER_MIRROR = 2
+    CONV_BORDER_MIRROR = 2,
+    CONV_BORDER_ZERO = 3,
+    CONV_BORDER_CLAMP = 4,
+    CONV_BORDER_WRAP = 5
 };
+/* DISCARD keeps the n - k + 1 outputs for which the kernel lies
+   completely inside the signal.  The others keep all n outputs, with
+   the kernel sample (k - 1) / 2 over the output sample.  Beyond its
+   ends the signal is mirrored at the end samples (which are not
+   repeated), zero, the end samples repeated, or periodic. */
 
-template< typename T_signal, typename T_kernel >
-Eigen::Matrix< tz::complex_type_of< typename T_signal::value_type >::complex_t, Eigen::Dynamic, Eigen::Dynamic >
-convolve_rows( T_signal const & a,
-               T_kernel const & b,
-               convolution_border_handling_t border = CONV_BORDER_DISCARD)
+enum convolution_method_t {
+    CONV_METHOD_AUTO = 0,
+    CONV_METHOD_DIRECT = 1,
+    CONV_METHOD_FFT = 2
+};
+
+struct convolution_options_t {
+    convolution_border_handling_t border = CONV_BORDER_DISCARD;
+    convolution_method_t method = CONV_METHOD_AUTO;
+    size_t threads = 1;
+    /* 0 means one per hardware thread.  Besides the calling thread,
+       they are tasks of default_executor(). */
+};
+
+namespace impl {
+
+template< typename S >
+using dsp_matrix_t = Eigen::Matrix< S, Eigen::Dynamic, Eigen::Dynamic >;
+
+template< typename S >
+using dsp_vector_t = Eigen::Matrix< S, Eigen::Dynamic, 1 >;
+
+inline
+Eigen::Index
+border_index( Eigen::Index t, Eigen::Index n, convolution_border_handling_t border )
+/* Where sample t of the extended signal comes from, -1 for zero. */
 {
-    Eigen::MatrixXf h( a.rows(), a.cols() - b.size() + 1);
+    if( (t >= 0) and (t < n) ) {
+        return t;
+    }
+    switch( border ) {
+    case CONV_BORDER_ZERO:
+        return -1;
+    case CONV_BORDER_CLAMP:
+        return (t < 0) ? 0 : n - 1;
+    case CONV_BORDER_WRAP: {
+        auto r = t % n;
+        return (r < 0) ? r + n : r;
+    }
+    case CONV_BORDER_MIRROR: {
+        if( n == 1 ) {
+            return 0;
+        }
+        auto period = 2 * (n - 1);
+        auto r = t % period;
+        r = (r < 0) ? r + period : r;
+        return (r < n) ? r : period - r;
+    }
+    default:
+        throw std::invalid_argument( "convolution: unknown border handling." );
+    }
+}
+
+struct convolution_geometry_t {
+    Eigen::Index n;
+    Eigen::Index k;
+    Eigen::Index outputs;
+    Eigen::Index offset;
+    /* Position in the signal of the first sample under the kernel. */
+
+    Eigen::Index
+    padded() const
+    {
+        return outputs + k - 1;
+    }
+};
+
+inline
+convolution_geometry_t
+convolution_geometry( Eigen::Index n, Eigen::Index k, convolution_border_handling_t border )
+{
+    if( k < 1 ) {
+        throw std::invalid_argument( "convolution: empty kernel." );
+    }
+    if( (border < CONV_BORDER_DISCARD) or (border > CONV_BORDER_WRAP) ) {
+        /* Before any work is split up, not in the middle of it. */
+        throw std::invalid_argument( "convolution: unknown border handling." );
+    }
     if( border == CONV_BORDER_DISCARD ) {
-        for( size_t row = 0; row < h.rows(); row = row + 1 ) {
-            for( size_t c = 0; c < h.cols(); c = c + 1 ) {
-                h( row, c ) = (a.block( row, c, 1, b.size()).array() * b.transpose().reverse().array()).matrix().sum();
-            }
+        return { n, k, std::max< Eigen::Index >( 0, n - k + 1 ), 0 };
+    }
+    return { n, k, n, -(k / 2) };
+}
+
+inline
+Eigen::Index
+fft_block_size( Eigen::Index k, Eigen::Index padded )
+/* FFT size for overlap-save with the smallest estimated cost per
+   output, no larger than needed for the whole signal. */
+{
+    Eigen::Index limit = 8;
+    while( limit < padded ) {
+        limit = 2 * limit;
+    }
+    Eigen::Index size = 8;
+    while( (size < 2 * k) and (size < limit) ) {
+        size = 2 * size;
+    }
+    auto best = size;
+    auto best_cost = 1e300;
+    for( ; size <= limit; size = 2 * size ) {
+        auto cost = size * (std::log2( double( size )) + 1.0) / double( size - k + 1 );
+        if( cost < best_cost ) {
+            best = size;
+            best_cost = cost;
+        }
+    }
+    return best;
+}
+
+inline
+bool
+prefer_fft( Eigen::Index k, Eigen::Index outputs, convolution_method_t method )
+{
+    if( method != CONV_METHOD_AUTO ) {
+        return method == CONV_METHOD_FFT;
+    }
+    if( (k < 32) or (outputs < 64) ) {
+        return false;
+    }
+    /* Two real FFTs and a product per block, against k vectorised
+       multiply-adds per output.  The weights are from bench-dsp, with
+       Eigen's default (kissfft) backend the crossover is at a kernel
+       of about 200 samples. */
+    constexpr double fft_weight = 2.5;
+    constexpr double direct_weight = 0.15;
+    auto size = fft_block_size( k, outputs + k - 1 );
+    auto step = std::min( size - k + 1, outputs );
+    auto fft_cost = fft_weight * size * (std::log2( double( size )) + 1.0) / double( step );
+    return fft_cost < direct_weight * k;
+}
+
+template< typename S, int flags >
+Eigen::FFT< S > &
+thread_fft()
+/* Keeps the plans of every size used on this thread. */
+{
+    using fft_t = Eigen::FFT< S >;
+    thread_local fft_t fft{ typename fft_t::impl_type{}, typename fft_t::Flag( flags ) };
+    return fft;
+}
+
+template< typename S >
+void
+convolve_valid_direct( S const * padded, Eigen::Index outputs,
+                       S const * reversed, Eigen::Index k, S * out )
+/* out[ i ] = sum over m of padded[ i + m ] * reversed[ m ], in
+   chunks that stay in the cache. */
+{
+    constexpr Eigen::Index chunk = 2048;
+    for( Eigen::Index s = 0; s < outputs; s = s + chunk ) {
+        auto len = std::min( chunk, outputs - s );
+        Eigen::Map< dsp_vector_t< S > > o( out + s, len );
+        o = reversed[ 0 ] * Eigen::Map< dsp_vector_t< S > const >( padded + s, len );
+        for( Eigen::Index m = 1; m < k; m = m + 1 ) {
+            o += reversed[ m ] * Eigen::Map< dsp_vector_t< S > const >( padded + s + m, len );
+        }
+    }
+}
+
+template< typename S >
+struct fft_convolver_t
+/* Overlap-save with one kernel.  Spectrum and buffers are kept for
+   all lines convolved by one thread. */
+{
+    using complex_t = std::complex< S >;
+    using fft_t = Eigen::FFT< S >;
+
+    Eigen::Index k;
+    Eigen::Index size;
+    Eigen::Index step;
+    Eigen::Array< complex_t, Eigen::Dynamic, 1 > kernel_spectrum;
+    Eigen::Array< complex_t, Eigen::Dynamic, 1 > spectrum;
+    dsp_vector_t< S > block;
+    fft_t & fft = thread_fft< S, fft_t::HalfSpectrum | fft_t::Unscaled >();
+
+    fft_convolver_t( dsp_vector_t< S > const & kernel, Eigen::Index padded )
+        : k( kernel.size() ),
+          size( fft_block_size( kernel.size(), padded )),
+          step( size - kernel.size() + 1 ),
+          kernel_spectrum( size / 2 + 1 ),
+          spectrum( size / 2 + 1 ),
+          block( dsp_vector_t< S >::Zero( size ))
+    {
+        block.head( k ) = kernel;
+        fft.fwd( kernel_spectrum.data(), block.data(), size );
+        /* The inverse is unscaled. */
+        kernel_spectrum = kernel_spectrum / S( size );
+    }
+
+    void
+    convolve_valid( S const * padded, Eigen::Index outputs, S * out )
+    {
+        auto length = outputs + k - 1;
+        for( Eigen::Index s = 0; s < outputs; s = s + step ) {
+            auto available = std::min( size, length - s );
+            block.head( available ) = Eigen::Map< dsp_vector_t< S > const >( padded + s, available );
+            block.tail( size - available ).setZero();
+            fft.fwd( spectrum.data(), block.data(), size );
+            spectrum = spectrum * kernel_spectrum;
+            fft.inv( block.data(), spectrum.data(), size );
+            auto n = std::min( step, outputs - s );
+            Eigen::Map< dsp_vector_t< S > >( out + s, n ) = block.segment( k - 1, n );
+        }
+    }
+};
+
+template< typename S >
+struct line_convolver_t
+/* Convolves contiguous lines, each thread has its own. */
+{
+    convolution_geometry_t geometry;
+    convolution_border_handling_t border;
+    dsp_vector_t< S > const & reversed;
+    std::optional< fft_convolver_t< S > > fft;
+    dsp_vector_t< S > padded;
+
+    line_convolver_t( convolution_geometry_t const & geometry_,
+                      convolution_border_handling_t border_,
+                      dsp_vector_t< S > const & kernel,
+                      dsp_vector_t< S > const & reversed_,
+                      bool use_fft )
+        : geometry( geometry_ ),
+          border( border_ ),
+          reversed( reversed_ ),
+          padded( geometry_.padded() )
+    {
+        if( use_fft ) {
+            fft.emplace( kernel, geometry.padded() );
         }
     }
+
+    template< typename T_line >
+    void
+    operator () ( T_line const & line, S * out )
+    /* line is indexed with (), out has geometry.outputs samples. */
+    {
+        if( geometry.outputs == 0 ) {
+            return;
+        }
+        for( Eigen::Index t = 0; t < padded.size(); t = t + 1 ) {
+            auto src = (border == CONV_BORDER_DISCARD)
+                ? t
+                : border_index( geometry.offset + t, geometry.n, border );
+            padded( t ) = (src < 0) ? S( 0 ) : S( line( src ));
+        }
+        if( fft ) {
+            fft->convolve_valid( padded.data(), geometry.outputs, out );
+        } else {
+            convolve_valid_direct( padded.data(), geometry.outputs, reversed.data(), geometry.k, out );
+        }
+    }
+};
+
+inline
+size_t
+dsp_thread_count( size_t threads, double work )
+{
+    if( threads == 0 ) {
+        threads = std::max< size_t >( 1, std::thread::hardware_concurrency() );
+    }
+    /* Not worth a thread below that many multiply-adds. */
+    constexpr double min_work_per_thread = 1 << 18;
+    return std::max< size_t >( 1, std::min< size_t >( threads, size_t( work / min_work_per_thread )));
+}
+
+template< typename F >
+void
+dsp_parallel_blocks( Eigen::Index n, size_t threads, F const & f )
+/* Calls f( begin, end ) for contiguous blocks of [0, n), on the
+   shared executor.  Exceptions of f reach the caller. */
+{
+    threads = std::max< size_t >( 1, std::min< size_t >( threads, size_t( n )));
+    if( threads == 1 ) {
+        f( 0, n );
+        return;
+    }
+    auto block = (n + Eigen::Index( threads ) - 1) / Eigen::Index( threads );
+    parallel_for(
+        threads, threads,
+        [ &f, block, n ]( size_t t )
+        {
+            f( std::min( n, Eigen::Index( t ) * block ), std::min( n, Eigen::Index( t + 1 ) * block ));
+        } );
+}
+
+template< typename S, typename T_kernel >
+dsp_vector_t< S >
+kernel_vector( T_kernel const & b )
+{
+    dsp_vector_t< S > v( b.size() );
+    for( Eigen::Index m = 0; m < v.size(); m = m + 1 ) {
+        v( m ) = S( b( m ));
+    }
+    return v;
+}
+
+template< typename S, typename T_signal, typename T_kernel >
+dsp_matrix_t< S >
+convolve_rows( T_signal const & a, T_kernel const & b, convolution_options_t const & options )
+{
+    auto g = convolution_geometry( a.cols(), b.size(), options.border );
+    dsp_matrix_t< S > h( a.rows(), g.outputs );
+    if( (a.rows() == 0) or (g.outputs == 0) ) {
+        return h;
+    }
+    auto kernel = kernel_vector< S >( b );
+    dsp_vector_t< S > reversed = kernel.reverse();
+    auto use_fft = prefer_fft( g.k, g.outputs, options.method );
+    auto threads = dsp_thread_count(
+        options.threads,
+        double( a.rows() ) * g.outputs * (use_fft ? 4.0 * std::log2( double( g.k )) : double( g.k )));
+
+    /* Column major: with enough rows, whole columns are multiplied
+       and added, otherwise every row is copied to a line. */
+    constexpr Eigen::Index row_block = 256;
+    if( not use_fft and (a.rows() >= 16) ) {
+        dsp_parallel_blocks(
+            a.rows(), threads,
+            [ & ]( Eigen::Index first, Eigen::Index last )
+            {
+                for( auto r0 = first; r0 < last; r0 = r0 + row_block ) {
+                    auto len = std::min( row_block, last - r0 );
+                    for( Eigen::Index i = 0; i < g.outputs; i = i + 1 ) {
+                        auto o = h.col( i ).segment( r0, len );
+                        o.setZero();
+                        for( Eigen::Index m = 0; m < g.k; m = m + 1 ) {
+                            auto c = (options.border == CONV_BORDER_DISCARD)
+                                ? i + m
+                                : border_index( g.offset + i + m, g.n, options.border );
+                            if( c >= 0 ) {
+                                o += reversed( m ) * a.col( c ).segment( r0, len ).template cast< S >();
+                            }
+                        }
+                    }
+                }
+            } );
+        return h;
+    }
+
+    dsp_parallel_blocks(
+        a.rows(), threads,
+        [ & ]( Eigen::Index first, Eigen::Index last )
+        {
+            line_convolver_t< S > convolve( g, options.border, kernel, reversed, use_fft );
+            dsp_vector_t< S > out( g.outputs );
+            for( auto r = first; r < last; r = r + 1 ) {
+                convolve( a.row( r ), out.data() );
+                h.row( r ) = out.transpose();
+            }
+        } );
     return h;
 }
 
+template< typename S, typename T_signal, typename T_kernel >
+dsp_matrix_t< S >
+convolve_cols( T_signal const & a, T_kernel const & b, convolution_options_t const & options )
+{
+    auto g = convolution_geometry( a.rows(), b.size(), options.border );
+    dsp_matrix_t< S > h( g.outputs, a.cols() );
+    if( (a.cols() == 0) or (g.outputs == 0) ) {
+        return h;
+    }
+    auto kernel = kernel_vector< S >( b );
+    dsp_vector_t< S > reversed = kernel.reverse();
+    auto use_fft = prefer_fft( g.k, g.outputs, options.method );
+    auto threads = dsp_thread_count(
+        options.threads,
+        double( a.cols() ) * g.outputs * (use_fft ? 4.0 * std::log2( double( g.k )) : double( g.k )));
 
+    dsp_parallel_blocks(
+        a.cols(), threads,
+        [ & ]( Eigen::Index first, Eigen::Index last )
+        {
+            line_convolver_t< S > convolve( g, options.border, kernel, reversed, use_fft );
+            for( auto c = first; c < last; c = c + 1 ) {
+                convolve( a.col( c ), h.col( c ).data() );
+            }
+        } );
+    return h;
+}
+}
+
+template< typename T_signal, typename T_kernel >
+impl::dsp_matrix_t< typename T_signal::Scalar >
+convolve_rows( T_signal const & a,
+               T_kernel const & b,
+               convolution_options_t const & options )
+/* Every row of a convolved with the kernel b. */
+{
+    return impl::convolve_rows< typename T_signal::Scalar >( a, b, options );
+}
+
+template< typename T_signal, typename T_kernel >
+impl::dsp_matrix_t< typename T_signal::Scalar >
+convolve_rows( T_signal const & a,
+               T_kernel const & b,
+               convolution_border_handling_t border = CONV_BORDER_DISCARD )
+{
+    convolution_options_t options;
+    options.border = border;
+    return convolve_rows( a, b, options );
+}
+
+template< typename T_signal, typename T_kernel >
+impl::dsp_matrix_t< typename T_signal::Scalar >
+convolve_cols( T_signal const & a,
+               T_kernel const & b,
+               convolution_options_t const & options )
+/* Every column of a convolved with the kernel b. */
+{
+    return impl::convolve_cols< typename T_signal::Scalar >( a, b, options );
+}
+
+template< typename T_signal, typename T_kernel >
+impl::dsp_matrix_t< typename T_signal::Scalar >
+convolve_cols( T_signal const & a,
+               T_kernel const & b,
+               convolution_border_handling_t border = CONV_BORDER_DISCARD )
+{
+    convolution_options_t options;
+    options.border = border;
+    return convolve_cols( a, b, options );
+}
+
+template< typename T_signal, typename T_row_kernel, typename T_col_kernel >
+impl::dsp_matrix_t< typename T_signal::Scalar >
+convolve_separable( T_signal const & a,
+                    T_row_kernel const & row_kernel,
+                    T_col_kernel const & col_kernel,
+                    convolution_options_t const & options = convolution_options_t() )
+/* 2D convolution with the outer product of col_kernel and
+   row_kernel, as two 1D passes. */
+{
+    return convolve_cols( convolve_rows( a, row_kernel, options ), col_kernel, options );
+}
 
 template< typename T_kernel >
 Eigen::MatrixXf
 convolve( Eigen::MatrixXf const & a, T_kernel const & b )
 {
-    Eigen::MatrixXf h( a.rows(), a.cols() - b.size() + 1);
-    for( size_t row = 0; row < h.rows(); row = row + 1 ) {
-        for( size_t c = 0; c < h.cols(); c = c + 1 ) {
-            h( row, c ) = (a.block( row, c, 1, b.size()).array() * b.transpose().reverse().array()).matrix().sum();
-        }
-    }
-    return h;
+    return convolve_rows( a, b );
 }
 
 /* Some simple 1 kernels */
@@ -85,7 +521,7 @@ template< typename T = float >
 Eigen::Matrix< T, 2, 1 >
 kernel_identity_1d_2r( T scale = 1 )
 {
-    Eigen::Matrix< T, 1, 1 > kernel( 0, scale);
+    Eigen::Matrix< T, 2, 1 > kernel( 0, scale);
     return kernel;
 }
 
@@ -93,7 +529,7 @@ template< typename T = float >
 Eigen::Matrix< T, 2, 1 >
 kernel_identity_1d_2l( T scale = 1 )
 {
-    Eigen::Matrix< T, 1, 1 > kernel( scale, 0 );
+    Eigen::Matrix< T, 2, 1 > kernel( scale, 0 );
     return kernel;
 }
 
@@ -105,23 +541,31 @@ kernel_identity_1d_3( T scale )
     return kernel;
 }
 
+inline
 Eigen::MatrixXcf
-cols_spectrum( Eigen::MatrixXf const & time )
+cols_spectrum( Eigen::MatrixXf const & time, size_t threads = 1 )
+/* The full spectrum of every column, unscaled. */
 {
-    Eigen::FFT< float > fft;
     Eigen::MatrixXcf frequency( time.rows(), time.cols());
-    for( size_t col = 0; col < time.cols(); col = col + 1 ) {
-        Eigen::VectorXf v_in( time.rows());
-        v_in = time.col( col );
-        Eigen::VectorXcf v_out( time.rows());
-        fft.fwd( v_out, v_in );
-        frequency.col( col ) = v_out;
+    if( time.size() == 0 ) {
+        return frequency;
     }
+    threads = impl::dsp_thread_count(
+        threads, double( time.size() ) * std::log2( double( time.rows() ) + 1.0 ));
+    impl::dsp_parallel_blocks(
+        time.cols(), threads,
+        [ & ]( Eigen::Index first, Eigen::Index last )
+        {
+            auto & fft = impl::thread_fft< float, 0 >();
+            for( auto col = first; col < last; col = col + 1 ) {
+                fft.fwd( frequency.col( col ).data(), time.col( col ).data(), time.rows() );
+            }
+        } );
     return frequency;
 }
 
 
 }
-    
+
 
 #endif
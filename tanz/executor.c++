@@ -0,0 +1,203 @@
+#include <tanz/executor.h++>
+#include <algorithm>
+#include <exception>
+
+namespace tz {
+namespace {
+
+thread_local work_stealing_pool_t const * current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+struct parallel_for_state_t
+/* Shared with the tasks, which may outlive parallel_for() if they
+   start after all indices are done. */
+{
+    std::function< void( size_t ) > const * f;
+    size_t n;
+
+    std::mutex mtx;
+    std::condition_variable finished;
+    size_t next = 0;
+    size_t running = 0;
+    std::exception_ptr error;
+
+    bool
+    take( size_t & k )
+    {
+        std::lock_guard< std::mutex > lock( mtx );
+        if( next >= n ) {
+            return false;
+        }
+        k = next;
+        next = next + 1;
+        running = running + 1;
+        return true;
+    }
+
+    void
+    done( std::exception_ptr e )
+    {
+        std::lock_guard< std::mutex > lock( mtx );
+        if( e ) {
+            if( not error ) {
+                error = e;
+            }
+            next = n;
+        }
+        running = running - 1;
+        if( running == 0 ) {
+            finished.notify_all();
+        }
+    }
+
+    void
+    run()
+    {
+        size_t k;
+        while( take( k )) {
+            std::exception_ptr e;
+            try {
+                (*f)( k );
+            } catch( ... ) {
+                e = std::current_exception();
+            }
+            done( e );
+        }
+    }
+};
+}
+
+work_stealing_pool_t::work_stealing_pool_t( size_t count )
+{
+    if( count == 0 ) {
+        count = std::max< size_t >( 1, std::thread::hardware_concurrency() );
+    }
+    for( size_t k = 0; k < count; k = k + 1 ) {
+        queues.push_back( std::make_unique< worker_queue_t >() );
+    }
+    for( size_t k = 0; k < count; k = k + 1 ) {
+        threads.emplace_back( [ this, k ]() { work( k ); } );
+    }
+}
+
+work_stealing_pool_t::~work_stealing_pool_t()
+{
+    {
+        std::lock_guard< std::mutex > lock( sleep_mtx );
+        stopping = true;
+    }
+    wake.notify_all();
+    for( auto & t : threads ) {
+        t.join();
+    }
+}
+
+void
+work_stealing_pool_t::submit( task_type task, executor_priority_t priority )
+{
+    auto p = std::clamp< size_t >( priority, 0, priority_count - 1 );
+    size_t target;
+    if( current_pool == this ) {
+        target = current_worker;
+    } else {
+        target = next_queue.fetch_add( 1, std::memory_order_relaxed ) % queues.size();
+    }
+    {
+        std::lock_guard< std::mutex > lock( queues[ target ]->mtx );
+        queues[ target ]->tasks[ p ].push_back( std::move( task ));
+    }
+    queued_count.fetch_add( 1 );
+
+    /* The count is read under sleep_mtx before sleeping, so taking
+       the lock here cannot miss a worker going to sleep. */
+    std::lock_guard< std::mutex > lock( sleep_mtx );
+    if( sleeping ) {
+        wake.notify_one();
+    }
+}
+
+bool
+work_stealing_pool_t::try_take( size_t worker, task_type & task )
+{
+    if( queued_count.load() == 0 ) {
+        return false;
+    }
+    auto n = queues.size();
+    for( size_t p = priority_count; p-- > 0; ) {
+        for( size_t k = 0; k < n; k = k + 1 ) {
+            auto & q = *queues[ (worker + k) % n ];
+            std::lock_guard< std::mutex > lock( q.mtx );
+            auto & tasks = q.tasks[ p ];
+            if( not tasks.empty() ) {
+                task = std::move( tasks.front() );
+                tasks.pop_front();
+                queued_count.fetch_sub( 1 );
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void
+work_stealing_pool_t::work( size_t worker )
+{
+    current_pool = this;
+    current_worker = worker;
+
+    task_type task;
+    for( ;; ) {
+        if( try_take( worker, task )) {
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock< std::mutex > lock( sleep_mtx );
+        if( queued_count.load() != 0 ) {
+            continue;
+        }
+        if( stopping ) {
+            return;
+        }
+        sleeping = sleeping + 1;
+        wake.wait( lock );
+        sleeping = sleeping - 1;
+    }
+}
+
+executor_t &
+default_executor()
+{
+    static work_stealing_pool_t pool;
+    return pool;
+}
+
+void
+parallel_for( size_t n, size_t threads, std::function< void( size_t ) > const & f,
+              executor_t & executor )
+{
+    if( n == 0 ) {
+        return;
+    }
+    auto state = std::make_shared< parallel_for_state_t >();
+    state->f = &f;
+    state->n = n;
+
+    auto helpers = std::min( std::max< size_t >( threads, 1 ), n ) - 1;
+    for( size_t t = 0; t < helpers; t = t + 1 ) {
+        try {
+            executor.submit( [ state ]() { state->run(); } );
+        } catch( ... ) {
+            /* The calling thread does the rest. */
+            break;
+        }
+    }
+    state->run();
+
+    std::unique_lock< std::mutex > lock( state->mtx );
+    state->finished.wait( lock, [ & ]() { return state->running == 0; } );
+    if( state->error ) {
+        std::rethrow_exception( state->error );
+    }
+}
+}
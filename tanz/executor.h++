@@ -0,0 +1,113 @@
+#pragma once
+#ifndef FILE_7E3B1C95A40D2F6_0B8E4D61C27F93A5_INCLUDED
+#define FILE_7E3B1C95A40D2F6_0B8E4D61C27F93A5_INCLUDED
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Where background work runs.  executor_t is the interface,
+   work_stealing_pool_t the implementation with a fixed number of
+   threads, and default_executor() a pool shared by everybody, with
+   one thread per core. */
+
+namespace tz {
+
+enum executor_priority_t {
+    EXECUTOR_PRIORITY_LOW = 0,
+    EXECUTOR_PRIORITY_NORMAL = 1,
+    EXECUTOR_PRIORITY_HIGH = 2
+};
+
+struct executor_t
+{
+    using task_type = std::function< void() >;
+
+    virtual ~executor_t() = default;
+
+    virtual void
+    submit( task_type task, executor_priority_t priority = EXECUTOR_PRIORITY_NORMAL ) = 0;
+    /* Tasks must not throw. */
+};
+
+struct work_stealing_pool_t
+    : public executor_t
+/* Every worker has its own queues, one per priority.  Tasks
+   submitted from a worker go to its own queues, others are
+   distributed round robin.  An idle worker takes the oldest task of
+   the highest priority, from its own queues first, otherwise from
+   the other workers.  Priorities are a preference, not a strict
+   global order.
+
+   The destructor runs all tasks submitted so far. */
+{
+    explicit work_stealing_pool_t( size_t threads = 0 );
+    /* 0 means one per hardware thread. */
+
+    ~work_stealing_pool_t();
+
+    work_stealing_pool_t( work_stealing_pool_t const & ) = delete;
+    work_stealing_pool_t & operator = ( work_stealing_pool_t const & ) = delete;
+
+    void
+    submit( task_type task, executor_priority_t priority = EXECUTOR_PRIORITY_NORMAL ) override;
+
+    size_t
+    thread_count() const
+    {
+        return threads.size();
+    }
+
+    size_t
+    queued() const
+    /* Submitted, but not started yet. */
+    {
+        return queued_count.load( std::memory_order_relaxed );
+    }
+
+private:
+    static constexpr size_t priority_count = 3;
+
+    struct alignas( 64 ) worker_queue_t {
+        std::mutex mtx;
+        std::array< std::deque< task_type >, priority_count > tasks;
+    };
+
+    bool
+    try_take( size_t worker, task_type & task );
+
+    void
+    work( size_t worker );
+
+    std::vector< std::unique_ptr< worker_queue_t > > queues;
+    std::vector< std::thread > threads;
+    std::atomic< size_t > queued_count{ 0 };
+    std::atomic< size_t > next_queue{ 0 };
+
+    std::mutex sleep_mtx;
+    std::condition_variable wake;
+    size_t sleeping = 0;
+    bool stopping = false;
+};
+
+executor_t &
+default_executor();
+
+void
+parallel_for( size_t n, size_t threads, std::function< void( size_t ) > const & f,
+              executor_t & executor = default_executor() );
+/* Calls f( k ) for all k in [0, n) on the calling thread and up to
+   threads - 1 tasks of executor.  Indices are handed out one at a
+   time, a task starting late finds none left instead of being waited
+   for, so a busy executor (or being called from one of its tasks)
+   only means less parallelism.  Returns when all calls that started
+   have returned.  The first exception of f is rethrown, no further
+   indices are handed out after it. */
+}
+#endif
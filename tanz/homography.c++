@@ -1,7 +1,174 @@
 #include "tanz/homography.h++"
+#include <tanz/dlt.h++>
+#include <algorithm>
+#include <cmath>
 #include <stdexcept>
 
 namespace tz {
+namespace {
+
+template< typename F_left, typename F_right >
+Eigen::Matrix3d
+normalised_dlt( size_t n, F_left const & left, F_right const & right )
+/* Two rows per correspondence, in normalised coordinates. */
+{
+    auto tl = point_normalisation_t::of( n, left );
+    auto tr = point_normalisation_t::of( n, right );
+    null_space_accumulator_t< 9 > dlt;
+    for( size_t k = 0; k < n; k = k + 1 ) {
+        auto l = tl( left( k ));
+        auto r = tr( right( k ));
+        dlt.add( (null_space_accumulator_t< 9 >::row_t()
+                  << r( 0 ), r( 1 ), 1, 0, 0, 0, -l( 0 ) * r( 0 ), -l( 0 ) * r( 1 ), -l( 0 )).finished() );
+        dlt.add( (null_space_accumulator_t< 9 >::row_t()
+                  << 0, 0, 0, r( 0 ), r( 1 ), 1, -l( 1 ) * r( 0 ), -l( 1 ) * r( 1 ), -l( 1 )).finished() );
+    }
+    Eigen::Matrix< double, 9, 1 > h = dlt.solve();
+    Eigen::Matrix3d hn = Eigen::Map< Eigen::Matrix< double, 3, 3, Eigen::RowMajor > >( h.data() );
+    return tl.inverse() * hn * tr.matrix();
+}
+
+bool
+collinear( Eigen::Vector2d const * p, double eps )
+/* Any three of four points. */
+{
+    for( int skip = 0; skip < 4; skip = skip + 1 ) {
+        Eigen::Vector2d q[ 3 ];
+        int k = 0;
+        for( int i = 0; i < 4; i = i + 1 ) {
+            if( i != skip ) {
+                q[ k ] = p[ i ];
+                k = k + 1;
+            }
+        }
+        Eigen::Vector2d u = q[ 1 ] - q[ 0 ];
+        Eigen::Vector2d v = q[ 2 ] - q[ 0 ];
+        if( std::abs( u( 0 ) * v( 1 ) - u( 1 ) * v( 0 )) < eps ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+minimal_homography( Eigen::Vector2d const * left, Eigen::Vector2d const * right, Eigen::Matrix3d & h )
+/* Exact homography from four correspondences, fixed size and without
+   allocation.  In normalised coordinates the centroids are at the
+   origin, so h(2,2) = 1 is safe for any sensible sample. */
+{
+    auto tl = point_normalisation_t::of( 4, [ left ]( size_t k ) { return left[ k ]; } );
+    auto tr = point_normalisation_t::of( 4, [ right ]( size_t k ) { return right[ k ]; } );
+    Eigen::Vector2d l[ 4 ];
+    Eigen::Vector2d r[ 4 ];
+    for( int k = 0; k < 4; k = k + 1 ) {
+        l[ k ] = tl( left[ k ] );
+        r[ k ] = tr( right[ k ] );
+    }
+    constexpr double eps = 1e-6;
+    if( collinear( l, eps ) or collinear( r, eps )) {
+        return false;
+    }
+
+    Eigen::Matrix< double, 8, 8 > a;
+    Eigen::Matrix< double, 8, 1 > b;
+    for( int k = 0; k < 4; k = k + 1 ) {
+        auto x = r[ k ]( 0 );
+        auto y = r[ k ]( 1 );
+        auto u = l[ k ]( 0 );
+        auto v = l[ k ]( 1 );
+        a.row( 2 * k ) << x, y, 1, 0, 0, 0, -u * x, -u * y;
+        a.row( 2 * k + 1 ) << 0, 0, 0, x, y, 1, -v * x, -v * y;
+        b( 2 * k ) = u;
+        b( 2 * k + 1 ) = v;
+    }
+    Eigen::FullPivLU< Eigen::Matrix< double, 8, 8 > > lu( a );
+    if( not lu.isInvertible() ) {
+        return false;
+    }
+    Eigen::Matrix< double, 8, 1 > x = lu.solve( b );
+    Eigen::Matrix3d hn;
+    hn <<
+        x( 0 ), x( 1 ), x( 2 ),
+        x( 3 ), x( 4 ), x( 5 ),
+        x( 6 ), x( 7 ), 1;
+    h = tl.inverse() * hn * tr.matrix();
+    return h.allFinite();
+}
+
+struct correspondences_t
+/* Structure of arrays, so transfer errors are computed vectorised. */
+{
+    Eigen::ArrayXd lx;
+    Eigen::ArrayXd ly;
+    Eigen::ArrayXd rx;
+    Eigen::ArrayXd ry;
+
+    correspondences_t( std::vector< Eigen::Vector2d > const & left,
+                       std::vector< Eigen::Vector2d > const & right )
+        : lx( left.size() ), ly( left.size() ), rx( right.size() ), ry( right.size() )
+    {
+        for( size_t k = 0; k < left.size(); k = k + 1 ) {
+            lx( k ) = left[ k ]( 0 );
+            ly( k ) = left[ k ]( 1 );
+            rx( k ) = right[ k ]( 0 );
+            ry( k ) = right[ k ]( 1 );
+        }
+    }
+
+    template< typename F >
+    size_t
+    inliers( Eigen::Matrix3d const & h, double threshold, size_t needed, F const & each ) const
+    /* Calls each( k ) for every inlier k, gives up once needed cannot
+       be reached anymore. */
+    {
+        constexpr Eigen::Index block = 256;
+        Eigen::Array< double, Eigen::Dynamic, 1, 0, block, 1 > w;
+        Eigen::Array< double, Eigen::Dynamic, 1, 0, block, 1 > d2;
+        auto n = lx.size();
+        auto t2 = threshold * threshold;
+        size_t count = 0;
+        for( Eigen::Index s = 0; s < n; s = s + block ) {
+            auto len = std::min( block, n - s );
+            auto x = rx.segment( s, len );
+            auto y = ry.segment( s, len );
+            w = (h( 2, 0 ) * x + h( 2, 1 ) * y + h( 2, 2 )).inverse();
+            d2 = ((h( 0, 0 ) * x + h( 0, 1 ) * y + h( 0, 2 )) * w - lx.segment( s, len )).square()
+                + ((h( 1, 0 ) * x + h( 1, 1 ) * y + h( 1, 2 )) * w - ly.segment( s, len )).square();
+            if constexpr( std::is_same_v< F, std::nullptr_t > ) {
+                count = count + size_t( (d2 <= t2).count() );
+            } else {
+                for( Eigen::Index k = 0; k < len; k = k + 1 ) {
+                    if( d2( k ) <= t2 ) {
+                        each( size_t( s + k ));
+                        count = count + 1;
+                    }
+                }
+            }
+            if( count + size_t( n - s - len ) < needed ) {
+                return count;
+            }
+        }
+        return count;
+    }
+
+    std::vector< size_t >
+    inlier_indices( Eigen::Matrix3d const & h, double threshold ) const
+    {
+        std::vector< size_t > indices;
+        inliers( h, threshold, 0, [ & ]( size_t k ) { indices.push_back( k ); } );
+        return indices;
+    }
+};
+
+Eigen::Matrix3d
+scaled( Eigen::Matrix3d const & h )
+{
+    if( std::abs( h( 2, 2 )) > 1e-12 * h.norm() ) {
+        return h * (1 / h( 2, 2 ));
+    }
+    return h / h.norm();
+}
+}
 
 Eigen::Matrix3d
 compute_homography_2d( std::vector< Eigen::Vector2d > const & left_observations,
@@ -17,34 +184,69 @@ compute_homography_2d( std::vector< Eigen::Vector2d > const & left_observations,
             std::domain_error( "At least four points are needed for homography estimation" );
     }
 
-    auto dlt_matrix_add_observation
-        = [] (Eigen::MatrixXd & mat, size_t obs_index, Eigen::Vector2d const & a, Eigen::Vector2d const & b)
-        {
-            mat.block< 1, 3 >( obs_index * 3, 0 ) = Eigen::Vector3d::Zero().transpose();
-            mat.block< 1, 3 >( obs_index * 3, 3 ) = - b.homogeneous().transpose();
-            mat.block< 1, 3 >( obs_index * 3, 6 ) = a(1) * b.homogeneous().transpose();
-
-            mat.block< 1, 3 >( obs_index * 3 + 1, 0 ) = b.homogeneous().transpose();
-            mat.block< 1, 3 >( obs_index * 3 + 1, 3 ) = Eigen::Vector3d::Zero().transpose();
-            mat.block< 1, 3 >( obs_index * 3 + 1, 6 ) = - a(0) * b.homogeneous().transpose();
-
-            mat.block< 1, 3 >( obs_index * 3 + 2, 0 ) = - a(1) * b.homogeneous().transpose();
-            mat.block< 1, 3 >( obs_index * 3 + 2, 3 ) = a(0) * b.homogeneous().transpose();
-            mat.block< 1, 3 >( obs_index * 3 + 2, 6 ) = Eigen::Vector3d::Zero().transpose();
-        };
+    Eigen::Matrix3d m =
+        normalised_dlt( left_observations.size(),
+                        [ & ]( size_t k ) { return left_observations[ k ]; },
+                        [ & ]( size_t k ) { return right_observations[ k ]; } );
+    m = m * (1/m(2,2));
+    return m;
+}
 
-    Eigen::MatrixXd dlt( left_observations.size() * 3, 9 );
+robust_homography_t
+estimate_homography_2d( std::vector< Eigen::Vector2d > const & left_observations,
+                        std::vector< Eigen::Vector2d > const & right_observations,
+                        ransac_options_t const & options )
+{
+    if( left_observations.size() != right_observations.size() ) {
+        throw
+            std::domain_error( "Left and right observations are of different size." );
+    }
 
-    for( size_t k = 0; k < left_observations.size(); k = k + 1 ) {
-        dlt_matrix_add_observation( dlt, k, left_observations.at( k ), right_observations.at( k ) );
+    if( left_observations.size() < 4 ) {
+        throw
+            std::domain_error( "At least four points are needed for homography estimation" );
     }
-    Eigen::JacobiSVD< Eigen::MatrixXd > svd( dlt, Eigen::ComputeThinU | Eigen::ComputeFullV );
 
-    Eigen::VectorXd h = svd.matrixV().col( 8 );
+    correspondences_t points( left_observations, right_observations );
+    auto best =
+        ransac< 4, Eigen::Matrix3d >(
+            left_observations.size(), options,
+            [ & ]( std::array< size_t, 4 > const & sample, Eigen::Matrix3d & h )
+            {
+                Eigen::Vector2d l[ 4 ];
+                Eigen::Vector2d r[ 4 ];
+                for( int k = 0; k < 4; k = k + 1 ) {
+                    l[ k ] = left_observations[ sample[ k ] ];
+                    r[ k ] = right_observations[ sample[ k ] ];
+                }
+                return minimal_homography( l, r, h );
+            },
+            [ & ]( Eigen::Matrix3d const & h, size_t needed )
+            {
+                return points.inliers( h, options.threshold, needed, nullptr );
+            } );
+    if( not best.found ) {
+        throw std::domain_error( "No homography found." );
+    }
 
-    Eigen::Matrix3d m
-        = Eigen::Map< Eigen::Matrix< double, 3, 3,  Eigen::RowMajor>>( h.data());
-    m = m * (1/m(2,2));
-    return m;
+    robust_homography_t result;
+    result.homography = best.model;
+    result.inliers = points.inlier_indices( best.model, options.threshold );
+    result.hypotheses = best.hypotheses;
+    for( size_t k = 0; (k < options.refinements) and (result.inliers.size() >= 4); k = k + 1 ) {
+        auto const & inliers = result.inliers;
+        Eigen::Matrix3d h =
+            normalised_dlt( inliers.size(),
+                            [ & ]( size_t i ) { return left_observations[ inliers[ i ] ]; },
+                            [ & ]( size_t i ) { return right_observations[ inliers[ i ] ]; } );
+        auto refined = points.inlier_indices( h, options.threshold );
+        if( refined.size() < inliers.size() ) {
+            break;
+        }
+        result.homography = h;
+        result.inliers = std::move( refined );
+    }
+    result.homography = scaled( result.homography );
+    return result;
 }
 }
@@ -6,12 +6,31 @@
 #include <vector>
 #include <Eigen/Dense>
 #include <Eigen/Geometry>
+#include <tanz/ransac.h++>
 
 namespace tz {
 
 Eigen::Matrix3d
 compute_homography_2d( std::vector< Eigen::Vector2d > const & left_observations,
                        std::vector< Eigen::Vector2d > const & right_observations );
+/* Least squares homography h with left ~ h * right, by the
+   normalised DLT.  Scaled to h(2,2) = 1. */
+
+struct robust_homography_t {
+    Eigen::Matrix3d homography;
+    std::vector< size_t > inliers;
+    size_t hypotheses = 0;
+};
+
+robust_homography_t
+estimate_homography_2d( std::vector< Eigen::Vector2d > const & left_observations,
+                        std::vector< Eigen::Vector2d > const & right_observations,
+                        ransac_options_t const & options = ransac_options_t() );
+/* Like compute_homography_2d, but robust against outliers.
+   Hypotheses come from four correspondences each, an inlier is
+   within options.threshold of the transferred right observation, and
+   the result is refined by least squares on the inliers.  Throws
+   std::domain_error if no homography is found. */
 
 
 }
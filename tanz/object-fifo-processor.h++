@@ -1,10 +1,493 @@
 #pragma once
 #ifndef FILE_E97C1C8BB1A36A1_983A8916C109E7E_INCLUDED
 #define FILE_E97C1C8BB1A36A1_983A8916C109E7E_INCLUDED
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <tanz/object-fifo.h++>
+
+/* A pipeline of processing stages, each one with a number of worker
+   threads, joined by bounded object_fifos.
+
+       auto proc =
+           tz::make_object_fifo_processor< frame_t >( 8 )
+               .then( 4, decode )
+               .then( 2, analyse, tz::FIFO_ORDER_KEEP );
+
+       proc.write_blockingly( frame ); ...  proc.close();
+       try {
+           for( ;; ) { use( proc.read_blockingly()); }
+       } catch( tz::fifo_is_closed const & ) {}
+       proc.wait(); // rethrows the first exception of a worker
+
+   Every element gets the index it was written with (like the
+   indices of queue_state()) and carries it through the pipeline.  A
+   stage with FIFO_ORDER_KEEP hands on its results in index order,
+   all other stages in the order the workers finish.  It holds back
+   fewer results than its output fifo takes, a worker that is ahead
+   by more waits, unless the missing result is still in an unordered
+   stage before.
+
+   Shutdown travels along the fifos: If the input is closed, the
+   workers drain it and the last worker of a stage closes the
+   output.  If an output is closed (or a worker throws), the stage
+   closes its input as well, so the stages before stop too.
+
+   The ring backends (fifo_backend_mpmc_ring) can be used for the
+   fifos, but fifo_backend_spsc_ring cannot, as there may be
+   several workers per stage. */
+
 namespace tz {
 
-template< typename T_arg >
+template< typename T >
+struct sequenced_t {
+    uint64_t index;
+    T value;
+};
+
+enum fifo_processor_order_t {
+    FIFO_ORDER_ANY = 1,
+    FIFO_ORDER_KEEP = 2
+};
+
+struct fifo_stage_statistics_t {
+    size_t workers = 0;
+    size_t queue_depth = 0;  /* elements waiting in the input fifo */
+    uint64_t processed = 0;
+    double busy_time = 0.0;  /* seconds, summed over the workers */
+    double idle_time = 0.0;  /* waiting for input or for the output */
+    size_t reorder_peak = 0; /* most results held back, FIFO_ORDER_KEEP */
+};
+
+namespace impl {
+
+struct fifo_processor_stage_base_t
+{
+    virtual ~fifo_processor_stage_base_t() = default;
+
+    virtual void close() = 0;
+    virtual void join() = 0;
+    virtual std::exception_ptr error() = 0;
+    virtual fifo_stage_statistics_t statistics() const = 0;
+};
+
+template< typename T_in, typename T_out, typename F, typename backend >
+struct fifo_processor_stage_t
+    : public fifo_processor_stage_base_t
+{
+    using input_fifo_t  = object_fifo< sequenced_t< T_in >, backend >;
+    using output_fifo_t = object_fifo< sequenced_t< T_out >, backend >;
+    using clock_t = std::chrono::steady_clock;
+
+    std::shared_ptr< input_fifo_t > input;
+    std::shared_ptr< output_fifo_t > output;
+    F fn;
+    fifo_processor_order_t order;
+
+    std::vector< std::thread > threads;
+    std::atomic< size_t > running;
+
+    std::atomic< uint64_t > processed;
+    std::atomic< int64_t > busy_ns;
+    std::atomic< int64_t > idle_ns;
+
+    std::mutex error_mtx;
+    std::exception_ptr first_error;
+
+    mutable std::mutex reorder_mtx;
+    std::condition_variable reorder_space;
+    uint64_t next_index = 0;
+    uint64_t reorder_window;
+    std::map< uint64_t, T_out > reorder_buffer;
+    std::vector< std::optional< uint64_t > > working_on; /* per worker */
+    std::atomic< size_t > reading;
+    size_t reorder_peak = 0;
+
+    fifo_processor_stage_t( std::shared_ptr< input_fifo_t > input_,
+                            std::shared_ptr< output_fifo_t > output_,
+                            F fn_,
+                            size_t workers,
+                            fifo_processor_order_t order_,
+                            size_t reorder_window_ )
+        : input( std::move( input_ )),
+          output( std::move( output_ )),
+          fn( std::move( fn_ )),
+          order( order_ ),
+          running( workers ),
+          processed( 0 ),
+          busy_ns( 0 ),
+          idle_ns( 0 ),
+          reorder_window( std::max< size_t >( 1, reorder_window_ )),
+          working_on( workers ),
+          reading( 0 )
+    {
+        if( workers < 1 ) {
+            throw std::domain_error( "A stage needs at least one worker." );
+        }
+        for( size_t k = 0; k < workers; k = k + 1 ) {
+            threads.emplace_back( [ this, k ]() { work( k ); } );
+        }
+    }
+
+    ~fifo_processor_stage_t()
+    {
+        close();
+        join();
+    }
+
+    void close() override
+    {
+        input->close();
+        output->close();
+        wake_reordering();
+    }
+
+    void wake_reordering()
+    {
+        std::lock_guard< std::mutex > lock( reorder_mtx );
+        reorder_space.notify_all();
+    }
+
+    void join() override
+    {
+        for( auto & t : threads ) {
+            if( t.joinable() ) {
+                t.join();
+            }
+        }
+    }
+
+    std::exception_ptr error() override
+    {
+        std::lock_guard< std::mutex > lock( error_mtx );
+        return first_error;
+    }
+
+    fifo_stage_statistics_t statistics() const override
+    {
+        fifo_stage_statistics_t s;
+        s.workers = threads.size();
+        s.queue_depth = input->size();
+        s.processed = processed.load();
+        s.busy_time = 1.0E-9 * busy_ns.load();
+        s.idle_time = 1.0E-9 * idle_ns.load();
+        {
+            std::lock_guard< std::mutex > lock( reorder_mtx );
+            s.reorder_peak = reorder_peak;
+        }
+        return s;
+    }
+
+    bool next_in_progress() const
+    /* With reorder_mtx locked.  A worker between reading and
+       registering its index might have it as well. */
+    {
+        return (reading.load() > 0)
+            or (std::find( working_on.begin(), working_on.end(), next_index ) != working_on.end());
+    }
+
+    void deliver( sequenced_t< T_out > && y, size_t worker )
+    {
+        if( order == FIFO_ORDER_ANY ) {
+            output->write_blockingly( std::move( y ));
+            return;
+        }
+
+        /* Whoever completes the next index writes all consecutive
+           results.  The lock is held while writing, so the order is
+           kept and a full output slows down all workers alike.
+           Results too far ahead of the next index wait, so a slow
+           element holds back at most reorder_window - 1 results
+           instead of everything the other workers finish meanwhile.
+           They only wait for a worker of this stage, if an unordered
+           stage before still has the next index, this stage has to
+           keep reading to let it through. */
+        std::unique_lock< std::mutex > lock( reorder_mtx );
+        reorder_space.wait(
+            lock,
+            [ & ]()
+            {
+                return (y.index - next_index < reorder_window)
+                    or (not next_in_progress())
+                    or output->closed();
+            } );
+        working_on[ worker ] = {};
+        if( output->closed() ) {
+            throw fifo_is_closed();
+        }
+        if( y.index != next_index ) {
+            reorder_buffer.emplace( y.index, std::move( y.value ));
+            reorder_peak = std::max( reorder_peak, reorder_buffer.size() );
+            return;
+        }
+        output->write_blockingly( std::move( y ));
+        next_index = next_index + 1;
+        while( (not reorder_buffer.empty())
+               and (reorder_buffer.begin()->first == next_index) ) {
+            auto node = reorder_buffer.extract( reorder_buffer.begin());
+            output->write_blockingly( sequenced_t< T_out >{ node.key(), std::move( node.mapped()) } );
+            next_index = next_index + 1;
+        }
+        reorder_space.notify_all();
+    }
 
+    void register_reading( size_t worker, std::optional< uint64_t > index )
+    {
+        std::lock_guard< std::mutex > lock( reorder_mtx );
+        working_on[ worker ] = index;
+        reading -= 1;
+        reorder_space.notify_all();
+    }
 
+    sequenced_t< T_in > read_input( size_t worker, bool & exhausted )
+    {
+        if( order == FIFO_ORDER_ANY ) {
+            try {
+                return input->read_blockingly();
+            } catch( fifo_is_closed const & ) {
+                exhausted = true;
+                throw;
+            }
+        }
+
+        reading += 1;
+        std::optional< sequenced_t< T_in > > x;
+        try {
+            x.emplace( input->read_blockingly() );
+        } catch( fifo_is_closed const & ) {
+            exhausted = true;
+            register_reading( worker, {} );
+            throw;
+        } catch( ... ) {
+            register_reading( worker, {} );
+            throw;
+        }
+        register_reading( worker, x->index );
+        return std::move( *x );
+    }
+
+    void work( size_t worker )
+    {
+        auto elapsed_ns =
+            []( clock_t::time_point a, clock_t::time_point b )
+            {
+                return std::chrono::duration_cast< std::chrono::nanoseconds >( b - a ).count();
+            };
+
+        bool input_exhausted = false;
+        try {
+            for( ;; ) {
+                auto t0 = clock_t::now();
+                auto x = read_input( worker, input_exhausted );
+                auto t1 = clock_t::now();
+                sequenced_t< T_out > y{ x.index, fn( std::move( x.value )) };
+                auto t2 = clock_t::now();
+                deliver( std::move( y ), worker );
+                auto t3 = clock_t::now();
+
+                processed += 1;
+                busy_ns += elapsed_ns( t1, t2 );
+                idle_ns += elapsed_ns( t0, t1 ) + elapsed_ns( t2, t3 );
+            }
+        } catch( fifo_is_closed const & ) {
+        } catch( ... ) {
+            std::lock_guard< std::mutex > lock( error_mtx );
+            if( not first_error ) {
+                first_error = std::current_exception();
+            }
+        }
+
+        if( not input_exhausted ) {
+            /* Cancelled from downstream or failed: stop upstream. */
+            input->close();
+            output->close();
+            wake_reordering();
+        }
+        if( running.fetch_sub( 1 ) == 1 ) {
+            output->close();
+        }
+    }
+};
+}
+
+template< typename T_in, typename T_out = T_in, typename backend = fifo_backend_locked >
+struct object_fifo_processor
+{
+    using input_type  = T_in;
+    using output_type = T_out;
+    using input_fifo_t  = object_fifo< sequenced_t< T_in >, backend >;
+    using output_fifo_t = object_fifo< sequenced_t< T_out >, backend >;
+
+    using stage_ptr = std::unique_ptr< impl::fifo_processor_stage_base_t >;
+
+    size_t queue_depth;
+    std::shared_ptr< std::atomic< uint64_t > > next_index;
+    std::shared_ptr< input_fifo_t > input;
+    std::shared_ptr< output_fifo_t > output;
+    std::vector< stage_ptr > stages;
+
+    object_fifo_processor( size_t queue_depth_,
+                           std::shared_ptr< std::atomic< uint64_t > > next_index_,
+                           std::shared_ptr< input_fifo_t > input_,
+                           std::shared_ptr< output_fifo_t > output_,
+                           std::vector< stage_ptr > stages_ )
+        : queue_depth( queue_depth_ ),
+          next_index( std::move( next_index_ )),
+          input( std::move( input_ )),
+          output( std::move( output_ )),
+          stages( std::move( stages_ ))
+    {
+    }
+
+    object_fifo_processor( object_fifo_processor const & ) = delete;
+    object_fifo_processor & operator = ( object_fifo_processor const & ) = delete;
+    object_fifo_processor( object_fifo_processor && ) = default;
+
+    ~object_fifo_processor()
+    {
+        cancel();
+        stages.clear(); // joins
+    }
+
+    template< typename F >
+    auto
+    then( size_t workers,
+          F fn,
+          fifo_processor_order_t order = FIFO_ORDER_ANY,
+          size_t stage_queue_depth = 0 ) &&
+    /* Appends a stage, which starts working immediately.  fn is
+       called with the element as rvalue, concurrently from all
+       workers of the stage. */
+    {
+        using result_t = std::decay_t< std::invoke_result_t< F &, T_out && > >;
+        using stage_t = impl::fifo_processor_stage_t< T_out, result_t, F, backend >;
+        using next_t = object_fifo_processor< T_in, result_t, backend >;
+
+        auto stage_output =
+            std::make_shared< typename next_t::output_fifo_t >(
+                stage_queue_depth ? stage_queue_depth : queue_depth );
+
+        stages.push_back(
+            std::make_unique< stage_t >( std::move( output ), stage_output, std::move( fn ), workers, order,
+                                         stage_queue_depth ? stage_queue_depth : queue_depth ));
+
+        return next_t( queue_depth,
+                       std::move( next_index ),
+                       std::move( input ),
+                       std::move( stage_output ),
+                       std::move( stages ));
+    }
+
+    uint64_t write_blockingly( T_in x )
+    /* Returns the index of the element. */
+    {
+        auto idx = next_index->fetch_add( 1 );
+        input->write_blockingly( sequenced_t< T_in >{ idx, std::move( x ) } );
+        return idx;
+    }
+
+    T_out read_blockingly()
+    {
+        return std::move( output->read_blockingly().value );
+    }
+
+    sequenced_t< T_out > read_sequenced_blockingly()
+    {
+        return output->read_blockingly();
+    }
+
+    std::optional< T_out > read_timeout( double span )
+    {
+        auto x = output->read_timeout( span );
+        if( x ) {
+            return std::move( x->value );
+        }
+        return {};
+    }
+
+    void close()
+    /* No more input, the pipeline drains and closes its output. */
+    {
+        if( input ) {
+            input->close();
+        }
+    }
+
+    void cancel()
+    /* Closes all fifos, queued elements are dropped. */
+    {
+        if( input ) {
+            input->close();
+        }
+        for( auto & s : stages ) {
+            s->close();
+        }
+        if( output ) {
+            output->close();
+        }
+    }
+
+    void wait()
+    /* Joins all workers, call it after the output has been closed
+       (or cancel()).  Rethrows the first exception of a worker. */
+    {
+        for( auto & s : stages ) {
+            s->join();
+        }
+        for( auto & s : stages ) {
+            if( auto e = s->error() ) {
+                std::rethrow_exception( e );
+            }
+        }
+    }
+
+    std::vector< fifo_stage_statistics_t >
+    statistics() const
+    /* One entry per stage, in pipeline order. */
+    {
+        std::vector< fifo_stage_statistics_t > result;
+        for( auto const & s : stages ) {
+            result.push_back( s->statistics() );
+        }
+        return result;
+    }
+
+    std::shared_ptr< input_fifo_t > input_fifo() const
+    {
+        return input;
+    }
+
+    std::shared_ptr< output_fifo_t > output_fifo() const
+    {
+        return output;
+    }
+};
+
+template< typename T, typename backend = fifo_backend_locked >
+object_fifo_processor< T, T, backend >
+make_object_fifo_processor( size_t queue_depth )
+/* A processor without stages yet, its input is its output. */
+{
+    auto fifo = std::make_shared< object_fifo< sequenced_t< T >, backend > >( queue_depth );
+    return object_fifo_processor< T, T, backend >(
+        queue_depth,
+        std::make_shared< std::atomic< uint64_t > >( 0 ),
+        fifo,
+        fifo,
+        {} );
+}
 }
 #endif
@@ -12,6 +12,13 @@
 #include <chrono>
 #include <optional>
 #include <atomic>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <iterator>
+#include <type_traits>
+
+#include <tanz/ring-buffer.h++>
 
 namespace tz {
 
@@ -27,13 +34,50 @@ struct fifo_max_size_must_be_positive
     };
 };
 
-template<typename T>
-struct object_fifo
+/* Backends of object_fifo:
+
+   - fifo_backend_locked: std::deque behind a single mutex.  May be
+     unbounded.
+
+   - fifo_backend_spsc_ring: preallocated ring, exactly one writing
+     and one reading thread.  No write_overwrite, the writer cannot
+     take back a published slot without slowing down every read.
+
+   - fifo_backend_mpmc_ring: preallocated ring, any number of
+     writers and readers.
+
+   write_overwrite on a full fifo drops the newest element, x takes
+   its place.  The elements already waiting longest are kept, so a
+   slow reader still sees the stream from where it stopped plus the
+   latest state.
+
+   The ring backends are lock-free as long as nobody has to wait,
+   waiting threads are parked on a condition variable and only woken
+   if there is something to do for them.  They need a max size and
+   nothrow move constructible elements. */
+
+struct fifo_backend_locked {};
+
+struct fifo_backend_spsc_ring {
+    template< typename T >
+    using ring_type = spsc_ring_t< T >;
+};
+
+struct fifo_backend_mpmc_ring {
+    template< typename T >
+    using ring_type = mpmc_ring_t< T >;
+};
+
+template< typename T, typename backend = fifo_backend_locked >
+struct object_fifo;
+
+template< typename T >
+struct object_fifo< T, fifo_backend_locked >
 {
     /* TODO:
-     * - Add move versions for writing and reading.
      * - Reduce number of locking operations at runtime,
      *   there is some monotonicty to be taken use of.
+     *   (The ring backends do so.)
      */
 private:
     using mutex_t = ::std::mutex;
@@ -82,8 +126,9 @@ public:
         input_state_change.notify_all();
     }
 
-    /** With multiple writers there's no guarantee about the order. */
-    void write_overwrite( value_type const& x )
+private:
+    template< typename U >
+    void write_overwrite_impl( U && x )
     {
         lock_t lock( mtx );
 
@@ -94,12 +139,13 @@ public:
         }
         reserve_space(); // cannot fail
         history_count = history_count + 1;
-        queue.push_back( x );
+        queue.push_back( std::forward< U >( x ));
 
         input_state_change.notify_all();
     }
 
-    void write_blockingly( value_type const& x )
+    template< typename U >
+    void write_blockingly_impl( U && x )
     {
         lock_t lock( mtx );
 
@@ -113,11 +159,57 @@ public:
             goto try_with_mutex_still_locked;
         } else {
             history_count = history_count + 1;
-            queue.push_back( x );
+            queue.push_back( std::forward< U >( x ));
             input_state_change.notify_all();
         }
     }
 
+public:
+    /** With multiple writers there's no guarantee about the order. */
+    void write_overwrite( value_type const& x )
+    {
+        write_overwrite_impl( x );
+    }
+
+    void write_overwrite( value_type && x )
+    {
+        write_overwrite_impl( std::move( x ));
+    }
+
+    void write_blockingly( value_type const& x )
+    {
+        write_blockingly_impl( x );
+    }
+
+    void write_blockingly( value_type && x )
+    {
+        write_blockingly_impl( std::move( x ));
+    }
+
+    template< typename Iterator >
+    void write_batch( Iterator begin, Iterator end )
+    /* Writes all elements, blocks while the fifo is full.  Use
+       std::make_move_iterator to move the elements in.  If the fifo
+       gets closed meanwhile, fifo_is_closed is thrown and only a
+       prefix has been written. */
+    {
+        lock_t lock( mtx );
+
+        while( begin != end ) {
+            if ( marked_as_closed ) {
+                throw fifo_is_closed();
+            } else if ( queue.size() == max_size ) {
+                input_state_change.notify_all();
+                input_state_change.wait( lock );
+            } else {
+                history_count = history_count + 1;
+                queue.push_back( *begin );
+                ++begin;
+            }
+        }
+        input_state_change.notify_all();
+    }
+
     std::tuple< size_t, size_t, bool >
     queue_state()
     /* Returns the state of the queue, a triple
@@ -155,6 +247,35 @@ public:
         }
     }
 
+    template< typename OutputIterator >
+    size_t read_batch( OutputIterator out, size_t max_count )
+    /* Blocks until at least one element is available and moves up to
+       max_count elements to out.  Returns the number of elements
+       read. */
+    {
+        if( max_count == 0 ) {
+            return 0;
+        }
+
+        lock_t lock( mtx );
+
+        while( queue.empty() ) {
+            if ( marked_as_closed ) {
+                throw fifo_is_closed();
+            }
+            input_state_change.wait( lock );
+        }
+
+        size_t count = 0;
+        for( ; (count < max_count) and (not queue.empty()); count = count + 1 ) {
+            *out = std::move( queue.front());
+            ++out;
+            queue.pop_front();
+        }
+        input_state_change.notify_all();
+        return count;
+    }
+
     template< typename Clock, typename Duration >
     std::optional< value_type >
     read_timeout( std::chrono::time_point< Clock, Duration > const &time_max )
@@ -224,10 +345,360 @@ public:
     }
 };
 
-template< typename T >
+namespace impl {
+
+template< typename T, typename ring_t >
+struct ring_fifo_t
+{
+private:
+    using mutex_t = ::std::mutex;
+    using lock_t  = ::std::unique_lock< mutex_t >;
+    using condition_variable_t = ::std::condition_variable;
+
+    static int spin_tries()
+    /* Spinning only pays off if the other side runs meanwhile. */
+    {
+        static int const tries = (::std::thread::hardware_concurrency() > 1) ? 64 : 1;
+        return tries;
+    }
+
+    ring_t ring;
+    ::std::atomic< bool > marked_as_closed;
+
+    /* Parking lot for waiting threads.  The lock-free paths only
+       touch it if the counters say somebody is waiting. */
+    mutex_t park_mtx;
+    condition_variable_t readable_again;
+    condition_variable_t writable_again;
+    alignas( ring_cache_line_size ) ::std::atomic< size_t > waiting_readers;
+    alignas( ring_cache_line_size ) ::std::atomic< size_t > waiting_writers;
+
+    static size_t
+    checked_max_size( size_t max_size )
+    {
+        if ( max_size < 1 ) {
+            throw fifo_max_size_must_be_positive();
+        }
+        return max_size;
+    }
+
+    void wake( condition_variable_t & cv,
+               ::std::atomic< size_t > const & waiting,
+               size_t count )
+    {
+        /* Pairs with the fence in park: Either we see the waiter or
+           the waiter sees the new state of the ring. */
+        ::std::atomic_thread_fence( ::std::memory_order_seq_cst );
+        if( waiting.load( ::std::memory_order_relaxed ) != 0 ) {
+            lock_t lock( park_mtx );
+            if( count == 1 ) {
+                cv.notify_one();
+            } else {
+                cv.notify_all();
+            }
+        }
+    }
+
+    template< typename Ready, typename Wait >
+    bool park( ::std::atomic< size_t > & waiting,
+               Ready const & ready,
+               Wait const & wait )
+    /* Returns false on timeout. */
+    {
+        lock_t lock( park_mtx );
+        waiting.fetch_add( 1, ::std::memory_order_relaxed );
+        ::std::atomic_thread_fence( ::std::memory_order_seq_cst );
+        bool in_time = true;
+        while( in_time and (not ready()) and (not closed()) ) {
+            in_time = wait( lock );
+        }
+        waiting.fetch_sub( 1, ::std::memory_order_relaxed );
+        return in_time;
+    }
+
+    bool park_reader()
+    {
+        return park( waiting_readers,
+                     [ this ]() { return ring.readable(); },
+                     [ this ]( lock_t & lock ) { readable_again.wait( lock ); return true; });
+    }
+
+    bool park_writer()
+    {
+        return park( waiting_writers,
+                     [ this ]() { return ring.writable(); },
+                     [ this ]( lock_t & lock ) { writable_again.wait( lock ); return true; });
+    }
+
+    std::optional< T > try_read()
+    {
+        for( int k = 0, n = spin_tries(); k < n; k = k + 1 ) {
+            auto x = ring.try_pop();
+            if( x ) {
+                wake( writable_again, waiting_writers, 1 );
+                return x;
+            }
+            cpu_relax();
+        }
+        return {};
+    }
+
+    template< typename U >
+    bool try_write( U && x )
+    /* x is only consumed on success. */
+    {
+        for( int k = 0, n = spin_tries(); k < n; k = k + 1 ) {
+            if( ring.try_push( std::forward< U >( x ))) {
+                wake( readable_again, waiting_readers, 1 );
+                return true;
+            }
+            cpu_relax();
+        }
+        return false;
+    }
+
+    template< typename U >
+    void write_blockingly_impl( U && x )
+    {
+        if constexpr ( not std::is_nothrow_constructible_v< T, U&& > ) {
+            /* The ring cannot recover from a throwing construction. */
+            T copy( std::forward< U >( x ));
+            write_blockingly_impl( std::move( copy ));
+        } else {
+            for( ;; ) {
+                if ( closed() ) {
+                    throw fifo_is_closed();
+                }
+                if( try_write( std::forward< U >( x ))) {
+                    return;
+                }
+                park_writer();
+            }
+        }
+    }
+
+    template< typename U >
+    void write_overwrite_impl( U && x )
+    {
+        if constexpr ( not std::is_nothrow_constructible_v< T, U&& > ) {
+            T copy( std::forward< U >( x ));
+            write_overwrite_impl( std::move( copy ));
+        } else {
+            for( ;; ) {
+                if ( closed() ) {
+                    throw fifo_is_closed();
+                }
+                if( ring.try_push( std::forward< U >( x ))
+                    or ring.try_replace_newest( std::forward< U >( x ))) {
+                    wake( readable_again, waiting_readers, 1 );
+                    return;
+                }
+            }
+        }
+    }
+
+public:
+    using value_type = T;
+    using ring_type  = ring_t;
+
+    ring_fifo_t( size_t max_size )
+        : ring( checked_max_size( max_size )),
+          marked_as_closed( false ),
+          waiting_readers( 0 ),
+          waiting_writers( 0 )
+    {
+    }
+
+    ring_fifo_t( ring_fifo_t const & ) = delete;
+    ring_fifo_t & operator = ( ring_fifo_t const & ) = delete;
+
+    void close( )
+    {
+        marked_as_closed.store( true );
+        lock_t lock( park_mtx );
+        readable_again.notify_all();
+        writable_again.notify_all();
+    }
+
+    /** Drops the newest element if full, only for the MPMC ring. */
+    void write_overwrite( value_type const& x )
+        requires ring_t::multi_consumer
+    {
+        write_overwrite_impl( x );
+    }
+
+    void write_overwrite( value_type && x )
+        requires ring_t::multi_consumer
+    {
+        write_overwrite_impl( std::move( x ));
+    }
+
+    void write_blockingly( value_type const& x )
+    {
+        write_blockingly_impl( x );
+    }
+
+    void write_blockingly( value_type && x )
+    {
+        write_blockingly_impl( std::move( x ));
+    }
+
+    template< typename Iterator >
+    void write_batch( Iterator begin, Iterator end )
+    /* Same semantics as for the locked fifo, but every chunk that
+       fits into the ring is published at once. */
+    {
+        using reference = std::iter_reference_t< Iterator >;
+        if constexpr ( std::forward_iterator< Iterator >
+                       and std::is_nothrow_constructible_v< T, reference > ) {
+            while( begin != end ) {
+                if ( closed() ) {
+                    throw fifo_is_closed();
+                }
+                auto next = ring.try_push_batch( begin, end );
+                if( next != begin ) {
+                    wake( readable_again, waiting_readers, std::distance( begin, next ));
+                    begin = next;
+                } else {
+                    park_writer();
+                }
+            }
+        } else {
+            for( ; begin != end; ++begin ) {
+                write_blockingly( T( *begin ));
+            }
+        }
+    }
+
+    std::tuple< size_t, size_t, bool >
+    queue_state()
+    /* See object_fifo< T, fifo_backend_locked >::queue_state(), but
+       this never locks. */
+    {
+        return { ring.head_position(),
+                 ring.size(),
+                 closed() };
+    }
+
+    value_type read_blockingly( )
+    {
+        for( ;; ) {
+            if( auto x = try_read() ) {
+                return std::move( *x );
+            }
+            if ( closed() ) {
+                if( auto x = ring.try_pop() ) {
+                    return std::move( *x );
+                }
+                throw fifo_is_closed();
+            }
+            park_reader();
+        }
+    }
+
+    template< typename OutputIterator >
+    size_t read_batch( OutputIterator out, size_t max_count )
+    {
+        if( max_count == 0 ) {
+            return 0;
+        }
+
+        for( ;; ) {
+            auto count = ring.try_pop_batch( out, max_count );
+            if( count ) {
+                wake( writable_again, waiting_writers, count );
+                return count;
+            }
+            if ( closed() ) {
+                count = ring.try_pop_batch( out, max_count );
+                if( count ) {
+                    return count;
+                }
+                throw fifo_is_closed();
+            }
+            park_reader();
+        }
+    }
+
+    template< typename Clock, typename Duration >
+    std::optional< value_type >
+    read_timeout( std::chrono::time_point< Clock, Duration > const &time_max )
+    {
+        for( ;; ) {
+            if( auto x = try_read() ) {
+                return x;
+            }
+            if ( closed() ) {
+                if( auto x = ring.try_pop() ) {
+                    return x;
+                }
+                throw fifo_is_closed();
+            }
+            bool in_time =
+                park( waiting_readers,
+                      [ this ]() { return ring.readable(); },
+                      [ this, &time_max ]( lock_t & lock ) {
+                          return readable_again.wait_until( lock, time_max ) != ::std::cv_status::timeout;
+                      });
+            if( not in_time ) {
+                if( auto x = ring.try_pop() ) {
+                    return x;
+                }
+                if( closed() ) {
+                    throw fifo_is_closed();
+                }
+                return {};
+            }
+        }
+    }
+
+    template< typename Rep, typename Rat >
+    std::optional< value_type >
+    read_timeout( ::std::chrono::duration< Rep, Rat > const & timeout )
+    {
+        return read_timeout( ::std::chrono::steady_clock::now() + timeout);
+    }
+
+    std::optional< value_type >
+    read_timeout( double len )
+    {
+        return read_timeout(::std::chrono::duration< double, std::ratio< 1 > >( len ));
+    }
+
+    size_t size()
+    {
+        return ring.size();
+    }
+
+    bool closed()
+    {
+        return marked_as_closed.load();
+    }
+
+    bool empty()
+    {
+        return ring.size() == 0;
+    }
+
+    bool full()
+    {
+        return ring.size() >= ring.capacity();
+    }
+};
+}
+
+template< typename T, typename backend >
+struct object_fifo
+    : public impl::ring_fifo_t< T, typename backend::template ring_type< T > >
+/* Any backend providing a ring_type, see fifo_backend_mpmc_ring. */
+{
+    using impl::ring_fifo_t< T, typename backend::template ring_type< T > >::ring_fifo_t;
+};
+
+template< typename T, typename backend = fifo_backend_locked >
 struct fifo_guard
 {
-    using fifo_type = object_fifo< T >;
+    using fifo_type = object_fifo< T, backend >;
     using fifo_ptr  = ::std::shared_ptr< fifo_type >;
 
     fifo_ptr fifo;
@@ -294,12 +765,12 @@ struct fifo_guard
     }
 };
 
-template< typename T > struct fifo_guard_writing;
+template< typename T, typename backend = fifo_backend_locked > struct fifo_guard_writing;
 
-template< typename T >
+template< typename T, typename backend = fifo_backend_locked >
 struct fifo_guard_reading {
-    using guard_type = fifo_guard_reading< T >;
-    using fifo_type = object_fifo< T >;
+    using guard_type = fifo_guard_reading< T, backend >;
+    using fifo_type = object_fifo< T, backend >;
     using value_type = typename fifo_type::value_type;
     using ptr_type = ::std::shared_ptr< fifo_type >;
 
@@ -335,16 +806,16 @@ struct fifo_guard_reading {
         return not not fifo;
     }
 
-    fifo_guard< T >
+    fifo_guard< T, backend >
     make_guard()
     {
-        return fifo_guard< T >( fifo );
+        return fifo_guard< T, backend >( fifo );
     }
 
-    fifo_guard_writing< T >
+    fifo_guard_writing< T, backend >
     make_guard_writing()
     {
-        return fifo_guard_writing< T >( fifo );
+        return fifo_guard_writing< T, backend >( fifo );
     }
 
     void close( )
@@ -359,6 +830,12 @@ struct fifo_guard_reading {
         return fifo->read_blockingly();
     }
 
+    template< typename OutputIterator >
+    size_t read_batch( OutputIterator out, size_t max_count )
+    {
+        return fifo->read_batch( out, max_count );
+    }
+
     std::optional< value_type >
     read_timeout( double span )
     {
@@ -382,9 +859,9 @@ struct fifo_guard_reading {
     }
 };
 
-template< typename T >
+template< typename T, typename backend >
 struct fifo_guard_writing {
-    using fifo_type = object_fifo< T >;
+    using fifo_type = object_fifo< T, backend >;
     using value_type = typename fifo_type::value_type;
     using ptr_type = ::std::shared_ptr< fifo_type >;
 
@@ -421,16 +898,16 @@ struct fifo_guard_writing {
         }
     }
 
-    fifo_guard< T >
+    fifo_guard< T, backend >
     make_guard()
     {
-        return fifo_guard< T >( fifo );
+        return fifo_guard< T, backend >( fifo );
     }
 
-    fifo_guard_reading< T >
+    fifo_guard_reading< T, backend >
     make_guard_reading()
     {
-        return fifo_guard_reading< T >( fifo );
+        return fifo_guard_reading< T, backend >( fifo );
     }
 
     void write_overwrite( value_type const& x )
@@ -438,11 +915,27 @@ struct fifo_guard_writing {
         fifo->write_overwrite( x );
     }
 
+    void write_overwrite( value_type && x )
+    {
+        fifo->write_overwrite( std::move( x ));
+    }
+
     void write_blockingly( value_type const& x )
     {
         fifo->write_blockingly( x );
     }
 
+    void write_blockingly( value_type && x )
+    {
+        fifo->write_blockingly( std::move( x ));
+    }
+
+    template< typename Iterator >
+    void write_batch( Iterator begin, Iterator end )
+    {
+        fifo->write_batch( begin, end );
+    }
+
     operator bool () const {
         return not not fifo;
     }
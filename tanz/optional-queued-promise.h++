@@ -4,10 +4,18 @@
 #ifndef FILE_199994D0FCFC6EF2_156EC7C79B5A347B_INCLUDED
 #define FILE_199994D0FCFC6EF2_156EC7C79B5A347B_INCLUDED
 
+#include <coroutine>
+#include <functional>
 #include <future>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <stop_token>
+#include <type_traits>
 #include <variant>
+#include <vector>
 #include <stdexcept>
+#include <tanz/executor.h++>
 
 #if SHOW_OQP_LOG
 #   include <iostream>
@@ -19,8 +27,51 @@
 
 namespace tz {
 
+namespace impl {
+struct threaded_completion_t
+/* Coroutines waiting for one computation of an optional_threaded_t. */
+{
+    std::mutex mtx;
+    bool done = false;
+    std::vector< std::coroutine_handle<> > waiters;
+
+    bool
+    add_waiter( std::coroutine_handle<> h )
+    /* False if already done, then h is not resumed. */
+    {
+        std::lock_guard< std::mutex > lock( mtx );
+        if( done ) {
+            return false;
+        }
+        waiters.push_back( h );
+        return true;
+    }
+
+    void
+    complete()
+    {
+        std::vector< std::coroutine_handle<> > resumed;
+        {
+            std::lock_guard< std::mutex > lock( mtx );
+            done = true;
+            resumed.swap( waiters );
+        }
+        for( auto h : resumed ) {
+            h.resume();
+        }
+    }
+};
+}
+
 template< typename T >
-struct optional_threaded_t {
+struct optional_threaded_t
+/* A value computed in the background.  The functions run on an
+   executor, default_executor() unless another one is given.  They
+   may take a std::stop_token, which is stop-requested once the
+   computation is cancelled or superseded by a newer one.  Its result
+   is thrown away in any case, checking the token only saves the
+   work. */
+{
     enum state_t {
         UNSET,
         PENDING,
@@ -29,9 +80,83 @@ struct optional_threaded_t {
 
     struct cancellation_task_t {};
 
+    using function_type = std::function< std::optional< T >( std::stop_token ) >;
+
     std::optional< T > value;
-    std::optional< std::future< std::optional< T > > > pending;
-    std::optional< std::variant< cancellation_task_t, std::function< std::optional< T >() >>> queued;
+    std::optional< std::shared_future< std::optional< T > > > pending;
+    std::optional< std::variant< cancellation_task_t, function_type >> queued;
+
+    executor_t * executor = nullptr;
+    executor_priority_t priority = EXECUTOR_PRIORITY_NORMAL;
+
+    std::optional< std::stop_source > stop;
+    std::shared_ptr< impl::threaded_completion_t > completion;
+
+    optional_threaded_t() = default;
+
+    explicit optional_threaded_t( executor_t & executor_,
+                                  executor_priority_t priority_ = EXECUTOR_PRIORITY_NORMAL )
+        : executor( &executor_ ),
+          priority( priority_ )
+    {}
+
+    optional_threaded_t( optional_threaded_t && ) = default;
+
+    optional_threaded_t &
+    operator = ( optional_threaded_t && other )
+    /* Cancels the pending computation of *this, like the destructor,
+       before taking over the one of other. */
+    {
+        if( this != &other ) {
+            cancel_pending();
+            value = std::move( other.value );
+            pending = std::move( other.pending );
+            queued = std::move( other.queued );
+            executor = other.executor;
+            priority = other.priority;
+            stop = std::move( other.stop );
+            completion = std::move( other.completion );
+            other.pending = {};
+            other.queued = {};
+            other.stop = {};
+            other.completion = {};
+        }
+        return *this;
+    }
+
+    ~optional_threaded_t()
+    /* Does not wait for a pending computation, unlike the futures of
+       std::async. */
+    {
+        cancel_pending();
+    }
+
+    void
+    cancel_pending()
+    {
+        if( stop ) {
+            stop->request_stop();
+        }
+    }
+
+    template< typename F >
+    static function_type
+    make_function( F f )
+    {
+        if constexpr( std::is_invocable_v< F &, std::stop_token > ) {
+            return [ f = std::move( f ) ]( std::stop_token token ) mutable
+                -> std::optional< T >
+            {
+                return f( token );
+            };
+        } else {
+            return [ f = std::move( f ) ]( std::stop_token ) mutable
+                -> std::optional< T >
+            {
+                return f();
+            };
+        }
+    }
 
     int
     update()
@@ -49,19 +174,7 @@ struct optional_threaded_t {
             if( not pending ) {
                 if( queued->index() == 1) {
                     LOG_OQP( "SCHEDULED" );
-                    auto fn = std::move( std::get<1>(*queued) );
-                    pending = std::move(
-                        ::std::async(
-                            ::std::launch::async,
-                            [fn]()
-                            -> std::optional< T >
-                            {
-                                try {
-                                    return fn();
-                                } catch ( ... ) {
-                                    return {};
-                                }
-                            }));
+                    schedule( std::move( std::get<1>(*queued) ));
                     queued = {};
                 } else {
                     queued = {};
@@ -73,13 +186,17 @@ struct optional_threaded_t {
             if( (*pending).wait_for( std::chrono::milliseconds(0)) == std::future_status::ready) {
                 if( not queued ) {
                     LOG_OQP( "PENDING -> SET" );
-                    value = std::move( (*pending).get() );
+                    value = (*pending).get();
                     pending = {};
+                    stop = {};
+                    completion = {};
                     return 1;
                 } else if( queued ) {
                     LOG_OQP( "READY, BUT CANCELLED" );
                     /* Ignore this result */
                     pending = {};
+                    stop = {};
+                    completion = {};
                     return update();
                 }
             }
@@ -87,6 +204,84 @@ struct optional_threaded_t {
         return 0;
     }
 
+    void
+    schedule( function_type fn )
+    {
+        auto result = std::make_shared< std::promise< std::optional< T > > >();
+        auto done = std::make_shared< impl::threaded_completion_t >();
+        std::stop_source source;
+        pending = result->get_future().share();
+        stop = source;
+        completion = done;
+        (executor ? *executor : default_executor()).submit(
+            [ fn = std::move( fn ), result, done, token = source.get_token() ]()
+            {
+                std::optional< T > r;
+                if( not token.stop_requested() ) {
+                    try {
+                        r = fn( token );
+                    } catch ( ... ) {
+                    }
+                }
+                if( token.stop_requested() ) {
+                    r = {};
+                }
+                result->set_value( std::move( r ));
+                done->complete();
+            },
+            priority );
+    }
+
+    struct awaiter_t
+    /* Gives the value once it is SET.  If the computation gets
+       cancelled or superseded while waiting, the result is empty.
+
+       The coroutine is resumed on the thread that finished the
+       computation, so it must not use the optional_threaded_t
+       afterwards unless that is safe. */
+    {
+        optional_threaded_t & x;
+        std::shared_future< std::optional< T > > future;
+        std::shared_ptr< impl::threaded_completion_t > completion;
+
+        bool
+        await_ready()
+        {
+            x.update();
+            if( x.state() != PENDING ) {
+                return true;
+            }
+            if( not x.pending ) {
+                /* The superseded computation is still running. */
+                return true;
+            }
+            future = *x.pending;
+            completion = x.completion;
+            return false;
+        }
+
+        bool
+        await_suspend( std::coroutine_handle<> h )
+        {
+            return completion->add_waiter( h );
+        }
+
+        std::optional< T >
+        await_resume()
+        {
+            if( future.valid() ) {
+                return future.get();
+            }
+            return x.value;
+        }
+    };
+
+    awaiter_t
+    operator co_await()
+    {
+        return awaiter_t{ *this, {}, {} };
+    }
+
     state_t
     state() const
     {
@@ -139,6 +334,7 @@ struct optional_threaded_t {
                 }
                 LOG_OQP( "MARK CANCELLATION" );
                 queued = cancellation_task_t{};
+                cancel_pending();
             }
             else if( value ) {
                 LOG_OQP( "RESET OLD VALUE" );
@@ -155,19 +351,7 @@ struct optional_threaded_t {
     operator = ( F const & f )
     /* As always: After setting a 'global' update needs to be done */
     {
-        if( value ) {
-            throw std::logic_error( "A new value can only be scheduled in the UNSET state." );
-        }
-        if( queued ) {
-            if( queued.index() == 1 ) {
-                LOG_OQP( "QUEUED OVERWRITING" );
-            }
-        } else {
-            LOG_OQP( "QUEUED" );
-        }
-        queued = f;
-        update();
-        return *this;
+        return (*this) = F( f );
     }
 
     template <typename F>
@@ -185,7 +369,8 @@ struct optional_threaded_t {
         } else {
             LOG_OQP( "QUEUED" );
         }
-        queued = std::move( f );
+        queued = make_function( std::forward< F >( f ));
+        cancel_pending();
         update();
         return *this;
     }
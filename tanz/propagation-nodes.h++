@@ -2,56 +2,104 @@
 #pragma once
 #ifndef FILE_609816DD_12F6839E956CDCE1_INCLUDED
 #define FILE_609816DD_12F6839E956CDCE1_INCLUDED
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
 #include <optional>
 #include <memory>
+#include <mutex>
 #include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <stdexcept>
-#include <unordered_map>
 #include <functional>
 
-#include <tanz/propagation-nodes.h++>
+#include <tanz/executor.h++>
 
 namespace tz {
 
+/* Data nodes hold a tuple of optional values and propagate changes
+   to their successors through callbacks.  By default a change
+   propagates right away, depth first.
+
+   Changes made during a transaction of a propagation_scheduler_t
+   are propagated when it commits: every node reachable from the
+   changed ones is evaluated at most once, in topological order, and
+   without the intermediate clearing of successors.  Nodes of the
+   same topological level, that do not feed into the same node, run
+   in parallel, on the calling thread and tasks of the executor of
+   the scheduler.
+
+       tz::propagation_scheduler_t scheduler( 4 );
+       {
+           auto tx = scheduler.transaction();
+           a->set_slot_direct< 0 >( 1 );
+           b->set_slot_direct< 1 >( 2 );
+           tx.commit();
+       }
+*/
+
+struct propagation_scheduler_t;
+
+namespace impl {
+inline constinit thread_local propagation_scheduler_t * active_propagation_scheduler = nullptr;
+}
+
+struct propagation_node_base_t
+/* What the scheduler needs to know about a node.  The bookkeeping
+   members belong to the scheduler. */
+{
+    propagation_node_base_t() = default;
+    propagation_node_base_t( propagation_node_base_t const & ) = delete;
+    propagation_node_base_t & operator = ( propagation_node_base_t const & ) = delete;
+
+    virtual ~propagation_node_base_t();
+
+    virtual void
+    propagate() = 0;
+    /* Calls the successors with the current data. */
+
+    virtual void
+    collect_successors( std::vector< propagation_node_base_t * > & out ) const = 0;
+
+    virtual bool
+    only_node_successors() const = 0;
+    /* False if a callback goes somewhere else than to a node, which
+       keeps the scheduler from running it in parallel. */
+
+    uint64_t visit_round = 0;
+    uint64_t done_round = 0;
+    uint64_t writers_round = 0;
+    size_t indegree = 0;
+    size_t writers = 0;
+    std::atomic< bool > changed{ false };
+    propagation_scheduler_t * queued_in = nullptr;
+};
+
 template< typename... argument_types >
 struct connection_table_t
 {
-    struct ptr_hasher_t {
-        size_t
-        operator() (std::weak_ptr< void > const & p )
-            const
-        {
-            auto sp = p.lock();
-            auto h = ::std::hash< size_t >()( (size_t)(sp.get()) );
-            return h;
-        }
-    };
+    using propagation_function = std::function< void( argument_types const & ...) >;
 
-    struct ptr_equal_t {
-        bool
-        operator() ( std::weak_ptr< void > const & a, std::weak_ptr< void > const & b )
-            const
-        {
-            auto sa = a.lock();
-            auto sb = b.lock();
-            return sa == sb;
-        }
+    struct entry_t {
+        std::weak_ptr< void > receiver;
+        void const * address;
+        propagation_node_base_t * node; /* nullptr if the receiver is no node */
+        propagation_function callback;
     };
 
-    using propagation_function = std::function< void( argument_types const & ...) >;
-    using key_type = std::weak_ptr< void >;
-    using map_type =
-        std::unordered_map< key_type, propagation_function, ptr_hasher_t, ptr_equal_t >;
-
-    map_type object_to_callback;
+    /* Entries are not moved, so a callback may add connections
+       while it runs. */
+    std::vector< std::unique_ptr< entry_t > > callbacks;
 
     void
     cleanup()
     {
-        std::erase_if( object_to_callback,
-                       []( auto x ) {
-                           return x.first.expired();
+        std::erase_if( callbacks,
+                       []( auto const & e ) {
+                           return e->receiver.expired();
                        });
     }
 
@@ -59,38 +107,411 @@ struct connection_table_t
     void
     add_callback( std::shared_ptr< T >  callee, propagation_function const & callback )
     {
-        key_type key( std::reinterpret_pointer_cast< void >( callee ));
-
-        if( object_to_callback.find( key ) != object_to_callback.end()) {
-            throw std::logic_error( "Object is connected already." );
+        void const * address = callee.get();
+        for( auto const & e : callbacks ) {
+            if( (e->address == address) and not e->receiver.expired() ) {
+                throw std::logic_error( "Object is connected already." );
+            }
         }
+        cleanup();
 
-        object_to_callback[ key ] = callback;
-        cleanup(); // TODO: How to do this systematically?
+        propagation_node_base_t * node = nullptr;
+        if constexpr( std::is_base_of_v< propagation_node_base_t, T > ) {
+            node = callee.get();
+        }
+        callbacks.push_back(
+            std::make_unique< entry_t >(
+                entry_t{ std::reinterpret_pointer_cast< void >( callee ), address, node, callback } ));
     }
 
     template< typename T >
     void
     remove_callback( std::shared_ptr< T > callee )
     {
-        object_to_callback.erase( callee );
+        void const * address = callee.get();
+        std::erase_if( callbacks,
+                       [ address ]( auto const & e ) {
+                           return e->address == address;
+                       });
     }
 
     void
     operator() ( argument_types const & ... arg )
     {
-        for( auto k : object_to_callback ) {
-            auto p = k.first.lock();
-            if( p ) {
-                k.second( arg... );
+        bool expired = false;
+        for( size_t k = 0; k < callbacks.size(); k = k + 1 ) {
+            auto & e = *callbacks[ k ];
+            if( e.receiver.expired() ) {
+                expired = true;
+            } else {
+                e.callback( arg... );
+            }
+        }
+        if( expired ) {
+            cleanup();
+        }
+    }
+
+    void
+    collect_successors( std::vector< propagation_node_base_t * > & out ) const
+    {
+        for( auto const & e : callbacks ) {
+            if( e->node and not e->receiver.expired() ) {
+                out.push_back( e->node );
+            }
+        }
+    }
+
+    bool
+    only_node_successors() const
+    {
+        for( auto const & e : callbacks ) {
+            if( (not e->node) and not e->receiver.expired() ) {
+                return false;
             }
         }
-        cleanup(); // TODO: How to do this systematically?
+        return true;
     }
 };
 
+struct propagation_scheduler_t
+{
+    explicit propagation_scheduler_t( size_t threads_ = 1,
+                                      executor_t & executor_ = default_executor() )
+    /* threads includes the one committing, the others are tasks of
+       executor. */
+        : threads( std::max< size_t >( threads_, 1 )),
+          executor( &executor_ )
+    {}
+
+    propagation_scheduler_t( propagation_scheduler_t const & ) = delete;
+    propagation_scheduler_t & operator = ( propagation_scheduler_t const & ) = delete;
+
+    ~propagation_scheduler_t()
+    {
+        std::lock_guard< std::mutex > lock( pending_mtx );
+        for( auto n : pending ) {
+            n->queued_in = nullptr;
+        }
+    }
+
+    struct transaction_t
+    {
+        explicit transaction_t( propagation_scheduler_t & scheduler_ )
+            : scheduler( &scheduler_ ),
+              outermost( impl::active_propagation_scheduler == nullptr )
+        {
+            if( (not outermost) and (impl::active_propagation_scheduler != scheduler) ) {
+                throw std::logic_error( "Another propagation scheduler is active." );
+            }
+            impl::active_propagation_scheduler = scheduler;
+        }
+
+        transaction_t( transaction_t const & ) = delete;
+        transaction_t & operator = ( transaction_t const & ) = delete;
+
+        ~transaction_t()
+        /* Commits, but swallows exceptions, call commit() to see
+           them. */
+        {
+            try {
+                commit();
+            } catch( ... ) {
+            }
+        }
+
+        void
+        commit()
+        /* Nested transactions commit with the outermost one. */
+        {
+            if( not scheduler ) {
+                return;
+            }
+            auto s = scheduler;
+            scheduler = nullptr;
+            if( outermost ) {
+                impl::active_propagation_scheduler = nullptr;
+                s->run();
+            }
+        }
+
+    private:
+        propagation_scheduler_t * scheduler;
+        bool outermost;
+    };
+
+    transaction_t
+    transaction()
+    {
+        return transaction_t( *this );
+    }
+
+    template< typename F >
+    void
+    batch( F const & fn )
+    {
+        auto tx = transaction();
+        fn();
+        tx.commit();
+    }
+
+    void
+    mark_changed( propagation_node_base_t * node )
+    /* Called by nodes when their data changed, from any thread. */
+    {
+        if( running and (node->visit_round == round) and (node->done_round != round) ) {
+            node->changed.store( true, std::memory_order_relaxed );
+            return;
+        }
+        std::lock_guard< std::mutex > lock( pending_mtx );
+        if( not node->queued_in ) {
+            node->queued_in = this;
+            pending.push_back( node );
+        }
+    }
+
+    void
+    forget( propagation_node_base_t * node )
+    {
+        std::lock_guard< std::mutex > lock( pending_mtx );
+        std::erase( pending, node );
+        node->queued_in = nullptr;
+    }
+
+    void
+    run();
+    /* Evaluates everything changed so far, usually called by
+       commit(). */
+
+    uint64_t
+    evaluations() const
+    /* Number of node evaluations so far. */
+    {
+        return evaluation_count.load();
+    }
+
+private:
+    std::vector< propagation_node_base_t * >
+    take_pending()
+    {
+        std::lock_guard< std::mutex > lock( pending_mtx );
+        for( auto n : pending ) {
+            n->queued_in = nullptr;
+        }
+        return std::exchange( pending, {} );
+    }
+
+    void
+    evaluate( propagation_node_base_t * node )
+    {
+        node->changed.store( false, std::memory_order_relaxed );
+        evaluation_count.fetch_add( 1, std::memory_order_relaxed );
+        node->propagate();
+    }
+
+    void
+    run_round( std::vector< propagation_node_base_t * > const & roots );
+
+    void
+    run_layer( std::vector< propagation_node_base_t * > const & layer );
+
+    size_t threads;
+    executor_t * executor;
+    std::mutex pending_mtx;
+    std::vector< propagation_node_base_t * > pending;
+    uint64_t round = 0;
+    bool running = false;
+    std::atomic< uint64_t > evaluation_count{ 0 };
+    std::vector< propagation_node_base_t * > successors;
+};
+
+inline
+propagation_node_base_t::~propagation_node_base_t()
+{
+    if( queued_in ) {
+        queued_in->forget( this );
+    }
+}
+
+inline
+void
+propagation_scheduler_t::run()
+{
+    /* Callbacks outside the known edges may change nodes that have
+       been evaluated already, that starts another round. */
+    constexpr size_t max_rounds = 1000;
+    for( size_t k = 0; k < max_rounds; k = k + 1 ) {
+        auto roots = take_pending();
+        if( roots.empty() ) {
+            return;
+        }
+        run_round( roots );
+    }
+    throw std::logic_error( "Propagation does not settle." );
+}
+
+inline
+void
+propagation_scheduler_t::run_round( std::vector< propagation_node_base_t * > const & roots )
+{
+    round = round + 1;
+
+    /* Everything reachable, with in-degrees from inside. */
+    std::vector< propagation_node_base_t * > nodes;
+    std::vector< propagation_node_base_t * > stack;
+    for( auto n : roots ) {
+        if( n->visit_round != round ) {
+            n->visit_round = round;
+            n->indegree = 0;
+            stack.push_back( n );
+        }
+    }
+    while( not stack.empty() ) {
+        auto n = stack.back();
+        stack.pop_back();
+        nodes.push_back( n );
+        successors.clear();
+        n->collect_successors( successors );
+        for( auto m : successors ) {
+            if( m->visit_round != round ) {
+                m->visit_round = round;
+                m->indegree = 0;
+                m->changed.store( false, std::memory_order_relaxed );
+                stack.push_back( m );
+            }
+            m->indegree = m->indegree + 1;
+        }
+    }
+    for( auto n : roots ) {
+        n->changed.store( true, std::memory_order_relaxed );
+    }
+
+    /* Kahn, level by level. */
+    std::vector< propagation_node_base_t * > layer;
+    for( auto n : nodes ) {
+        if( n->indegree == 0 ) {
+            layer.push_back( n );
+        }
+    }
+    size_t seen = 0;
+    std::vector< propagation_node_base_t * > next;
+    std::exception_ptr error;
+    while( not layer.empty() ) {
+        seen = seen + layer.size();
+        for( auto n : layer ) {
+            n->done_round = round;
+        }
+        if( not error ) {
+            running = true;
+            try {
+                run_layer( layer );
+            } catch( ... ) {
+                error = std::current_exception();
+            }
+            running = false;
+        }
+        next.clear();
+        for( auto n : layer ) {
+            successors.clear();
+            n->collect_successors( successors );
+            for( auto m : successors ) {
+                if( (m->visit_round == round) and (m->indegree > 0) ) {
+                    m->indegree = m->indegree - 1;
+                    if( m->indegree == 0 ) {
+                        next.push_back( m );
+                    }
+                }
+            }
+        }
+        std::swap( layer, next );
+    }
+    if( error ) {
+        take_pending();
+        std::rethrow_exception( error );
+    }
+    if( seen != nodes.size() ) {
+        throw std::logic_error( "Cycle in the propagation graph." );
+    }
+}
+
+inline
+void
+propagation_scheduler_t::run_layer( std::vector< propagation_node_base_t * > const & layer )
+{
+    std::vector< propagation_node_base_t * > parallel;
+    std::vector< propagation_node_base_t * > sequential;
+    for( auto n : layer ) {
+        if( n->changed.load( std::memory_order_relaxed )) {
+            sequential.push_back( n );
+        }
+    }
+    if( (threads > 1) and (sequential.size() > 1) ) {
+        /* Nodes writing to the same node, or to something else than
+           nodes, stay sequential. */
+        for( auto n : sequential ) {
+            successors.clear();
+            n->collect_successors( successors );
+            for( auto m : successors ) {
+                if( m->writers_round != round ) {
+                    m->writers_round = round;
+                    m->writers = 0;
+                }
+                m->writers = m->writers + 1;
+            }
+        }
+        std::erase_if(
+            sequential,
+            [ & ]( propagation_node_base_t * n )
+            {
+                if( not n->only_node_successors() ) {
+                    return false;
+                }
+                successors.clear();
+                n->collect_successors( successors );
+                for( auto m : successors ) {
+                    if( m->writers > 1 ) {
+                        return false;
+                    }
+                }
+                parallel.push_back( n );
+                return true;
+            } );
+    }
+
+    if( parallel.size() > 1 ) {
+        parallel_for(
+            parallel.size(), threads,
+            [ & ]( size_t k )
+            {
+                auto previous = std::exchange( impl::active_propagation_scheduler, this );
+                try {
+                    evaluate( parallel[ k ] );
+                } catch( ... ) {
+                    impl::active_propagation_scheduler = previous;
+                    throw;
+                }
+                impl::active_propagation_scheduler = previous;
+            },
+            *executor );
+    } else {
+        sequential.insert( sequential.end(), parallel.begin(), parallel.end() );
+    }
+
+    auto previous = std::exchange( impl::active_propagation_scheduler, this );
+    try {
+        for( auto n : sequential ) {
+            evaluate( n );
+        }
+    } catch( ... ) {
+        impl::active_propagation_scheduler = previous;
+        throw;
+    }
+    impl::active_propagation_scheduler = previous;
+}
+
 template< typename... T_args >
 struct data_node_t
+    : public propagation_node_base_t
 {
     using data_type = std::tuple< ::std::optional< T_args >... >;
     using optional_data_type = std::optional< data_type >;
@@ -114,7 +535,25 @@ struct data_node_t
     ~data_node_t()
     {
         all_data = {};
-        notify();
+        connections( data() );
+    }
+
+    void
+    propagate() override
+    {
+        connections( data() );
+    }
+
+    void
+    collect_successors( std::vector< propagation_node_base_t * > & out ) const override
+    {
+        connections.collect_successors( out );
+    }
+
+    bool
+    only_node_successors() const override
+    {
+        return connections.only_node_successors();
     }
 
     data_node_t const & input() const
@@ -218,15 +657,23 @@ struct data_node_t
 
     void
     clear_successors()
+    /* Within a transaction the successors are evaluated in order
+       anyway, there is nothing to clear. */
     {
-        connections( {} );
+        if( not impl::active_propagation_scheduler ) {
+            connections( {} );
+        }
     }
 
     void
     notify( bool success = true )
     {
         if( success ) {
-            notify_impl( std::make_integer_sequence< size_t, sizeof ... (T_args) >());
+            if( auto scheduler = impl::active_propagation_scheduler ) {
+                scheduler->mark_changed( this );
+            } else {
+                notify_impl( std::make_integer_sequence< size_t, sizeof ... (T_args) >());
+            }
         }
     }
 
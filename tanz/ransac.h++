@@ -0,0 +1,179 @@
+#pragma once
+#ifndef FILE_3C8A0D5E71B94F26_A54E12F0C8D7B963_INCLUDED
+#define FILE_3C8A0D5E71B94F26_A54E12F0C8D7B963_INCLUDED
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <tanz/executor.h++>
+
+/* Random sample consensus.  ransac() draws minimal samples, lets a
+   solver fit a hypothesis to each and keeps the one with most
+   inliers.  Hypotheses are evaluated on several threads, and the
+   number of hypotheses shrinks as better ones are found, until the
+   requested confidence is reached.  The estimators built on it are
+   estimate_homography_2d() and estimate_conic_params(). */
+
+namespace tz {
+
+struct ransac_options_t {
+    double threshold = 1.0;
+    /* Largest distance of an inlier, in the units of the
+       observations. */
+    double confidence = 0.999;
+    /* Probability of drawing at least one sample without outliers. */
+    size_t max_hypotheses = 10000;
+    size_t threads = 1;
+    /* 0 means one per hardware thread. */
+    uint64_t seed = 0x243F6A8885A308D3ull;
+    size_t refinements = 2;
+    /* Least squares fits on the inliers after the search. */
+};
+
+template< typename Model >
+struct ransac_hypothesis_t {
+    Model model;
+    size_t inliers = 0;
+    size_t hypotheses = 0;
+    /* Evaluated, including degenerate samples. */
+    bool found = false;
+};
+
+namespace impl {
+
+inline
+uint64_t
+ransac_mix( uint64_t x )
+/* splitmix64 */
+{
+    x = x + 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+template< size_t sample_size >
+void
+ransac_sample( size_t n, uint64_t seed, uint64_t hypothesis, std::array< size_t, sample_size > & sample )
+/* Distinct indices, the same for the same seed and hypothesis
+   whatever thread draws them. */
+{
+    auto state = ransac_mix( seed ^ ransac_mix( hypothesis ));
+    for( size_t k = 0; k < sample_size; k = k + 1 ) {
+        for( ;; ) {
+            state = ransac_mix( state );
+            auto candidate = static_cast< size_t >( state % n );
+            if( std::find( sample.begin(), sample.begin() + k, candidate ) == sample.begin() + k ) {
+                sample[ k ] = candidate;
+                break;
+            }
+        }
+    }
+}
+
+inline
+size_t
+ransac_required_hypotheses( size_t inliers, size_t n, size_t sample_size,
+                            double confidence, size_t max_hypotheses )
+{
+    auto clean = std::pow( double( inliers ) / double( n ), double( sample_size ));
+    if( clean >= 1.0 ) {
+        return 1;
+    }
+    if( clean <= 0.0 ) {
+        return max_hypotheses;
+    }
+    auto required = std::ceil( std::log1p( -confidence ) / std::log1p( -clean ));
+    return static_cast< size_t >( std::clamp( required, 1.0, double( max_hypotheses )));
+}
+}
+
+template< size_t sample_size, typename Model, typename Solve, typename Count >
+ransac_hypothesis_t< Model >
+ransac( size_t n, ransac_options_t const & options, Solve const & solve, Count const & count )
+/* solve( sample, model ) fits model to the observations with the
+   indices in sample and returns false for degenerate samples.
+   count( model, needed ) returns the number of inliers of model, or
+   any number below needed as soon as it cannot reach needed.
+
+   With one thread the result only depends on the seed.  Further
+   threads are tasks of default_executor(), an exception of solve or
+   count stops the search and is rethrown. */
+{
+    ransac_hypothesis_t< Model > best;
+    if( n < sample_size ) {
+        return best;
+    }
+
+    std::mutex mtx;
+    std::atomic< size_t > next( 0 );
+    std::atomic< size_t > evaluated( 0 );
+    std::atomic< size_t > limit( options.max_hypotheses );
+    std::atomic< size_t > best_count( 0 );
+
+    constexpr size_t chunk = 4;
+    auto work =
+        [ & ]()
+        {
+            std::array< size_t, sample_size > sample;
+            Model model;
+            size_t done = 0;
+            try {
+                for( ;; ) {
+                    auto first = next.fetch_add( chunk );
+                    if( first >= limit.load() ) {
+                        break;
+                    }
+                    for( auto h = first; (h < first + chunk) and (h < limit.load()); h = h + 1 ) {
+                        done = done + 1;
+                        impl::ransac_sample( n, options.seed, h, sample );
+                        if( not solve( sample, model )) {
+                            continue;
+                        }
+                        auto needed = best_count.load() + 1;
+                        auto inliers = count( model, needed );
+                        if( inliers < needed ) {
+                            continue;
+                        }
+                        std::lock_guard< std::mutex > lock( mtx );
+                        if( inliers > best.inliers ) {
+                            best.model = model;
+                            best.inliers = inliers;
+                            best.found = true;
+                            best_count.store( inliers );
+                            limit.store(
+                                std::min( limit.load(),
+                                          impl::ransac_required_hypotheses(
+                                              inliers, n, sample_size, options.confidence, options.max_hypotheses )));
+                        }
+                    }
+                }
+            } catch( ... ) {
+                /* Stops the other threads as well. */
+                std::lock_guard< std::mutex > lock( mtx );
+                limit.store( 0 );
+                throw;
+            }
+            evaluated.fetch_add( done );
+        };
+
+    auto threads = options.threads;
+    if( threads == 0 ) {
+        threads = std::max< size_t >( 1, std::thread::hardware_concurrency() );
+    }
+    threads = std::max< size_t >( 1, std::min( threads, options.max_hypotheses / (4 * chunk) ));
+    if( threads == 1 ) {
+        work();
+    } else {
+        parallel_for( threads, threads, [ & ]( size_t ) { work(); } );
+    }
+    best.hypotheses = evaluated.load();
+    return best;
+}
+}
+#endif
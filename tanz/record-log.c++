@@ -0,0 +1,547 @@
+#include <tanz/record-log.h++>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#if __unix__
+#  include <fcntl.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#else
+#  error Record logs not implemented for this platform
+#endif
+
+namespace tz {
+namespace {
+
+[[noreturn]]
+void
+throw_errno()
+{
+    throw std::system_error(
+        std::error_code(
+            errno,
+            std::system_category()));
+}
+
+constexpr char file_magic[ 8 ] = { 'T', 'Z', 'R', 'E', 'C', 'L', 'O', 'G' };
+constexpr char index_magic[ 8 ] = { 'T', 'Z', 'R', 'L', 'I', 'N', 'D', 'X' };
+constexpr uint32_t file_version = 1;
+constexpr uint32_t chunk_magic = 0x4b435a54; /* "TZCK" */
+
+constexpr size_t file_header_size = 16;
+constexpr size_t chunk_header_size = 56;
+constexpr size_t record_header_size = 12;
+constexpr size_t index_entry_size = 48;
+constexpr size_t trailer_size = 32;
+
+/* CRC32C (Castagnoli), eight bytes per step. */
+constexpr auto crc32c_tables =
+    []()
+    {
+        std::array< std::array< uint32_t, 256 >, 8 > t{};
+        for( uint32_t i = 0; i < 256; i = i + 1 ) {
+            uint32_t c = i;
+            for( int k = 0; k < 8; k = k + 1 ) {
+                c = (c >> 1) ^ (0x82f63b78u & (0u - (c & 1u)));
+            }
+            t[ 0 ][ i ] = c;
+        }
+        for( uint32_t i = 0; i < 256; i = i + 1 ) {
+            for( size_t s = 1; s < 8; s = s + 1 ) {
+                t[ s ][ i ] = (t[ s - 1 ][ i ] >> 8) ^ t[ 0 ][ t[ s - 1 ][ i ] & 0xff ];
+            }
+        }
+        return t;
+    }();
+
+template< typename T >
+void
+put( std::byte * & p, T x )
+{
+    std::memcpy( p, &x, sizeof( T ));
+    p = p + sizeof( T );
+}
+
+template< typename T >
+T
+get( std::byte const * & p )
+{
+    T x;
+    std::memcpy( &x, p, sizeof( T ));
+    p = p + sizeof( T );
+    return x;
+}
+
+std::array< std::byte, chunk_header_size >
+encode_chunk_header( record_log_chunk_t const & c, uint32_t payload_crc )
+{
+    std::array< std::byte, chunk_header_size > h;
+    auto p = h.data();
+    put< uint32_t >( p, chunk_magic );
+    put< uint32_t >( p, payload_crc );
+    put< uint64_t >( p, c.first_record );
+    put< uint64_t >( p, c.record_count );
+    put< uint64_t >( p, c.payload_size );
+    put< int64_t >( p, c.first_time.count() );
+    put< int64_t >( p, c.last_time.count() );
+    put< uint32_t >( p, crc32c( { h.data(), 48 } ));
+    put< uint32_t >( p, 0 );
+    return h;
+}
+
+std::array< std::byte, index_entry_size >
+encode_index_entry( record_log_chunk_t const & c )
+{
+    std::array< std::byte, index_entry_size > e;
+    auto p = e.data();
+    put< uint64_t >( p, c.offset );
+    put< uint64_t >( p, c.first_record );
+    put< uint64_t >( p, c.record_count );
+    put< uint64_t >( p, c.payload_size );
+    put< int64_t >( p, c.first_time.count() );
+    put< int64_t >( p, c.last_time.count() );
+    return e;
+}
+
+bool
+read_footer( std::span< std::byte const > file,
+             record_log_limits_t const & limits,
+             std::vector< record_log_chunk_t > & index,
+             uint64_t & chunks_end )
+/* The index written by close(), false if it is missing or does not
+   fit the file. */
+{
+    if( file.size() < file_header_size + trailer_size ) {
+        return false;
+    }
+    auto trailer = file.data() + file.size() - trailer_size;
+    auto p = trailer;
+    if( std::memcmp( p, index_magic, sizeof( index_magic )) != 0 ) {
+        return false;
+    }
+    p = p + sizeof( index_magic );
+    auto index_offset = get< uint64_t >( p );
+    auto entries = get< uint64_t >( p );
+    auto index_crc = get< uint32_t >( p );
+    auto trailer_crc = get< uint32_t >( p );
+    if( trailer_crc != crc32c( { trailer, trailer_size - 4 } )) {
+        return false;
+    }
+    auto index_end = file.size() - trailer_size;
+    if( (index_offset < file_header_size)
+        or (index_offset > index_end)
+        or ((index_end - index_offset) / index_entry_size != entries)
+        or ((index_end - index_offset) % index_entry_size != 0) ) {
+        return false;
+    }
+    if( index_crc != crc32c( file.subspan( index_offset, index_end - index_offset ))) {
+        return false;
+    }
+
+    std::vector< record_log_chunk_t > result;
+    result.reserve( entries );
+    uint64_t offset = file_header_size;
+    uint64_t next_record = 0;
+    p = file.data() + index_offset;
+    for( uint64_t k = 0; k < entries; k = k + 1 ) {
+        record_log_chunk_t c;
+        c.offset = get< uint64_t >( p );
+        c.first_record = get< uint64_t >( p );
+        c.record_count = get< uint64_t >( p );
+        c.payload_size = get< uint64_t >( p );
+        c.first_time = record_log_time_t( get< int64_t >( p ));
+        c.last_time = record_log_time_t( get< int64_t >( p ));
+        if( (c.offset != offset)
+            or (c.first_record != next_record)
+            or (c.payload_size > limits.max_chunk_size)
+            or (index_offset - c.offset < chunk_header_size)
+            or (c.payload_size > index_offset - c.offset - chunk_header_size)
+            or (c.record_count > c.payload_size / record_header_size) ) {
+            return false;
+        }
+        offset = c.offset + chunk_header_size + c.payload_size;
+        next_record = c.first_record + c.record_count;
+        result.push_back( c );
+    }
+    if( offset != index_offset ) {
+        return false;
+    }
+    index = std::move( result );
+    chunks_end = index_offset;
+    return true;
+}
+
+void
+scan_chunks( std::span< std::byte const > file,
+             record_log_limits_t const & limits,
+             std::vector< record_log_chunk_t > & index,
+             uint64_t & chunks_end )
+/* Recovery without index: all chunks with valid checksums up to the
+   first broken one. */
+{
+    index.clear();
+    uint64_t offset = file_header_size;
+    uint64_t next_record = 0;
+    while( file.size() - offset >= chunk_header_size ) {
+        auto header = file.data() + offset;
+        auto p = header;
+        if( get< uint32_t >( p ) != chunk_magic ) {
+            break;
+        }
+        auto payload_crc = get< uint32_t >( p );
+        record_log_chunk_t c;
+        c.offset = offset;
+        c.first_record = get< uint64_t >( p );
+        c.record_count = get< uint64_t >( p );
+        c.payload_size = get< uint64_t >( p );
+        c.first_time = record_log_time_t( get< int64_t >( p ));
+        c.last_time = record_log_time_t( get< int64_t >( p ));
+        if( get< uint32_t >( p ) != crc32c( { header, 48 } )) {
+            break;
+        }
+        if( (c.first_record != next_record)
+            or (c.payload_size > limits.max_chunk_size)
+            or (c.payload_size > file.size() - offset - chunk_header_size)
+            or (payload_crc != crc32c( file.subspan( offset + chunk_header_size, c.payload_size )))) {
+            break;
+        }
+        index.push_back( c );
+        offset = offset + chunk_header_size + c.payload_size;
+        next_record = c.first_record + c.record_count;
+    }
+    chunks_end = offset;
+}
+
+bool
+load_index( std::span< std::byte const > file,
+            record_log_limits_t const & limits,
+            std::vector< record_log_chunk_t > & index,
+            uint64_t & chunks_end )
+/* Returns true if the chunks had to be scanned. */
+{
+    if( (file.size() < file_header_size)
+        or (std::memcmp( file.data(), file_magic, sizeof( file_magic )) != 0) ) {
+        throw record_log_error( "Not a record log." );
+    }
+    auto p = file.data() + sizeof( file_magic );
+    if( get< uint32_t >( p ) != file_version ) {
+        throw record_log_error( "Unsupported record log version." );
+    }
+    if( read_footer( file, limits, index, chunks_end )) {
+        return false;
+    }
+    scan_chunks( file, limits, index, chunks_end );
+    return true;
+}
+}
+
+uint32_t
+crc32c( std::span< std::byte const > bytes, uint32_t crc )
+{
+    auto const & t = crc32c_tables;
+    auto p = bytes.data();
+    auto n = bytes.size();
+    crc = ~crc;
+    if constexpr( std::endian::native == std::endian::little ) {
+        while( n >= 8 ) {
+            uint64_t v;
+            std::memcpy( &v, p, 8 );
+            v = v ^ crc;
+            crc =
+                t[ 7 ][ v & 0xff ] ^ t[ 6 ][ (v >> 8) & 0xff ] ^
+                t[ 5 ][ (v >> 16) & 0xff ] ^ t[ 4 ][ (v >> 24) & 0xff ] ^
+                t[ 3 ][ (v >> 32) & 0xff ] ^ t[ 2 ][ (v >> 40) & 0xff ] ^
+                t[ 1 ][ (v >> 48) & 0xff ] ^ t[ 0 ][ v >> 56 ];
+            p = p + 8;
+            n = n - 8;
+        }
+    }
+    for( ; n; n = n - 1 ) {
+        crc = t[ 0 ][ (crc ^ static_cast< uint32_t >( *p )) & 0xff ] ^ (crc >> 8);
+        p = p + 1;
+    }
+    return ~crc;
+}
+
+record_log_writer_t::record_log_writer_t( std::string const & path,
+                                          record_log_options_t const & options_ )
+    : options( options_ ),
+      payload( options_.chunk_size + record_header_size ),
+      scratch()
+{
+    fd = ::open( path.c_str(), O_RDWR | O_CREAT, 0644 );
+    if( fd < 0 ) {
+        throw_errno();
+    }
+    try {
+        struct stat st;
+        if( ::fstat( fd, &st ) < 0 ) {
+            throw_errno();
+        }
+        if( st.st_size == 0 ) {
+            std::array< std::byte, file_header_size > header{};
+            auto p = header.data();
+            std::memcpy( p, file_magic, sizeof( file_magic ));
+            p = p + sizeof( file_magic );
+            put< uint32_t >( p, file_version );
+            write_all( header );
+        } else {
+            uint64_t chunks_end;
+            {
+                mapped_file_t existing( path );
+                load_index( existing.bytes(), options.limits, chunks, chunks_end );
+            }
+            if( ::ftruncate( fd, chunks_end ) < 0 ) {
+                throw_errno();
+            }
+            if( ::lseek( fd, chunks_end, SEEK_SET ) < 0 ) {
+                throw_errno();
+            }
+            file_size = chunks_end;
+            if( not chunks.empty() ) {
+                record_count = chunks.back().first_record + chunks.back().record_count;
+            }
+        }
+    } catch( ... ) {
+        ::close( fd );
+        throw;
+    }
+}
+
+record_log_writer_t::~record_log_writer_t()
+{
+    try {
+        close();
+    } catch( ... ) {
+    }
+}
+
+void
+record_log_writer_t::write_all( std::span< std::byte const > bytes )
+{
+    auto p = bytes.data();
+    auto n = bytes.size();
+    while( n ) {
+        auto written = ::write( fd, p, n );
+        if( written < 0 ) {
+            if( errno == EINTR ) {
+                continue;
+            }
+            throw_errno();
+        }
+        p = p + written;
+        n = n - written;
+    }
+    file_size = file_size + bytes.size();
+}
+
+uint64_t
+record_log_writer_t::append_bytes( record_log_time_t time, std::span< std::byte const > bytes )
+{
+    if( fd < 0 ) {
+        throw record_log_error( "Record log is closed." );
+    }
+    if( (bytes.size() > options.limits.max_record_size)
+        or (bytes.size() > UINT32_MAX) ) {
+        throw record_log_error( "Record exceeds the size limit." );
+    }
+    if( payload_records == 0 ) {
+        payload_first_time = time;
+    }
+    payload_last_time = time;
+
+    std::array< std::byte, record_header_size > header;
+    auto p = header.data();
+    put< uint32_t >( p, static_cast< uint32_t >( bytes.size() ));
+    put< int64_t >( p, time.count() );
+    payload.write( header.data(), header.size() );
+    payload.write( bytes.data(), bytes.size() );
+    payload_records = payload_records + 1;
+
+    if( payload.size() >= options.chunk_size ) {
+        flush();
+    }
+    record_count = record_count + 1;
+    return record_count - 1;
+}
+
+void
+record_log_writer_t::flush()
+{
+    if( payload_records == 0 ) {
+        return;
+    }
+    if( payload.size() > options.limits.max_chunk_size ) {
+        throw record_log_error( "Chunk exceeds the size limit." );
+    }
+    record_log_chunk_t c;
+    c.offset = file_size;
+    c.first_record = chunks.empty() ? 0 : chunks.back().first_record + chunks.back().record_count;
+    c.record_count = payload_records;
+    c.payload_size = payload.size();
+    c.first_time = payload_first_time;
+    c.last_time = payload_last_time;
+
+    auto header = encode_chunk_header( c, crc32c( payload.bytes() ));
+    write_all( header );
+    write_all( payload.bytes() );
+    if( options.sync and (::fdatasync( fd ) < 0) ) {
+        throw_errno();
+    }
+    chunks.push_back( c );
+    payload.clear();
+    payload_records = 0;
+}
+
+void
+record_log_writer_t::close()
+{
+    if( fd < 0 ) {
+        return;
+    }
+    try {
+        flush();
+
+        memory_sink_t index( chunks.size() * index_entry_size + trailer_size );
+        for( auto const & c : chunks ) {
+            auto e = encode_index_entry( c );
+            index.write( e.data(), e.size() );
+        }
+        auto index_crc = crc32c( index.bytes() );
+        std::array< std::byte, trailer_size > trailer;
+        auto p = trailer.data();
+        std::memcpy( p, index_magic, sizeof( index_magic ));
+        p = p + sizeof( index_magic );
+        put< uint64_t >( p, file_size );
+        put< uint64_t >( p, chunks.size() );
+        put< uint32_t >( p, index_crc );
+        put< uint32_t >( p, crc32c( { trailer.data(), trailer_size - 4 } ));
+        index.write( trailer.data(), trailer.size() );
+
+        write_all( index.bytes() );
+        if( options.sync and (::fdatasync( fd ) < 0) ) {
+            throw_errno();
+        }
+    } catch( ... ) {
+        ::close( fd );
+        fd = -1;
+        throw;
+    }
+    auto closed = ::close( fd );
+    fd = -1;
+    if( closed < 0 ) {
+        throw_errno();
+    }
+}
+
+uint64_t
+record_log_writer_t::size() const
+{
+    return record_count;
+}
+
+record_log_reader_t::record_log_reader_t( std::string const & path,
+                                          record_log_limits_t const & limits_ )
+    : file( path ),
+      limits( limits_ )
+{
+    uint64_t chunks_end;
+    was_recovered = load_index( file.bytes(), limits, index, chunks_end );
+    verified = std::make_unique< std::atomic< bool >[] >( index.size() );
+}
+
+uint64_t
+record_log_reader_t::size() const
+{
+    if( index.empty() ) {
+        return 0;
+    }
+    return index.back().first_record + index.back().record_count;
+}
+
+size_t
+record_log_reader_t::chunk_of( uint64_t n ) const
+{
+    auto it = std::upper_bound(
+        index.begin(), index.end(), n,
+        []( uint64_t m, record_log_chunk_t const & c )
+        {
+            return m < c.first_record;
+        } );
+    return static_cast< size_t >( it - index.begin()) - 1;
+}
+
+void
+record_log_reader_t::decode_chunk( size_t c, std::vector< record_view_t > & records ) const
+{
+    auto const & chunk = index[ c ];
+    auto bytes = file.bytes().subspan( chunk.offset + chunk_header_size, chunk.payload_size );
+    if( not verified[ c ].load( std::memory_order_acquire )) {
+        auto h = file.bytes().data() + chunk.offset;
+        get< uint32_t >( h );
+        if( get< uint32_t >( h ) != crc32c( bytes )) {
+            throw record_log_error( "Record log chunk checksum mismatch." );
+        }
+        verified[ c ].store( true, std::memory_order_release );
+    }
+
+    records.clear();
+    records.reserve( chunk.record_count );
+    auto p = bytes.data();
+    auto end = bytes.data() + bytes.size();
+    while( p != end ) {
+        if( static_cast< size_t >( end - p ) < record_header_size ) {
+            throw record_log_error( "Truncated record header." );
+        }
+        auto size = get< uint32_t >( p );
+        auto time = record_log_time_t( get< int64_t >( p ));
+        if( (size > limits.max_record_size)
+            or (size > static_cast< size_t >( end - p )) ) {
+            throw record_log_error( "Record exceeds the size limit or its chunk." );
+        }
+        records.push_back( record_view_t{ time, { p, size } } );
+        p = p + size;
+    }
+    if( records.size() != chunk.record_count ) {
+        throw record_log_error( "Record count of chunk does not match." );
+    }
+}
+
+record_view_t
+record_log_reader_t::record( uint64_t n ) const
+{
+    if( n >= size() ) {
+        throw std::out_of_range( "Record index out of range." );
+    }
+    auto c = chunk_of( n );
+    std::vector< record_view_t > records;
+    decode_chunk( c, records );
+    return records[ n - index[ c ].first_record ];
+}
+
+uint64_t
+record_log_reader_t::lower_bound( record_log_time_t t ) const
+{
+    auto it = std::partition_point(
+        index.begin(), index.end(),
+        [ t ]( record_log_chunk_t const & c )
+        {
+            return c.last_time < t;
+        } );
+    if( it == index.end() ) {
+        return size();
+    }
+    std::vector< record_view_t > records;
+    decode_chunk( static_cast< size_t >( it - index.begin()), records );
+    auto r = std::partition_point(
+        records.begin(), records.end(),
+        [ t ]( record_view_t const & v )
+        {
+            return v.time < t;
+        } );
+    return it->first_record + static_cast< uint64_t >( r - records.begin());
+}
+}
@@ -0,0 +1,257 @@
+#pragma once
+#ifndef FILE_D86601986060E78_1F1F2B4045A5B614_INCLUDED
+#define FILE_D86601986060E78_1F1F2B4045A5B614_INCLUDED
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <tanz/binary-serialisation.h++>
+#include <tanz/executor.h++>
+
+/* A log of serialised records with random access.
+
+   Layout of the file:
+
+       file header     "TZRECLOG", version
+       chunk*          chunk header, records
+       index           one entry per chunk          } written on
+       trailer         offset and checksum of index } close()
+
+   A chunk header holds the number, the first record index, the
+   time range, the payload size and CRC32C checksums of itself and
+   of the payload.  Every record is framed by its size and its time
+   stamp.  Chunks only count if their checksums match, so after a
+   crash everything up to the last complete chunk is still there.
+   If the trailer is missing or broken, the reader (and a writer
+   appending to the file) scans the chunk headers instead.
+
+   Time stamps are meant to be non-decreasing, lower_bound() relies
+   on that.
+
+   The reader maps the file and hands out records without copying.
+   The sizes are checked against record_log_limits_t and records are
+   deserialised from their bytes only, so a corrupt file leads to a
+   record_log_error (or the runtime_error of deserialiser_t::check),
+   never to reading outside of the record or to allocating for
+   lengths the record cannot hold.
+
+   Not a database: one writer, no concurrent reader while writing. */
+
+namespace tz {
+
+using record_log_time_t = ::std::chrono::duration< int64_t, ::std::nano >;
+
+struct record_log_error
+    : public ::std::runtime_error
+{
+    using ::std::runtime_error::runtime_error;
+};
+
+struct record_log_limits_t {
+    uint64_t max_record_size = uint64_t( 1 ) << 28;
+    uint64_t max_chunk_size = uint64_t( 1 ) << 32;
+};
+
+struct record_log_options_t {
+    size_t chunk_size = size_t( 1 ) << 20; /* bytes of records per chunk */
+    bool sync = false;                     /* fdatasync after each chunk */
+    record_log_limits_t limits;
+};
+
+struct record_log_chunk_t {
+    uint64_t offset;        /* of the chunk header in the file */
+    uint64_t first_record;
+    uint64_t record_count;
+    uint64_t payload_size;
+    record_log_time_t first_time;
+    record_log_time_t last_time;
+};
+
+struct record_view_t {
+    record_log_time_t time;
+    std::span< std::byte const > bytes;
+};
+
+uint32_t
+crc32c( std::span< std::byte const > bytes, uint32_t crc = 0 );
+
+struct record_log_writer_t
+{
+    explicit record_log_writer_t( std::string const & path,
+                                  record_log_options_t const & options = {} );
+    /* Appends to an existing log.  Its index is dropped and
+       rewritten on close(), incomplete chunks at its end are cut. */
+
+    ~record_log_writer_t();
+
+    record_log_writer_t( record_log_writer_t const & ) = delete;
+    record_log_writer_t & operator = ( record_log_writer_t const & ) = delete;
+
+    template< typename T >
+    uint64_t
+    append( record_log_time_t time, T const & record )
+    /* Returns the index of the record. */
+    {
+        scratch.clear();
+        auto ser = make_serialiser( scratch );
+        ser << record;
+        return append_bytes( time, scratch.bytes() );
+    }
+
+    uint64_t
+    append_bytes( record_log_time_t time, std::span< std::byte const > bytes );
+
+    void
+    flush();
+    /* Writes the records collected so far as a chunk. */
+
+    void
+    close();
+
+    uint64_t
+    size() const;
+
+private:
+    void
+    write_all( std::span< std::byte const > bytes );
+
+    int fd = -1;
+    record_log_options_t options;
+    uint64_t file_size = 0;
+    uint64_t record_count = 0;
+    std::vector< record_log_chunk_t > chunks;
+
+    memory_sink_t payload;
+    memory_sink_t scratch;
+    uint64_t payload_records = 0;
+    record_log_time_t payload_first_time{ 0 };
+    record_log_time_t payload_last_time{ 0 };
+};
+
+struct record_log_reader_t
+{
+    explicit record_log_reader_t( std::string const & path,
+                                  record_log_limits_t const & limits = {} );
+
+    uint64_t
+    size() const;
+
+    std::vector< record_log_chunk_t > const &
+    chunks() const
+    {
+        return index;
+    }
+
+    bool
+    recovered() const
+    /* True if there was no valid index and the chunks were scanned. */
+    {
+        return was_recovered;
+    }
+
+    record_view_t
+    record( uint64_t n ) const;
+
+    template< typename T >
+    T
+    read( uint64_t n ) const
+    {
+        return decode< T >( record( n ).bytes );
+    }
+
+    uint64_t
+    lower_bound( record_log_time_t t ) const;
+    /* Index of the first record not before t, size() if there is
+       none. */
+
+    template< typename F >
+    void
+    for_each( uint64_t first, uint64_t last, F const & fn, size_t threads = 1 ) const
+    /* Calls fn( index, record_view_t ) for all records in [first,
+       last).  With several threads, chunks are verified and visited
+       concurrently, fn has to cope with that.  The first exception
+       is rethrown. */
+    {
+        last = std::min( last, size() );
+        if( first >= last ) {
+            return;
+        }
+        auto first_chunk = chunk_of( first );
+        auto last_chunk = chunk_of( last - 1 ) + 1;
+
+        parallel_for(
+            last_chunk - first_chunk, threads,
+            [ & ]( size_t n )
+            {
+                auto c = first_chunk + n;
+                std::vector< record_view_t > records;
+                decode_chunk( c, records );
+                auto base = index[ c ].first_record;
+                for( size_t k = 0; k < records.size(); k = k + 1 ) {
+                    if( (base + k >= first) and (base + k < last) ) {
+                        fn( base + k, records[ k ] );
+                    }
+                }
+            } );
+    }
+
+    template< typename T >
+    std::vector< T >
+    read_range( uint64_t first, uint64_t last, size_t threads = 1 ) const
+    /* Deserialises the records [first, last) in parallel. */
+    {
+        last = std::min( last, size() );
+        std::vector< T > result( last > first ? last - first : 0 );
+        for_each( first, last,
+                  [ & ]( uint64_t n, record_view_t const & r )
+                  {
+                      result[ n - first ] = decode< T >( r.bytes );
+                  },
+                  threads );
+        return result;
+    }
+
+private:
+    template< typename T >
+    static
+    T
+    decode( std::span< std::byte const > bytes )
+    /* The lengths inside a record are checked against its size,
+       but many short elements can still ask for more memory than
+       there is. */
+    {
+        T x;
+        auto des = make_deserialiser( bytes );
+        try {
+            des >> x;
+        } catch( std::bad_alloc const & ) {
+            throw record_log_error( "Record does not fit into memory." );
+        } catch( std::length_error const & ) {
+            throw record_log_error( "Record exceeds the maximum container size." );
+        }
+        des.check();
+        return x;
+    }
+
+    size_t
+    chunk_of( uint64_t n ) const;
+
+    void
+    decode_chunk( size_t c, std::vector< record_view_t > & records ) const;
+
+    mapped_file_t file;
+    record_log_limits_t limits;
+    std::vector< record_log_chunk_t > index;
+    std::unique_ptr< std::atomic< bool >[] > verified;
+    bool was_recovered = false;
+};
+}
+#endif
@@ -0,0 +1,623 @@
+#pragma once
+#ifndef FILE_1B5845937D141F6_31E9BF4A034422F4_INCLUDED
+#define FILE_1B5845937D141F6_31E9BF4A034422F4_INCLUDED
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/* Bounded, lock-free ring buffers with preallocated slots.
+
+   Both variants only offer non-blocking operations (try_...).
+   Blocking, closing and timeouts are layered on top of them by
+   object_fifo (see object-fifo.h++).
+
+   - spsc_ring_t: exactly one producing and one consuming thread.
+     Classical Lamport queue, each side caches the position of the
+     other side, so the shared cache lines are only touched when the
+     cached view runs out.
+
+   - mpmc_ring_t: any number of producers and consumers.  Vyukovs
+     bounded queue, every slot carries a sequence number telling
+     which position it currently waits for.
+
+   Positions are monotone 64 bit counters, a position maps to the
+   slot position % capacity.  The capacity does not have to be a
+   power of two, but if it is, the modulo becomes a mask.
+
+   Elements are constructed in place.  Since a slot, once claimed,
+   has to be published, constructing an element in the ring must
+   not throw.  The callers (object_fifo) take care of that by making
+   the copy up front if needed. */
+
+namespace tz {
+
+constexpr size_t ring_cache_line_size = 64;
+
+namespace impl {
+
+inline
+bool
+is_power_of_two( size_t x )
+{
+    return (x != 0) and ((x & (x - 1)) == 0);
+}
+
+struct ring_index_t {
+    size_t capacity;
+    size_t mask;
+
+    ring_index_t( size_t capacity_ )
+        : capacity( capacity_ ),
+          mask( is_power_of_two( capacity_ ) ? capacity_ - 1 : 0 )
+    {
+    }
+
+    size_t
+    operator() ( size_t position ) const
+    {
+        return mask ? (position & mask) : (position % capacity);
+    }
+};
+
+template< typename T >
+struct alignas( ring_cache_line_size ) spsc_slot_t {
+    alignas( T ) std::byte storage[ sizeof( T ) ];
+
+    T *
+    get()
+    {
+        return std::launder( reinterpret_cast< T * >( storage ));
+    }
+};
+
+template< typename T >
+struct alignas( ring_cache_line_size ) mpmc_slot_t {
+    std::atomic< size_t > sequence;
+    alignas( T ) std::byte storage[ sizeof( T ) ];
+
+    T *
+    get()
+    {
+        return std::launder( reinterpret_cast< T * >( storage ));
+    }
+};
+
+inline
+void
+cpu_relax()
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+    __builtin_ia32_pause();
+#elif defined( __aarch64__ )
+    asm volatile( "yield" );
+#endif
+}
+
+inline
+std::ptrdiff_t
+position_difference( size_t a, size_t b )
+{
+    return static_cast< std::ptrdiff_t >( a - b );
+}
+}
+
+template< typename T >
+struct spsc_ring_t
+{
+    static_assert( std::is_nothrow_move_constructible_v< T >,
+                   "Elements of a ring buffer must be nothrow move constructible." );
+
+    using value_type = T;
+    static constexpr bool multi_producer = false;
+    static constexpr bool multi_consumer = false;
+
+private:
+    using slot_t = impl::spsc_slot_t< T >;
+
+    struct alignas( ring_cache_line_size ) producer_side_t {
+        std::atomic< size_t > tail{ 0 };
+        size_t head_cache = 0;
+    };
+
+    struct alignas( ring_cache_line_size ) consumer_side_t {
+        std::atomic< size_t > head{ 0 };
+        size_t tail_cache = 0;
+    };
+
+    impl::ring_index_t index;
+    std::vector< slot_t > slots;
+    producer_side_t producer;
+    consumer_side_t consumer;
+
+    size_t
+    free_for_producer( size_t tail )
+    {
+        auto free = index.capacity - (tail - producer.head_cache);
+        if( free == 0 ) {
+            producer.head_cache = consumer.head.load( std::memory_order_acquire );
+            free = index.capacity - (tail - producer.head_cache);
+        }
+        return free;
+    }
+
+    size_t
+    available_for_consumer( size_t head )
+    {
+        auto available = consumer.tail_cache - head;
+        if( available == 0 ) {
+            consumer.tail_cache = producer.tail.load( std::memory_order_acquire );
+            available = consumer.tail_cache - head;
+        }
+        return available;
+    }
+
+public:
+    explicit
+    spsc_ring_t( size_t capacity )
+        : index( capacity ),
+          slots( capacity )
+    {
+    }
+
+    spsc_ring_t( spsc_ring_t const & ) = delete;
+    spsc_ring_t & operator = ( spsc_ring_t const & ) = delete;
+
+    ~spsc_ring_t()
+    {
+        auto head = consumer.head.load( std::memory_order_relaxed );
+        auto tail = producer.tail.load( std::memory_order_relaxed );
+        for( ; head != tail; head = head + 1 ) {
+            slots[ index( head ) ].get()->~T();
+        }
+    }
+
+    size_t
+    capacity() const
+    {
+        return index.capacity;
+    }
+
+    size_t
+    head_position() const
+    {
+        return consumer.head.load( std::memory_order_acquire );
+    }
+
+    size_t
+    tail_position() const
+    {
+        return producer.tail.load( std::memory_order_acquire );
+    }
+
+    size_t
+    size() const
+    /* Only a snapshot, exact if neither side is active. */
+    {
+        auto head = head_position();
+        auto tail = tail_position();
+        return tail - head;
+    }
+
+    bool
+    readable() const
+    {
+        return size() != 0;
+    }
+
+    bool
+    writable() const
+    {
+        return size() < index.capacity;
+    }
+
+    template< typename U >
+    bool
+    try_push( U && x )
+    /* Producer side only. */
+    {
+        static_assert( std::is_nothrow_constructible_v< T, U&& > );
+
+        auto tail = producer.tail.load( std::memory_order_relaxed );
+        if( free_for_producer( tail ) == 0 ) {
+            return false;
+        }
+        ::new( slots[ index( tail ) ].storage ) T( std::forward< U >( x ));
+        producer.tail.store( tail + 1, std::memory_order_release );
+        return true;
+    }
+
+    template< typename Iterator >
+    Iterator
+    try_push_batch( Iterator begin, Iterator end )
+    /* Producer side only.  Pushes as many elements as fit and
+       publishes all of them at once.  Returns the iterator past the
+       last element pushed. */
+    {
+        auto tail = producer.tail.load( std::memory_order_relaxed );
+        auto free = free_for_producer( tail );
+        size_t count = 0;
+        try {
+            for( ; (count < free) and (begin != end); count = count + 1, ++begin ) {
+                ::new( slots[ index( tail + count ) ].storage ) T( *begin );
+            }
+        } catch( ... ) {
+            producer.tail.store( tail + count, std::memory_order_release );
+            throw;
+        }
+        if( count ) {
+            producer.tail.store( tail + count, std::memory_order_release );
+        }
+        return begin;
+    }
+
+    std::optional< T >
+    try_pop()
+    /* Consumer side only. */
+    {
+        auto head = consumer.head.load( std::memory_order_relaxed );
+        if( available_for_consumer( head ) == 0 ) {
+            return {};
+        }
+        auto p = slots[ index( head ) ].get();
+        std::optional< T > x( std::move( *p ));
+        p->~T();
+        consumer.head.store( head + 1, std::memory_order_release );
+        return x;
+    }
+
+    template< typename OutputIterator >
+    size_t
+    try_pop_batch( OutputIterator & out, size_t max_count )
+    /* Consumer side only.  Moves up to max_count elements to out and
+       releases their slots at once.  If assigning to out throws, the
+       element stays in the ring. */
+    {
+        auto head = consumer.head.load( std::memory_order_relaxed );
+        auto available = available_for_consumer( head );
+        size_t count = 0;
+        try {
+            for( ; (count < available) and (count < max_count); count = count + 1 ) {
+                auto p = slots[ index( head + count ) ].get();
+                *out = std::move( *p );
+                ++out;
+                p->~T();
+            }
+        } catch( ... ) {
+            consumer.head.store( head + count, std::memory_order_release );
+            throw;
+        }
+        if( count ) {
+            consumer.head.store( head + count, std::memory_order_release );
+        }
+        return count;
+    }
+};
+
+template< typename T >
+struct mpmc_ring_t
+{
+    static_assert( std::is_nothrow_move_constructible_v< T >,
+                   "Elements of a ring buffer must be nothrow move constructible." );
+
+    using value_type = T;
+    static constexpr bool multi_producer = true;
+    static constexpr bool multi_consumer = true;
+
+private:
+    using slot_t = impl::mpmc_slot_t< T >;
+
+    struct alignas( ring_cache_line_size ) position_t {
+        std::atomic< size_t > value{ 0 };
+    };
+
+    impl::ring_index_t index;
+    std::vector< slot_t > slots;
+    position_t tail;
+    position_t head;
+
+    /* The states of a slot for position pos.  Unlike Vyukov's pos
+       and pos + 1 they cannot be confused with the states of the
+       next position, not even with capacity one. */
+
+    static size_t
+    free_sequence( size_t pos )
+    /* Waits for the element at pos, or is being written. */
+    {
+        return 4 * pos;
+    }
+
+    static size_t
+    published_sequence( size_t pos )
+    /* Holds the element at pos. */
+    {
+        return 4 * pos + 1;
+    }
+
+    static size_t
+    reading_sequence( size_t pos )
+    /* A reader owns the element at pos, try_replace_newest() must
+       not touch it any more. */
+    {
+        return 4 * pos + 2;
+    }
+
+    size_t
+    claim_for_writing( size_t & max_count )
+    /* Returns the first position claimed, the number of claimed
+       positions is stored in max_count (0 if the ring is full). */
+    {
+        auto pos = tail.value.load( std::memory_order_relaxed );
+        for( ;; ) {
+            size_t count = 0;
+            while( count < max_count ) {
+                auto seq = slots[ index( pos + count ) ].sequence.load( std::memory_order_acquire );
+                if( seq != free_sequence( pos + count )) {
+                    break;
+                }
+                count = count + 1;
+            }
+            if( count == 0 ) {
+                auto seq = slots[ index( pos ) ].sequence.load( std::memory_order_acquire );
+                if( impl::position_difference( seq, free_sequence( pos )) < 0 ) {
+                    max_count = 0;
+                    return pos;
+                }
+                pos = tail.value.load( std::memory_order_relaxed );
+            } else if( tail.value.compare_exchange_weak( pos, pos + count, std::memory_order_relaxed )) {
+                max_count = count;
+                return pos;
+            }
+        }
+    }
+
+    size_t
+    claim_for_reading( size_t & max_count )
+    {
+        auto pos = head.value.load( std::memory_order_relaxed );
+        for( ;; ) {
+            size_t count = 0;
+            while( count < max_count ) {
+                auto seq = slots[ index( pos + count ) ].sequence.load( std::memory_order_acquire );
+                if( seq != published_sequence( pos + count )) {
+                    break;
+                }
+                count = count + 1;
+            }
+            if( count == 0 ) {
+                auto seq = slots[ index( pos ) ].sequence.load( std::memory_order_acquire );
+                if( impl::position_difference( seq, published_sequence( pos )) < 0 ) {
+                    max_count = 0;
+                    return pos;
+                }
+                pos = head.value.load( std::memory_order_relaxed );
+            } else if( head.value.compare_exchange_weak( pos, pos + count, std::memory_order_relaxed )) {
+                max_count = count;
+                return pos;
+            }
+        }
+    }
+
+    T *
+    published( size_t pos )
+    /* Takes over the element at a claimed position.  Waits while
+       try_replace_newest() swaps it. */
+    {
+        auto & slot = slots[ index( pos ) ];
+        for( ;; ) {
+            auto expected = published_sequence( pos );
+            if( slot.sequence.compare_exchange_weak( expected, reading_sequence( pos ),
+                                                     std::memory_order_acquire,
+                                                     std::memory_order_relaxed )) {
+                return slot.get();
+            }
+            impl::cpu_relax();
+        }
+    }
+
+    void
+    release_read( size_t pos )
+    {
+        slots[ index( pos ) ].sequence.store( free_sequence( pos + index.capacity ), std::memory_order_release );
+    }
+
+public:
+    explicit
+    mpmc_ring_t( size_t capacity )
+        : index( capacity ),
+          slots( capacity )
+    {
+        for( size_t k = 0; k < capacity; k = k + 1 ) {
+            slots[ k ].sequence.store( free_sequence( k ), std::memory_order_relaxed );
+        }
+    }
+
+    mpmc_ring_t( mpmc_ring_t const & ) = delete;
+    mpmc_ring_t & operator = ( mpmc_ring_t const & ) = delete;
+
+    ~mpmc_ring_t()
+    {
+        auto pos = head.value.load( std::memory_order_relaxed );
+        auto end = tail.value.load( std::memory_order_relaxed );
+        for( ; pos != end; pos = pos + 1 ) {
+            slots[ index( pos ) ].get()->~T();
+        }
+    }
+
+    size_t
+    capacity() const
+    {
+        return index.capacity;
+    }
+
+    size_t
+    head_position() const
+    {
+        return head.value.load( std::memory_order_acquire );
+    }
+
+    size_t
+    tail_position() const
+    {
+        return tail.value.load( std::memory_order_acquire );
+    }
+
+    size_t
+    size() const
+    /* Only a snapshot, claimed but unpublished slots are counted. */
+    {
+        auto h = head_position();
+        auto t = tail_position();
+        return (impl::position_difference( t, h ) > 0) ? (t - h) : 0;
+    }
+
+    bool
+    readable() const
+    {
+        auto pos = head.value.load( std::memory_order_relaxed );
+        auto seq = slots[ index( pos ) ].sequence.load( std::memory_order_acquire );
+        return seq == published_sequence( pos );
+    }
+
+    bool
+    writable() const
+    {
+        auto pos = tail.value.load( std::memory_order_relaxed );
+        auto seq = slots[ index( pos ) ].sequence.load( std::memory_order_acquire );
+        return seq == free_sequence( pos );
+    }
+
+    template< typename U >
+    bool
+    try_push( U && x )
+    {
+        static_assert( std::is_nothrow_constructible_v< T, U&& > );
+
+        size_t count = 1;
+        auto pos = claim_for_writing( count );
+        if( count == 0 ) {
+            return false;
+        }
+        auto & slot = slots[ index( pos ) ];
+        ::new( slot.storage ) T( std::forward< U >( x ));
+        slot.sequence.store( published_sequence( pos ), std::memory_order_release );
+        return true;
+    }
+
+    template< typename Iterator >
+    Iterator
+    try_push_batch( Iterator begin, Iterator end )
+    /* Claims as many consecutive free slots as there are elements
+       with a single CAS.  Returns the iterator past the last element
+       pushed. */
+    {
+        static_assert( std::forward_iterator< Iterator > );
+        static_assert( std::is_nothrow_constructible_v< T, std::iter_reference_t< Iterator > > );
+
+        if( begin == end ) {
+            return begin;
+        }
+        size_t count = std::min< size_t >( std::distance( begin, end ), index.capacity );
+        auto pos = claim_for_writing( count );
+        for( size_t k = 0; k < count; k = k + 1, ++begin ) {
+            auto & slot = slots[ index( pos + k ) ];
+            ::new( slot.storage ) T( *begin );
+            slot.sequence.store( published_sequence( pos + k ), std::memory_order_release );
+        }
+        return begin;
+    }
+
+    template< typename U >
+    bool
+    try_replace_newest( U && x )
+    /* Replaces the element published last by x, for overwriting a
+       full ring.  The slot is taken back from published to free, so
+       readers skip it, and a reader that claimed it meanwhile waits
+       in published() until it is published again.  Once a reader
+       has taken the element (reading), the CAS fails and nothing is
+       touched.
+
+       Returns false if x was not placed: the last element is being
+       read or written, or another writer has appended since tail
+       was loaded.  Then the ring has space again, or will have soon.
+       With several writers, "newest" is the last element at the
+       moment of the check after the CAS. */
+    {
+        static_assert( std::is_nothrow_constructible_v< T, U&& > );
+
+        auto pos = tail.value.load( std::memory_order_acquire );
+        if( pos == 0 ) {
+            return false;
+        }
+        auto last = pos - 1;
+        auto & slot = slots[ index( last ) ];
+        auto expected = published_sequence( last );
+        if( not slot.sequence.compare_exchange_strong( expected, free_sequence( last ), std::memory_order_acquire )) {
+            return false;
+        }
+        if( tail.value.load( std::memory_order_acquire ) != pos ) {
+            /* Not the newest any more, leave it alone. */
+            slot.sequence.store( published_sequence( last ), std::memory_order_release );
+            return false;
+        }
+        auto p = slot.get();
+        p->~T();
+        ::new( slot.storage ) T( std::forward< U >( x ));
+        slot.sequence.store( published_sequence( last ), std::memory_order_release );
+        return true;
+    }
+
+    std::optional< T >
+    try_pop()
+    {
+        size_t count = 1;
+        auto pos = claim_for_reading( count );
+        if( count == 0 ) {
+            return {};
+        }
+        auto p = published( pos );
+        std::optional< T > x( std::move( *p ));
+        p->~T();
+        release_read( pos );
+        return x;
+    }
+
+    template< typename OutputIterator >
+    size_t
+    try_pop_batch( OutputIterator & out, size_t max_count )
+    /* Claims up to max_count published elements with a single CAS.
+       If assigning to out throws, the remaining claimed elements are
+       dropped (they cannot be handed back to the ring). */
+    {
+        if( max_count == 0 ) {
+            return 0;
+        }
+        auto count = std::min( max_count, index.capacity );
+        auto pos = claim_for_reading( count );
+        size_t k = 0;
+        try {
+            for( ; k < count; k = k + 1 ) {
+                auto p = published( pos + k );
+                *out = std::move( *p );
+                ++out;
+                p->~T();
+                release_read( pos + k );
+            }
+        } catch( ... ) {
+            for( ; k < count; k = k + 1 ) {
+                published( pos + k )->~T();
+                release_read( pos + k );
+            }
+            throw;
+        }
+        return count;
+    }
+};
+}
+#endif
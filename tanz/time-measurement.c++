@@ -5,8 +5,8 @@
 
 namespace tz {
 
-time_marker_t::time_marker_t()
-    : physical( std::chrono::steady_clock::now())
+uint64_t
+thread_cpu_time_ns()
 {
 #if __unix__
     struct timespec ts;
@@ -16,12 +16,18 @@ time_marker_t::time_marker_t()
                 errno,
                 std::system_category()));
     }
-    cycles = ts.tv_sec * uint64_t(1000000000) + ts.tv_nsec;
+    return ts.tv_sec * uint64_t(1000000000) + ts.tv_nsec;
 #else
 #  error CPU time clock not implemented for this platform
 #endif
 }
 
+time_marker_t::time_marker_t()
+    : physical( std::chrono::steady_clock::now()),
+      cycles( thread_cpu_time_ns())
+{
+}
+
 ::tz::serialiser_t &
 operator << ( ::tz::serialiser_t & out, ::tz::task_duration_t const & v )
 {
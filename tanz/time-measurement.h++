@@ -27,6 +27,10 @@ operator << ( ::tz::serialiser_t & out, ::tz::task_duration_t const & v );
 ::tz::deserialiser_t &
 operator >> ( ::tz::deserialiser_t & in, ::tz::task_duration_t  & v );
 
+uint64_t
+thread_cpu_time_ns();
+/* CPU time of the calling thread. */
+
 struct time_marker_t {
     using physical_time_t = std::chrono::time_point<std::chrono::steady_clock>;
     using cycle_time_t = uint64_t;
@@ -0,0 +1,424 @@
+#include <tanz/tracing.h++>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <iterator>
+#include <stdexcept>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#  include <cpuid.h>
+#endif
+
+namespace tz {
+
+namespace impl {
+std::atomic< bool > trace_enabled{ false };
+std::atomic< bool > trace_use_tsc{ false };
+}
+
+namespace {
+
+struct trace_registry_t {
+    std::mutex mtx;
+    std::vector< std::shared_ptr< impl::trace_buffer_t > > buffers;
+    uint32_t next_thread = 0;
+    size_t ring_capacity = 8192;
+    bool collector_alive = false;
+};
+
+trace_registry_t &
+registry()
+{
+    static trace_registry_t r;
+    return r;
+}
+
+struct trace_thread_holder_t
+/* Marks the buffer of an exiting thread, the collector drops it
+   once it is empty. */
+{
+    std::shared_ptr< impl::trace_buffer_t > buffer;
+
+    ~trace_thread_holder_t()
+    {
+        if( buffer ) {
+            impl::current_trace_buffer = nullptr;
+            buffer->retired.store( true, std::memory_order_release );
+        }
+    }
+};
+
+thread_local trace_thread_holder_t trace_thread_holder;
+
+bool
+invariant_tsc()
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+    unsigned a, b, c, d;
+    if( not __get_cpuid( 0x80000007, &a, &b, &c, &d )) {
+        return false;
+    }
+    return (d & (1u << 8)) != 0;
+#else
+    return false;
+#endif
+}
+
+int64_t
+steady_ns()
+{
+    return std::chrono::duration_cast< std::chrono::nanoseconds >(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+constexpr uint8_t dump_block = 1;
+constexpr uint8_t dump_end = 0;
+}
+
+impl::trace_buffer_t *
+impl::register_trace_thread()
+{
+    auto & r = registry();
+    std::lock_guard< std::mutex > lock( r.mtx );
+    auto buffer = std::make_shared< trace_buffer_t >( r.ring_capacity, r.next_thread );
+    r.next_thread = r.next_thread + 1;
+    r.buffers.push_back( buffer );
+    trace_thread_holder.buffer = buffer;
+    current_trace_buffer = buffer.get();
+    return current_trace_buffer;
+}
+
+size_t
+trace_histogram_t::bucket_of( uint64_t ns )
+{
+    auto width = static_cast< unsigned >( std::bit_width( ns ));
+    auto shift = (width > sub_bucket_bits + 1) ? width - (sub_bucket_bits + 1) : 0u;
+    return (size_t( shift ) << sub_bucket_bits) + static_cast< size_t >( ns >> shift );
+}
+
+uint64_t
+trace_histogram_t::bucket_start( size_t bucket )
+{
+    constexpr size_t linear = size_t( 2 ) << sub_bucket_bits;
+    auto shift = (bucket < linear) ? 0 : (bucket >> sub_bucket_bits) - 1;
+    return uint64_t( bucket - (shift << sub_bucket_bits)) << shift;
+}
+
+void
+trace_histogram_t::add( uint64_t ns )
+{
+    n = n + 1;
+    sum = sum + static_cast< double >( ns );
+    smallest = std::min( smallest, ns );
+    largest = std::max( largest, ns );
+    buckets[ bucket_of( ns ) ] += 1;
+}
+
+void
+trace_histogram_t::merge( trace_histogram_t const & other )
+{
+    n = n + other.n;
+    sum = sum + other.sum;
+    smallest = std::min( smallest, other.smallest );
+    largest = std::max( largest, other.largest );
+    for( size_t b = 0; b < bucket_count; b = b + 1 ) {
+        buckets[ b ] += other.buckets[ b ];
+    }
+}
+
+double
+trace_histogram_t::mean() const
+{
+    return n ? sum / n : 0.0;
+}
+
+double
+trace_histogram_t::percentile( double p ) const
+{
+    if( n == 0 ) {
+        return 0.0;
+    }
+    auto rank = static_cast< uint64_t >( std::ceil( std::clamp( p, 0.0, 1.0 ) * n ));
+    rank = std::max< uint64_t >( rank, 1 );
+    uint64_t seen = 0;
+    for( size_t b = 0; b < bucket_count; b = b + 1 ) {
+        seen = seen + buckets[ b ];
+        if( seen >= rank ) {
+            /* Middle of the bucket, but within what was seen. */
+            auto start = bucket_start( b );
+            auto end = (b + 1 < bucket_count) ? bucket_start( b + 1 ) : largest + 1;
+            auto middle = start + 0.5 * static_cast< double >( end - start - 1 );
+            return std::clamp( middle,
+                               static_cast< double >( smallest ),
+                               static_cast< double >( largest ));
+        }
+    }
+    return static_cast< double >( largest );
+}
+
+task_duration_t
+trace_record_t::task_duration() const
+{
+    task_duration_t d;
+    d.start = start;
+    d.real_time = 1.0E-9f * wall.count();
+    d.cpu_time = (cpu.count() < 0) ? 0.0f : 1.0E-9f * cpu.count();
+    return d;
+}
+
+::tz::serialiser_t &
+operator << ( ::tz::serialiser_t & out, ::tz::trace_record_t const & v )
+{
+    return out
+        << v.label
+        << v.thread
+        << v.start
+        << v.wall
+        << v.cpu;
+}
+
+::tz::deserialiser_t &
+operator >> ( ::tz::deserialiser_t & in, ::tz::trace_record_t & v )
+{
+    return
+        in >> v.label
+           >> v.thread
+           >> v.start
+           >> v.wall
+           >> v.cpu;
+}
+
+trace_dump_t
+read_trace_dump( deserialiser_t & in )
+{
+    trace_dump_t dump;
+    for( ;; ) {
+        uint8_t marker;
+        in >> marker;
+        in.check();
+        if( marker == dump_end ) {
+            return dump;
+        }
+        if( marker != dump_block ) {
+            throw std::runtime_error( "Not a trace dump." );
+        }
+        std::vector< std::vector< uint8_t > > labels;
+        std::vector< trace_record_t > records;
+        in >> labels >> records;
+        in.check();
+        for( auto const & l : labels ) {
+            dump.labels.emplace_back( l.begin(), l.end() );
+        }
+        for( auto const & r : records ) {
+            if( r.label >= dump.labels.size() ) {
+                throw std::runtime_error( "Trace record with unknown label." );
+            }
+        }
+        dump.records.insert( dump.records.end(), records.begin(), records.end() );
+    }
+}
+
+trace_collector_t::trace_collector_t( trace_collector_options_t const & options_ )
+    : options( options_ )
+{
+    {
+        auto & r = registry();
+        std::lock_guard< std::mutex > lock( r.mtx );
+        if( r.collector_alive ) {
+            throw std::logic_error( "Only one trace_collector_t at a time." );
+        }
+        r.collector_alive = true;
+        r.ring_capacity = options.ring_capacity;
+    }
+
+    /* Left over from an earlier collector, maybe with another clock. */
+    auto dump = options.dump;
+    options.dump = nullptr;
+    drain();
+    options.dump = dump;
+    stats.clear();
+    label_by_pointer.clear();
+    label_by_name.clear();
+    dropped_events = 0;
+
+    tsc = options.use_tsc and invariant_tsc();
+    impl::trace_use_tsc.store( tsc );
+    if( tsc ) {
+        tick0 = impl::trace_ticks();
+        ns0 = steady_ns();
+        std::this_thread::sleep_for( std::chrono::milliseconds( 2 ));
+        calibrate();
+    } else {
+        tick0 = 0;
+        ns0 = 0;
+        ticks_to_ns = 1.0;
+    }
+
+    impl::trace_enabled.store( true );
+    worker = std::thread(
+        [ this ]()
+        {
+            std::unique_lock< std::mutex > lock( stop_mtx );
+            while( not stopping ) {
+                stop_cv.wait_for( lock, options.interval );
+                lock.unlock();
+                try {
+                    drain();
+                } catch( ... ) {
+                    /* The dump failed and has been given up. */
+                }
+                lock.lock();
+            }
+        } );
+}
+
+trace_collector_t::~trace_collector_t()
+{
+    impl::trace_enabled.store( false );
+    {
+        std::lock_guard< std::mutex > lock( stop_mtx );
+        stopping = true;
+    }
+    stop_cv.notify_all();
+    worker.join();
+    try {
+        drain();
+        if( options.dump ) {
+            *options.dump << dump_end;
+        }
+    } catch( ... ) {
+    }
+    auto & r = registry();
+    std::lock_guard< std::mutex > lock( r.mtx );
+    r.collector_alive = false;
+}
+
+void
+trace_collector_t::calibrate()
+/* Ticks per nanosecond over the whole lifetime of the collector,
+   so the estimate gets better over time. */
+{
+    if( not tsc ) {
+        return;
+    }
+    auto ticks = impl::trace_ticks();
+    auto ns = steady_ns();
+    if( (ticks > tick0) and (ns > ns0) ) {
+        ticks_to_ns = static_cast< double >( ns - ns0 ) / static_cast< double >( ticks - tick0 );
+    }
+}
+
+uint32_t
+trace_collector_t::label_index( char const * label )
+{
+    auto p = label_by_pointer.find( label );
+    if( p != label_by_pointer.end() ) {
+        return p->second;
+    }
+    /* The same literal may have different addresses in different
+       translation units. */
+    auto [ it, added ] = label_by_name.emplace( label, static_cast< uint32_t >( stats.size()));
+    if( added ) {
+        stats.push_back( trace_label_statistics_t{ label, {}, {} } );
+    }
+    label_by_pointer.emplace( label, it->second );
+    return it->second;
+}
+
+void
+trace_collector_t::drain()
+{
+    std::lock_guard< std::mutex > lock( mtx );
+    calibrate();
+
+    std::vector< std::shared_ptr< impl::trace_buffer_t > > buffers;
+    {
+        auto & r = registry();
+        std::lock_guard< std::mutex > registry_lock( r.mtx );
+        buffers = r.buffers;
+    }
+
+    std::vector< impl::trace_buffer_t * > finished;
+    for( auto const & buffer : buffers ) {
+        auto retired = buffer->retired.load( std::memory_order_acquire );
+        events.clear();
+        auto out = std::back_inserter( events );
+        while( buffer->ring.try_pop_batch( out, 4096 )) {
+        }
+        dropped_events = dropped_events + buffer->dropped.exchange( 0, std::memory_order_relaxed );
+        if( retired ) {
+            finished.push_back( buffer.get() );
+        }
+
+        for( auto const & e : events ) {
+            auto idx = label_index( e.label );
+            auto wall = static_cast< double >( e.end - e.start ) * ticks_to_ns;
+            auto & s = stats[ idx ];
+            s.wall.add( static_cast< uint64_t >( wall ));
+            if( e.cpu_ns != impl::trace_no_cpu_time ) {
+                s.cpu.add( e.cpu_ns );
+            }
+            if( options.dump ) {
+                auto since_tick0 = static_cast< double >( static_cast< int64_t >( e.start - tick0 ));
+                records.push_back(
+                    trace_record_t{
+                        idx,
+                        buffer->thread,
+                        trace_record_t::duration_t( ns0 + static_cast< int64_t >( since_tick0 * ticks_to_ns )),
+                        trace_record_t::duration_t( static_cast< int64_t >( wall )),
+                        trace_record_t::duration_t(
+                            (e.cpu_ns == impl::trace_no_cpu_time) ? -1 : static_cast< int64_t >( e.cpu_ns )) } );
+            }
+        }
+    }
+
+    if( not finished.empty() ) {
+        auto & r = registry();
+        std::lock_guard< std::mutex > registry_lock( r.mtx );
+        std::erase_if( r.buffers,
+                       [ & ]( auto const & b )
+                       {
+                           return std::find( finished.begin(), finished.end(), b.get()) != finished.end();
+                       } );
+    }
+
+    if( options.dump and ((labels_dumped < stats.size()) or not records.empty()) ) {
+        std::vector< std::vector< uint8_t > > labels;
+        for( ; labels_dumped < stats.size(); labels_dumped = labels_dumped + 1 ) {
+            auto const & l = stats[ labels_dumped ].label;
+            labels.emplace_back( l.begin(), l.end() );
+        }
+        try {
+            *options.dump << dump_block << labels << records;
+            options.dump->check();
+        } catch( ... ) {
+            options.dump = nullptr;
+            records.clear();
+            throw;
+        }
+        records.clear();
+    }
+}
+
+std::vector< trace_label_statistics_t >
+trace_collector_t::statistics()
+{
+    drain();
+    std::lock_guard< std::mutex > lock( mtx );
+    return stats;
+}
+
+uint64_t
+trace_collector_t::dropped() const
+{
+    std::lock_guard< std::mutex > lock( mtx );
+    return dropped_events;
+}
+
+double
+trace_collector_t::ns_per_tick() const
+{
+    std::lock_guard< std::mutex > lock( mtx );
+    return ticks_to_ns;
+}
+}
@@ -0,0 +1,326 @@
+#pragma once
+#ifndef FILE_4A0C2B7E91D35F8_C61E07D2A93B58E1_INCLUDED
+#define FILE_4A0C2B7E91D35F8_C61E07D2A93B58E1_INCLUDED
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#  include <x86intrin.h>
+#endif
+
+#include <tanz/binary-serialisation.h++>
+#include <tanz/ring-buffer.h++>
+#include <tanz/time-measurement.h++>
+
+/* Always-on tracing of code sections.
+
+       tz::trace_collector_t collector;      // enables tracing
+       ...
+       {
+           tz::trace_span_t span( "decode" );
+           ...
+       }
+       ...
+       for( auto const & s : collector.statistics() ) { ... }
+
+   A span takes two clock readings and pushes one event to a ring
+   buffer of its thread, nothing else.  The collector drains the
+   rings from a background thread, keeps per label a count and
+   histograms of wall and CPU time, and can write all events to a
+   serialiser_t.  Without a collector a span costs one relaxed load.
+
+   Labels have to be string literals (or otherwise live forever),
+   only the pointer is stored.
+
+   The clock is the TSC if it is invariant, calibrated against
+   steady_clock by the collector, otherwise steady_clock.
+   trace_cpu_span_t also measures the CPU time of the thread, which
+   is a system call and costs much more than the span itself.
+
+   If a ring is full, events are dropped and counted, spans never
+   block. */
+
+namespace tz {
+
+namespace impl {
+
+struct trace_event_t {
+    char const * label;
+    uint64_t start;   /* ticks */
+    uint64_t end;
+    uint64_t cpu_ns;  /* trace_no_cpu_time if not measured */
+};
+
+constexpr uint64_t trace_no_cpu_time = ~uint64_t( 0 );
+
+struct trace_buffer_t {
+    explicit trace_buffer_t( size_t capacity, uint32_t thread_ )
+        : ring( capacity ),
+          thread( thread_ )
+    {
+    }
+
+    spsc_ring_t< trace_event_t > ring;
+    std::atomic< uint64_t > dropped{ 0 };
+    std::atomic< bool > retired{ false };
+    uint32_t thread;
+};
+
+extern std::atomic< bool > trace_enabled;
+extern std::atomic< bool > trace_use_tsc;
+
+inline constinit thread_local trace_buffer_t * current_trace_buffer = nullptr;
+
+trace_buffer_t *
+register_trace_thread();
+
+inline
+uint64_t
+trace_ticks()
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+    if( trace_use_tsc.load( std::memory_order_relaxed )) {
+        return __rdtsc();
+    }
+#endif
+    return std::chrono::duration_cast< std::chrono::nanoseconds >(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline
+void
+trace_push( trace_event_t const & e )
+{
+    auto buffer = current_trace_buffer;
+    if( not buffer ) {
+        buffer = register_trace_thread();
+    }
+    if( not buffer->ring.try_push( e )) {
+        buffer->dropped.fetch_add( 1, std::memory_order_relaxed );
+    }
+}
+}
+
+struct trace_span_t
+/* Wall time of the enclosing scope. */
+{
+    explicit trace_span_t( char const * label_ )
+        : label( label_ ),
+          start( impl::trace_enabled.load( std::memory_order_relaxed ) ? impl::trace_ticks() : 0 )
+    {
+    }
+
+    ~trace_span_t()
+    {
+        if( start ) {
+            impl::trace_push( { label, start, impl::trace_ticks(), impl::trace_no_cpu_time } );
+        }
+    }
+
+    trace_span_t( trace_span_t const & ) = delete;
+    trace_span_t & operator = ( trace_span_t const & ) = delete;
+
+private:
+    char const * label;
+    uint64_t start;
+};
+
+struct trace_cpu_span_t
+/* Wall and CPU time of the enclosing scope. */
+{
+    explicit trace_cpu_span_t( char const * label_ )
+        : label( label_ )
+    {
+        if( impl::trace_enabled.load( std::memory_order_relaxed )) {
+            cpu_start = thread_cpu_time_ns();
+            start = impl::trace_ticks();
+        }
+    }
+
+    ~trace_cpu_span_t()
+    {
+        if( start ) {
+            auto end = impl::trace_ticks();
+            auto cpu = thread_cpu_time_ns() - cpu_start;
+            impl::trace_push( { label, start, end, cpu } );
+        }
+    }
+
+    trace_cpu_span_t( trace_cpu_span_t const & ) = delete;
+    trace_cpu_span_t & operator = ( trace_cpu_span_t const & ) = delete;
+
+private:
+    char const * label;
+    uint64_t start = 0;
+    uint64_t cpu_start = 0;
+};
+
+struct trace_histogram_t
+/* Durations in nanoseconds in log-linear buckets (as in HDR
+   histograms): exact below 64 ns, above that 32 buckets per power
+   of two, so percentiles are off by at most about 3%. */
+{
+    static constexpr unsigned sub_bucket_bits = 5;
+    static constexpr size_t bucket_count = (64 - sub_bucket_bits + 1) << sub_bucket_bits;
+
+    void
+    add( uint64_t ns );
+
+    void
+    merge( trace_histogram_t const & other );
+
+    uint64_t
+    count() const
+    {
+        return n;
+    }
+
+    double
+    mean() const;
+
+    uint64_t
+    min() const
+    {
+        return n ? smallest : 0;
+    }
+
+    uint64_t
+    max() const
+    {
+        return largest;
+    }
+
+    double
+    percentile( double p ) const;
+    /* p in [0, 1], e.g. 0.99 */
+
+    static
+    size_t
+    bucket_of( uint64_t ns );
+
+    static
+    uint64_t
+    bucket_start( size_t bucket );
+
+private:
+    uint64_t n = 0;
+    double sum = 0.0;
+    uint64_t smallest = ~uint64_t( 0 );
+    uint64_t largest = 0;
+    std::array< uint64_t, bucket_count > buckets{};
+};
+
+struct trace_label_statistics_t {
+    std::string label;
+    trace_histogram_t wall;
+    trace_histogram_t cpu; /* only spans measuring CPU time */
+};
+
+struct trace_record_t
+/* One span, as written to the dump. */
+{
+    using duration_t = task_duration_t::duration_t;
+
+    uint32_t label;    /* index into trace_dump_t::labels */
+    uint32_t thread;   /* in order of the first span of the thread */
+    duration_t start;  /* steady_clock */
+    duration_t wall;
+    duration_t cpu;    /* negative if not measured */
+
+    task_duration_t
+    task_duration() const;
+
+    bool
+    operator == ( trace_record_t const & ) const = default;
+};
+
+::tz::serialiser_t &
+operator << ( ::tz::serialiser_t & out, ::tz::trace_record_t const & v );
+
+::tz::deserialiser_t &
+operator >> ( ::tz::deserialiser_t & in, ::tz::trace_record_t & v );
+
+struct trace_dump_t {
+    std::vector< std::string > labels;
+    std::vector< trace_record_t > records;
+};
+
+trace_dump_t
+read_trace_dump( deserialiser_t & in );
+/* Reads everything a trace_collector_t wrote to its dump. */
+
+struct trace_collector_options_t {
+    std::chrono::milliseconds interval{ 10 };
+    size_t ring_capacity = 8192;   /* events per thread */
+    bool use_tsc = true;
+    serialiser_t * dump = nullptr;
+    /* If set, all events are written to it, from the collector
+       thread.  It must stay alive until the collector is gone.  If
+       writing fails, the dump is given up. */
+};
+
+struct trace_collector_t
+/* Only one collector can exist at a time, its lifetime is when
+   tracing is enabled. */
+{
+    explicit trace_collector_t( trace_collector_options_t const & options = {} );
+    ~trace_collector_t();
+
+    trace_collector_t( trace_collector_t const & ) = delete;
+    trace_collector_t & operator = ( trace_collector_t const & ) = delete;
+
+    void
+    drain();
+    /* Processes all events pushed so far. */
+
+    std::vector< trace_label_statistics_t >
+    statistics();
+    /* Drains and returns the statistics per label, in order of
+       their first appearance. */
+
+    uint64_t
+    dropped() const;
+    /* Events lost because of full rings. */
+
+    double
+    ns_per_tick() const;
+
+private:
+    void
+    calibrate();
+
+    uint32_t
+    label_index( char const * label );
+
+    trace_collector_options_t options;
+
+    mutable std::mutex mtx;
+    std::vector< trace_label_statistics_t > stats;
+    std::unordered_map< char const *, uint32_t > label_by_pointer;
+    std::unordered_map< std::string, uint32_t > label_by_name;
+    size_t labels_dumped = 0;
+    std::vector< impl::trace_event_t > events;
+    std::vector< trace_record_t > records;
+    uint64_t dropped_events = 0;
+
+    bool tsc = false;
+    uint64_t tick0 = 0;
+    int64_t ns0 = 0;
+    double ticks_to_ns = 1.0;
+
+    std::mutex stop_mtx;
+    std::condition_variable stop_cv;
+    bool stopping = false;
+    std::thread worker;
+};
+}
+#endif
@@ -1,33 +1,115 @@
 /* Tara Lorenz (c) 2020, GPL3 or Apache License 2.0 */
 #include <tanz/union-find.h++>
-#include <iostream>
-#include <functional>
+#include <tanz/executor.h++>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <thread>
 
 namespace tz {
 
-union_finder_t::union_finder_t( size_t num_elements )
-    : index_to_rep( num_elements )
+namespace {
+size_t find_root( std::vector< union_finder_t::prep_t > & map, size_t a )
+/* Path halving, without recursion. */
 {
-    for( size_t k = 0; k < num_elements; k = k + 1 ) {
-        index_to_rep[ k ] = { k, 1 };
+    for( ;; ) {
+        auto parent = map[ a ].root;
+        if( parent == a ) {
+            return a;
+        }
+        auto grandparent = map[ parent ].root;
+        map[ a ].root = grandparent;
+        a = grandparent;
     }
 }
 
-namespace {
-size_t find_root( std::vector< union_finder_t::prep_t > & map, size_t a )
+union_find_classes_t
+classes_from_roots( std::vector< size_t > && roots )
+/* Linear: number the roots in order of appearance, count, then
+   place every element. */
 {
-    auto & rep = map[ a ];
-    auto current_root = rep.root;
-    if( current_root == a )
-    {
-        return current_root;
-    } else {
-        /* Using the stack, fingers crossed… */
-        auto new_root = find_root( map, current_root );
-        rep.root = new_root;
-        return new_root;
+    constexpr auto none = std::numeric_limits< size_t >::max();
+    auto n = roots.size();
+
+    union_find_classes_t result;
+    std::vector< size_t > root_label( n, none );
+    size_t count = 0;
+    for( size_t k = 0; k < n; k = k + 1 ) {
+        auto & label = root_label[ roots[ k ]];
+        if( label == none ) {
+            label = count;
+            count = count + 1;
+        }
+        roots[ k ] = label;
+    }
+    result.labels = std::move( roots );
+
+    result.offsets.assign( count + 1, 0 );
+    for( auto label : result.labels ) {
+        result.offsets[ label + 1 ] += 1;
+    }
+    for( size_t c = 0; c < count; c = c + 1 ) {
+        result.offsets[ c + 1 ] += result.offsets[ c ];
+    }
+
+    /* root_label is not needed anymore, reuse it as fill cursor. */
+    std::copy( result.offsets.begin(), result.offsets.end() - 1, root_label.begin() );
+    result.members.resize( n );
+    for( size_t k = 0; k < n; k = k + 1 ) {
+        auto & cursor = root_label[ result.labels[ k ]];
+        result.members[ cursor ] = k;
+        cursor = cursor + 1;
+    }
+    return result;
+}
+
+size_t
+thread_count( size_t threads, size_t work )
+{
+    if( threads == 0 ) {
+        threads = std::max< size_t >( 1, std::thread::hardware_concurrency() );
+    }
+    /* Not worth a thread below that. */
+    constexpr size_t min_work_per_thread = 4096;
+    return std::max< size_t >( 1, std::min( threads, work / min_work_per_thread ));
+}
+
+template< typename F >
+void
+parallel_blocks( size_t n, size_t threads, F const & f )
+/* Calls f( begin, end ) for contiguous blocks of [0, n). */
+{
+    threads = thread_count( threads, n );
+    auto block = (n + threads - 1) / threads;
+    parallel_for(
+        threads, threads,
+        [ &f, block, n ]( size_t t )
+        {
+            f( std::min( n, t * block ), std::min( n, (t + 1) * block ));
+        } );
+}
+
+constexpr unsigned rank_shift = 56;
+constexpr uint64_t index_mask = (uint64_t( 1 ) << rank_shift) - 1;
+}
+
+std::vector< std::vector< size_t > >
+union_find_classes_t::to_vectors() const
+{
+    std::vector< std::vector< size_t > > cs( size() );
+    for( size_t c = 0; c < cs.size(); c = c + 1 ) {
+        auto m = members_of( c );
+        cs[ c ].assign( m.begin(), m.end() );
+    }
+    return cs;
+}
+
+union_finder_t::union_finder_t( size_t num_elements )
+    : index_to_rep( num_elements )
+{
+    for( size_t k = 0; k < num_elements; k = k + 1 ) {
+        index_to_rep[ k ] = { k, 1 };
     }
-};
 }
 
 void
@@ -50,31 +132,135 @@ union_finder_t::add_relation( size_t a, size_t b)
                 }
             }
         };
-    
+
     unite_roots( find_root( index_to_rep, a ),
                  find_root( index_to_rep, b ));
 }
 
+size_t
+union_finder_t::find( size_t a )
+{
+    return find_root( index_to_rep, a );
+}
+
+union_find_classes_t
+union_finder_t::labels()
+{
+    std::vector< size_t > roots( index_to_rep.size() );
+    for( size_t k = 0; k < roots.size(); k = k + 1 ) {
+        roots[ k ] = find_root( index_to_rep, k );
+    }
+    return classes_from_roots( std::move( roots ));
+}
+
 std::vector< std::vector< size_t > >
 union_finder_t::classes()
 {
-    size_t current_index = 0;
-    std::unordered_map< size_t, size_t > root_to_output_index;
+    return labels().to_vectors();
+}
+
+concurrent_union_finder_t::concurrent_union_finder_t( size_t num_elements_ )
+    : num_elements( num_elements_ )
+{
+    if( num_elements > index_mask ) {
+        throw std::length_error( "Too many elements for concurrent_union_finder_t." );
+    }
+    parent = std::make_unique< std::atomic< uint64_t >[] >( num_elements );
+    for( size_t k = 0; k < num_elements; k = k + 1 ) {
+        parent[ k ].store( k, std::memory_order_relaxed );
+    }
+}
 
-    size_t tx = 0;
-    for( auto const & rep : index_to_rep ) {
-        auto root = find_root( index_to_rep, rep.root);
-        if( root_to_output_index.insert( { root, current_index } ).second ) {
-            current_index = current_index + 1;
+size_t
+concurrent_union_finder_t::find( size_t a )
+{
+    uint64_t x = a;
+    for( ;; ) {
+        auto w = parent[ x ].load( std::memory_order_acquire );
+        auto p = w & index_mask;
+        if( p == x ) {
+            return x;
+        }
+        auto g = parent[ p ].load( std::memory_order_acquire ) & index_mask;
+        if( g != p ) {
+            /* May fail if x got a new parent meanwhile, which is
+               fine: g is an ancestor of x either way. */
+            parent[ x ].compare_exchange_weak( w, (w & ~index_mask) | g,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed );
         }
+        x = g;
     }
-    std::vector< std::vector< size_t > > cs( root_to_output_index.size());
-    for( size_t k = 0; k < index_to_rep.size(); k = k + 1 ) {
-        auto root = find_root( index_to_rep, index_to_rep[ k ].root);
-        auto output_index = root_to_output_index[ root  ];
-        cs[ output_index ].push_back( k );
+}
+
+bool
+concurrent_union_finder_t::add_relation( size_t a, size_t b )
+{
+    for( ;; ) {
+        a = find( a );
+        b = find( b );
+        if( a == b ) {
+            return false;
+        }
+        auto w_a = parent[ a ].load( std::memory_order_acquire );
+        auto w_b = parent[ b ].load( std::memory_order_acquire );
+        if( ((w_a & index_mask) != a) or ((w_b & index_mask) != b) ) {
+            continue; /* no roots anymore */
+        }
+        /* Link the smaller (rank, index) below the larger one.  The
+           order is total and ranks only grow, so no cycles. */
+        auto r_a = w_a >> rank_shift;
+        auto r_b = w_b >> rank_shift;
+        if( (r_a > r_b) or ((r_a == r_b) and (a > b)) ) {
+            std::swap( a, b );
+            std::swap( w_a, w_b );
+            std::swap( r_a, r_b );
+        }
+        if( not parent[ a ].compare_exchange_strong( w_a, (r_a << rank_shift) | b,
+                                                     std::memory_order_acq_rel )) {
+            continue;
+        }
+        if( r_a == r_b ) {
+            /* Losing this race only costs balance, not correctness. */
+            parent[ b ].compare_exchange_strong( w_b, ((r_b + 1) << rank_shift) | b,
+                                                 std::memory_order_acq_rel );
+        }
+        return true;
     }
+}
 
-    return cs;
+void
+concurrent_union_finder_t::add_relations( std::span< std::pair< size_t, size_t > const > relations,
+                                          size_t threads )
+{
+    parallel_blocks(
+        relations.size(), threads,
+        [ this, relations ]( size_t begin, size_t end )
+        {
+            for( auto k = begin; k < end; k = k + 1 ) {
+                add_relation( relations[ k ].first, relations[ k ].second );
+            }
+        } );
+}
+
+union_find_classes_t
+concurrent_union_finder_t::labels( size_t threads )
+{
+    std::vector< size_t > roots( num_elements );
+    parallel_blocks(
+        num_elements, threads,
+        [ this, &roots ]( size_t begin, size_t end )
+        {
+            for( auto k = begin; k < end; k = k + 1 ) {
+                roots[ k ] = find( k );
+            }
+        } );
+    return classes_from_roots( std::move( roots ));
+}
+
+std::vector< std::vector< size_t > >
+concurrent_union_finder_t::classes( size_t threads )
+{
+    return labels( threads ).to_vectors();
 }
 }
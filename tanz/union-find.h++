@@ -2,18 +2,49 @@
 #pragma once
 #ifndef FILE_60E69869_FBF6C337739AA77_INCLUDED
 #define FILE_60E69869_FBF6C337739AA77_INCLUDED
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <utility>
 #include <vector>
-#include <unordered_map>
 
 namespace tz {
 /* Classical union-find algorithm with Tarjans heuristics.
    See https://en.wikipedia.org/wiki/Disjoint-set_data_structure */
 
+struct union_find_classes_t
+/* The classes in compressed form: labels[ k ] is the class of
+   element k, the members of class c are members[ offsets[ c ] ..
+   offsets[ c + 1 ] ).  Classes are numbered in the order of their
+   smallest element, members are sorted. */
+{
+    std::vector< size_t > labels;
+    std::vector< size_t > offsets;
+    std::vector< size_t > members;
+
+    size_t
+    size() const
+    {
+        return offsets.size() - 1;
+    }
+
+    std::span< size_t const >
+    members_of( size_t c ) const
+    {
+        return { members.data() + offsets[ c ], offsets[ c + 1 ] - offsets[ c ] };
+    }
+
+    std::vector< std::vector< size_t > >
+    to_vectors() const;
+};
+
 struct union_finder_t
 {
     struct prep_t {
         size_t root;
-        size_t size; /* not used ATM */
+        size_t size;
     };
 
     std::vector< prep_t > index_to_rep;
@@ -24,8 +55,55 @@ struct union_finder_t
     void
     add_relation( size_t a, size_t b);
 
+    size_t
+    find( size_t a );
+
+    union_find_classes_t
+    labels();
+
     std::vector< std::vector< size_t > >
     classes();
 };
+
+struct concurrent_union_finder_t
+/* Lock-free variant: add_relation() and find() may be called from
+   any number of threads at the same time.  Linking uses union by
+   rank with a compare-and-swap on the root, find() halves the path.
+   The rank lives in the top byte of the parent word.
+
+   labels() and classes() need all relations to be added, they must
+   not run concurrently with add_relation(). */
+{
+    explicit concurrent_union_finder_t( size_t num_elements );
+
+    size_t
+    size() const
+    {
+        return num_elements;
+    }
+
+    bool
+    add_relation( size_t a, size_t b );
+    /* False if a and b have been in the same class already. */
+
+    void
+    add_relations( std::span< std::pair< size_t, size_t > const > relations,
+                   size_t threads = 0 );
+    /* Splits the relations over threads, 0 means one per hardware
+       thread. */
+
+    size_t
+    find( size_t a );
+
+    union_find_classes_t
+    labels( size_t threads = 0 );
+
+    std::vector< std::vector< size_t > >
+    classes( size_t threads = 0 );
+
+private:
+    size_t num_elements;
+    std::unique_ptr< std::atomic< uint64_t >[] > parent;
+};
 }
 #endif
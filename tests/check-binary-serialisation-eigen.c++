@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include <sstream>
 #include <limits>
+#include <cstring>
 #include <tanz/binary-serialisation-eigen.h++>
 
 TEST( binary_serialisation_eigen, matrixXf )
@@ -329,3 +330,54 @@ TEST( binary_serialisation_eigen, affine2f )
 
     EXPECT_EQ( m.matrix(), m2.matrix());
 }
+
+TEST( binary_serialisation_eigen, vector_of_fixed_matrices_in_one_go )
+{
+    static_assert( tz::is_bitwise_serialisable_v< Eigen::Vector3d > );
+    static_assert( tz::is_bitwise_serialisable_v< Eigen::Matrix4f > );
+    static_assert( not tz::is_bitwise_serialisable_v< Eigen::VectorXd > );
+
+    std::vector< Eigen::Vector3d > a( 1000 );
+    for( auto & x : a ) {
+        x = Eigen::Vector3d::Random();
+    }
+
+    std::stringstream str;
+    str << tz::serialiser_t::start()
+        << a;
+
+    tz::memory_sink_t sink;
+    auto ser = tz::make_serialiser( sink );
+    ser << a;
+
+    auto expected = str.str();
+    ASSERT_EQ( expected.size(), sizeof( uint64_t ) + 1000 * 3 * sizeof( double ));
+    ASSERT_EQ( sink.size(), expected.size() );
+    EXPECT_EQ( 0, std::memcmp( sink.bytes().data(), expected.data(), expected.size()));
+
+    std::vector< Eigen::Vector3d > b;
+    auto des = tz::make_deserialiser( sink.bytes() );
+    des >> b;
+    EXPECT_EQ( a, b );
+}
+
+TEST( binary_serialisation_eigen, huge_sizes )
+{
+    for( auto size : { int64_t( 1 ) << 36, int64_t( -3 ), std::numeric_limits< int64_t >::max() } ) {
+        tz::memory_sink_t sink;
+        auto ser = tz::make_serialiser( sink );
+        ser << size << size << int64_t( 0 );
+
+        Eigen::MatrixXd a;
+        auto des_a = tz::make_deserialiser( sink.bytes() );
+        EXPECT_THROW( des_a >> a, std::runtime_error );
+
+        Eigen::Matrix< double, 3, Eigen::Dynamic > b;
+        auto des_b = tz::make_deserialiser( sink.bytes() );
+        EXPECT_THROW( des_b >> b, std::runtime_error );
+
+        Eigen::Matrix< float, Eigen::Dynamic, 2 > c;
+        auto des_c = tz::make_deserialiser( sink.bytes() );
+        EXPECT_THROW( des_c >> c, std::runtime_error );
+    }
+}
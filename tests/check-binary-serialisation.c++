@@ -1,6 +1,8 @@
 #include <gtest/gtest.h>
 #include <tanz/binary-serialisation.h++>
 #include <sstream>
+#include <cstdio>
+#include <cstring>
 
 
 TEST( serialisation, primitives )
@@ -359,3 +361,224 @@ TEST( serialisation, start_and_stop )
         EXPECT_EQ( x2_in, 1.234 );
     }
 }
+
+namespace {
+using mixed_t =
+    std::tuple< uint8_t,
+                std::vector< double >,
+                std::vector< std::complex< float > >,
+                std::vector< std::array< int16_t, 3 > >,
+                std::vector< std::vector< int8_t > >,
+                std::map< int32_t, std::vector< uint64_t > >,
+                std::optional< float > >;
+
+mixed_t
+mixed_example()
+{
+    return {
+        7,
+        { 1.0, 2.0, 3.5 },
+        { { 1.0f, -1.0f }, { 0.5f, 2.0f } },
+        { { 1, 2, 3 }, { -4, -5, -6 } },
+        { { 1, 2 }, {}, { -3 } },
+        { { 3, { 1, 2 } }, { -1, {} } },
+        2.5f };
+}
+}
+
+TEST( serialisation, memory_sink_same_format_as_stream )
+{
+    auto x = mixed_example();
+
+    std::stringstream str;
+    tz::serialiser_t ser{ &str };
+    ser << x;
+
+    tz::memory_sink_t sink( 1 ); // force growing
+    auto mser = tz::make_serialiser( sink );
+    mser << x;
+
+    auto expected = str.str();
+    ASSERT_EQ( sink.size(), expected.size() );
+    EXPECT_EQ( 0, std::memcmp( sink.bytes().data(), expected.data(), expected.size()));
+
+    mixed_t y;
+    auto des = tz::make_deserialiser( sink.bytes() );
+    des >> y;
+    des.check();
+    EXPECT_EQ( x, y );
+    EXPECT_EQ( des.remaining(), 0 );
+}
+
+TEST( serialisation, deserialiser_on_bytes_detects_truncation )
+{
+    tz::memory_sink_t sink;
+    auto ser = tz::make_serialiser( sink );
+    ser << std::vector< double >( 100, 1.0 );
+
+    auto bytes = sink.bytes().first( sink.size() - 1 );
+    {
+        std::vector< double > v;
+        auto des = tz::make_deserialiser( bytes );
+        EXPECT_THROW( des >> v, std::runtime_error );
+    }
+    {
+        uint64_t a;
+        auto des = tz::make_deserialiser( bytes.first( 4 ));
+        des >> a;
+        EXPECT_THROW( des.check(), std::runtime_error );
+    }
+}
+
+TEST( serialisation, array_view )
+{
+    std::vector< std::complex< double > > x = { { 1, 2 }, { 3, 4 }, { 5, 6 } };
+
+    tz::memory_sink_t sink;
+    auto ser = tz::make_serialiser( sink );
+    ser << uint8_t( 1 ) << x << uint16_t( 0xabc );
+
+    uint8_t a = 0;
+    uint16_t b = 0;
+    tz::array_view_t< std::complex< double > > view;
+    auto des = tz::make_deserialiser( sink.bytes() );
+    des >> a >> view >> b;
+
+    EXPECT_EQ( b, 0xabc );
+    ASSERT_EQ( view.size(), 3 );
+    EXPECT_EQ( view[ 1 ], std::complex< double >( 3, 4 ));
+    EXPECT_EQ( view.to_vector(), x );
+    EXPECT_EQ( view.bytes.data(), sink.bytes().data() + 1 + 8 ); // no copy
+    EXPECT_FALSE( view.aligned() );
+    EXPECT_THROW( view.span(), std::runtime_error );
+
+    std::stringstream str;
+    tz::deserialiser_t sdes{ &str };
+    EXPECT_THROW( sdes.view( 0 ), std::logic_error );
+}
+
+TEST( serialisation, mapped_file_roundtrip )
+{
+    auto path = testing::TempDir() + "tanz-mapped-file-roundtrip";
+    std::vector< uint32_t > big( 5000000 );
+    for( size_t k = 0; k < big.size(); k = k + 1 ) {
+        big[ k ] = k;
+    }
+    auto x = mixed_example();
+    tz::memory_sink_t reference;
+    auto rser = tz::make_serialiser( reference );
+    rser << x << big;
+
+    {
+        tz::mapped_file_sink_t sink( path );
+        auto ser = tz::make_serialiser( sink );
+        ser << x << big;
+        EXPECT_EQ( sink.size(), reference.size() );
+    }
+
+    tz::mapped_file_t file( path );
+    ASSERT_EQ( file.bytes().size(), reference.size() );
+    EXPECT_EQ( 0, std::memcmp( file.bytes().data(), reference.bytes().data(), reference.size()));
+
+    mixed_t y;
+    tz::array_view_t< uint32_t > view;
+    auto des = tz::make_deserialiser( file.bytes() );
+    des >> y >> view;
+    des.check();
+    EXPECT_EQ( x, y );
+    ASSERT_EQ( view.size(), big.size() );
+    EXPECT_EQ( view[ 4999999 ], 4999999 );
+    EXPECT_EQ( view.to_vector(), big );
+    std::remove( path.c_str());
+}
+
+namespace {
+template< typename T >
+void
+expect_rejected( uint64_t len )
+/* A length prefix followed by a few bytes must fail without
+   allocating for len elements or looping len times. */
+{
+    tz::memory_sink_t sink;
+    auto ser = tz::make_serialiser( sink );
+    ser << len << uint64_t( 1 ) << uint64_t( 2 );
+
+    T v;
+    auto des = tz::make_deserialiser( sink.bytes() );
+    EXPECT_THROW( des >> v, std::runtime_error ) << len;
+
+    std::stringstream str;
+    str.write( reinterpret_cast< char const * >( sink.bytes().data()), sink.size() );
+    tz::deserialiser_t sdes{ &str };
+    T w;
+    EXPECT_THROW( sdes >> w, std::runtime_error ) << len;
+}
+
+template< typename T >
+void
+expect_all_rejected()
+{
+    for( auto len : { uint64_t( 1 ) << 28, uint64_t( 1 ) << 36, ~uint64_t( 0 ) - 1, ~uint64_t( 0 ) } ) {
+        expect_rejected< T >( len );
+    }
+}
+}
+
+TEST( serialisation, huge_length_prefixes )
+{
+    expect_all_rejected< std::vector< double > >();
+    expect_all_rejected< std::vector< std::vector< uint8_t > > >();
+    expect_all_rejected< std::map< uint64_t, uint64_t > >();
+    expect_all_rejected< std::map< uint8_t, std::vector< int > > >();
+    expect_all_rejected< std::unordered_map< uint32_t, double > >();
+
+    for( auto len : { uint64_t( 1 ) << 36, ~uint64_t( 0 ) } ) {
+        tz::memory_sink_t sink;
+        auto ser = tz::make_serialiser( sink );
+        ser << len << uint64_t( 1 );
+        tz::array_view_t< double > view;
+        auto des = tz::make_deserialiser( sink.bytes() );
+        EXPECT_THROW( des >> view, std::runtime_error );
+    }
+}
+
+namespace {
+struct empty_t
+{
+    bool operator == ( empty_t const & ) const = default;
+};
+
+tz::serialiser_t &
+operator << ( tz::serialiser_t & out, empty_t const & )
+{
+    return out;
+}
+
+tz::deserialiser_t &
+operator >> ( tz::deserialiser_t & in, empty_t & )
+{
+    return in;
+}
+}
+
+TEST( serialisation, containers_of_zero_byte_elements )
+{
+    static_assert( tz::impl::min_serialised_size_v< empty_t > == 0 );
+    static_assert( tz::impl::min_serialised_size_v< std::tuple<> > == 0 );
+    static_assert( tz::impl::min_serialised_size_v< std::pair< empty_t, uint32_t > > == 4 );
+
+    std::vector< empty_t > x( 10000 );
+    std::map< uint8_t, std::tuple<> > m{{ 1, {} }, { 2, {} }};
+    tz::memory_sink_t sink;
+    auto ser = tz::make_serialiser( sink );
+    ser << x << m;
+
+    std::vector< empty_t > y;
+    std::map< uint8_t, std::tuple<> > n;
+    auto des = tz::make_deserialiser( sink.bytes() );
+    des >> y >> n;
+    des.check();
+    EXPECT_EQ( x, y );
+    EXPECT_EQ( m, n );
+    EXPECT_EQ( des.remaining(), 0 );
+}
@@ -1,6 +1,8 @@
 #include <tanz/conics.h++>
 #include <gtest/gtest.h>
 #include <Eigen/Geometry>
+#include <algorithm>
+#include <random>
 
 TEST( conics, conic_matrix )
 {
@@ -223,3 +225,81 @@ TEST( conics, fit_ellipsis_1_2_rotated_shifted )
             .isApprox( Eigen::Vector2d( 3.0, -12.0 )));
     }
 }
+
+TEST( conics, robust_estimation )
+{
+    std::mt19937 rng( 5 );
+    std::uniform_real_distribution< double > angle( 0.0, 2.0 * M_PI );
+    std::uniform_real_distribution< double > position( -20.0, 20.0 );
+    std::normal_distribution< double > jitter( 0.0, 0.01 );
+    std::bernoulli_distribution is_outlier( 0.3 );
+
+    /* a = 3, b = 5, rotated and shifted */
+    auto transform = Eigen::Translation2d( 2.0, -4.0 ) * Eigen::Rotation2Dd( 0.4 );
+    std::vector< Eigen::Vector2d > obs;
+    std::vector< bool > outlier;
+    for( int k = 0; k < 300; k = k + 1 ) {
+        auto t = angle( rng );
+        Eigen::Vector2d p = transform * Eigen::Vector2d( 3.0 * std::cos( t ), 5.0 * std::sin( t ));
+        bool out = is_outlier( rng );
+        if( out ) {
+            p = Eigen::Vector2d( position( rng ), position( rng ));
+        } else {
+            p += Eigen::Vector2d( jitter( rng ), jitter( rng ));
+        }
+        obs.push_back( p );
+        outlier.push_back( out );
+    }
+
+    tz::ransac_options_t options;
+    options.threshold = 0.05;
+    options.threads = 2;
+    auto result = tz::estimate_conic_params( obs, options );
+    EXPECT_TRUE( tz::conic_center( result.params ).isApprox( Eigen::Vector2d( 2.0, -4.0 ), 1e-2 ));
+    auto canonical = tz::conic_canonical_params( result.params );
+    EXPECT_NEAR( 1 / std::sqrt( canonical[ 0 ] ), 3.0, 1e-2 );
+    EXPECT_NEAR( 1 / std::sqrt( canonical[ 2 ] ), 5.0, 1e-2 );
+
+    size_t wrong = 0;
+    for( auto k : result.inliers ) {
+        wrong = wrong + (outlier[ k ] ? 1 : 0);
+    }
+    size_t outliers = std::count( outlier.begin(), outlier.end(), true );
+    EXPECT_LE( wrong, 3u );
+    EXPECT_GE( result.inliers.size(), 300 - outliers - 3 );
+
+    EXPECT_THROW( tz::estimate_conic_params( std::vector< Eigen::Vector2d >( 4 )), std::domain_error );
+}
+
+TEST( conics, robust_estimation_mostly_collinear )
+{
+    std::mt19937 rng( 7 );
+    std::uniform_real_distribution< double > angle( 0.0, 2.0 * M_PI );
+    std::uniform_real_distribution< double > along( -20.0, 20.0 );
+    std::normal_distribution< double > jitter( 0.0, 0.01 );
+
+    /* 160 points on y = x / 2 + 1, 100 on an ellipse with a = 3,
+       b = 5 around (2, -4).  Conics through three of the collinear
+       points, pairs of lines or thin ones along the line, would fit
+       more points than the ellipse. */
+    auto transform = Eigen::Translation2d( 2.0, -4.0 ) * Eigen::Rotation2Dd( 0.4 );
+    std::vector< Eigen::Vector2d > obs;
+    for( int k = 0; k < 160; k = k + 1 ) {
+        auto x = along( rng );
+        obs.push_back( Eigen::Vector2d( x, 0.5 * x + 1.0 ) + Eigen::Vector2d( jitter( rng ), jitter( rng )));
+    }
+    for( int k = 0; k < 100; k = k + 1 ) {
+        auto t = angle( rng );
+        Eigen::Vector2d p = transform * Eigen::Vector2d( 3.0 * std::cos( t ), 5.0 * std::sin( t ));
+        obs.push_back( p + Eigen::Vector2d( jitter( rng ), jitter( rng )));
+    }
+
+    tz::ransac_options_t options;
+    options.threshold = 0.05;
+    auto result = tz::estimate_conic_params( obs, options );
+    EXPECT_TRUE( tz::conic_center( result.params ).isApprox( Eigen::Vector2d( 2.0, -4.0 ), 1e-2 ));
+    size_t on_line = std::count_if( result.inliers.begin(), result.inliers.end(),
+                                    []( size_t k ) { return k < 160; } );
+    EXPECT_LE( on_line, 3u );
+    EXPECT_GE( result.inliers.size(), 97u );
+}
@@ -0,0 +1,176 @@
+#include <gtest/gtest.h>
+#include <tanz/dsp.h++>
+#include <random>
+
+namespace {
+
+Eigen::MatrixXf
+random_matrix( Eigen::Index rows, Eigen::Index cols, unsigned seed )
+{
+    std::mt19937 rng( seed );
+    std::uniform_real_distribution< float > d( -1.0f, 1.0f );
+    Eigen::MatrixXf m( rows, cols );
+    for( Eigen::Index k = 0; k < m.size(); k = k + 1 ) {
+        m.data()[ k ] = d( rng );
+    }
+    return m;
+}
+
+Eigen::MatrixXf
+reference_rows( Eigen::MatrixXf const & a, Eigen::VectorXf const & b, tz::convolution_border_handling_t border )
+/* y[ i ] = sum over j of b[ j ] * x[ i + c - j ] */
+{
+    auto n = a.cols();
+    auto k = b.size();
+    auto discard = (border == tz::CONV_BORDER_DISCARD);
+    auto outputs = discard ? std::max< Eigen::Index >( 0, n - k + 1 ) : n;
+    auto c = discard ? k - 1 : (k - 1) / 2;
+    Eigen::MatrixXf h( a.rows(), outputs );
+    for( Eigen::Index r = 0; r < a.rows(); r = r + 1 ) {
+        for( Eigen::Index i = 0; i < outputs; i = i + 1 ) {
+            double sum = 0.0;
+            for( Eigen::Index j = 0; j < k; j = j + 1 ) {
+                auto t = i + c - j;
+                auto src = discard ? t : tz::impl::border_index( t, n, border );
+                if( src >= 0 ) {
+                    sum = sum + double( b( j )) * a( r, src );
+                }
+            }
+            h( r, i ) = float( sum );
+        }
+    }
+    return h;
+}
+
+void
+expect_near( Eigen::MatrixXf const & x, Eigen::MatrixXf const & y, float tolerance )
+{
+    ASSERT_EQ( x.rows(), y.rows() );
+    ASSERT_EQ( x.cols(), y.cols() );
+    if( x.size() ) {
+        EXPECT_LT( (x - y).cwiseAbs().maxCoeff(), tolerance );
+    }
+}
+}
+
+TEST( dsp, border_index )
+{
+    using tz::impl::border_index;
+    /* 0 1 2 3 */
+    EXPECT_EQ( border_index( -1, 4, tz::CONV_BORDER_MIRROR ), 1 );
+    EXPECT_EQ( border_index( -3, 4, tz::CONV_BORDER_MIRROR ), 3 );
+    EXPECT_EQ( border_index( 4, 4, tz::CONV_BORDER_MIRROR ), 2 );
+    EXPECT_EQ( border_index( 9, 4, tz::CONV_BORDER_MIRROR ), 3 );
+    EXPECT_EQ( border_index( -2, 4, tz::CONV_BORDER_CLAMP ), 0 );
+    EXPECT_EQ( border_index( 7, 4, tz::CONV_BORDER_CLAMP ), 3 );
+    EXPECT_EQ( border_index( -1, 4, tz::CONV_BORDER_WRAP ), 3 );
+    EXPECT_EQ( border_index( 9, 4, tz::CONV_BORDER_WRAP ), 1 );
+    EXPECT_EQ( border_index( -1, 4, tz::CONV_BORDER_ZERO ), -1 );
+    EXPECT_EQ( border_index( 5, 1, tz::CONV_BORDER_MIRROR ), 0 );
+}
+
+TEST( dsp, rows_match_reference )
+{
+    for( auto border : { tz::CONV_BORDER_DISCARD, tz::CONV_BORDER_MIRROR, tz::CONV_BORDER_ZERO,
+                         tz::CONV_BORDER_CLAMP, tz::CONV_BORDER_WRAP } ) {
+        for( auto method : { tz::CONV_METHOD_DIRECT, tz::CONV_METHOD_FFT, tz::CONV_METHOD_AUTO } ) {
+            /* Few rows go line by line, many through whole columns. */
+            for( Eigen::Index rows : { 3, 40 } ) {
+                for( Eigen::Index k : { 1, 2, 5, 70 } ) {
+                    auto a = random_matrix( rows, 300, unsigned( k ));
+                    Eigen::VectorXf b = random_matrix( k, 1, unsigned( k + 1 ));
+                    tz::convolution_options_t options;
+                    options.border = border;
+                    options.method = method;
+                    options.threads = 3;
+                    SCOPED_TRACE( ::testing::Message() << "border " << border << " method " << method
+                                  << " rows " << rows << " k " << k );
+                    expect_near( tz::convolve_rows( a, b, options ), reference_rows( a, b, border ), 1e-4f );
+                    Eigen::MatrixXf at = a.transpose();
+                    Eigen::MatrixXf expected = reference_rows( a, b, border ).transpose();
+                    expect_near( tz::convolve_cols( at, b, options ), expected, 1e-4f );
+                }
+            }
+        }
+    }
+}
+
+TEST( dsp, short_signals )
+{
+    Eigen::MatrixXf a = random_matrix( 2, 3, 7 );
+    Eigen::VectorXf b = random_matrix( 5, 1, 8 );
+    EXPECT_EQ( tz::convolve_rows( a, b ).cols(), 0 );
+    expect_near( tz::convolve_rows( a, b, tz::CONV_BORDER_MIRROR ),
+                 reference_rows( a, b, tz::CONV_BORDER_MIRROR ), 1e-5f );
+    EXPECT_THROW( tz::convolve_rows( a, Eigen::VectorXf() ), std::invalid_argument );
+}
+
+TEST( dsp, errors_reach_the_caller )
+{
+    auto a = random_matrix( 40, 4000, 9 );
+    Eigen::VectorXf b = random_matrix( 70, 1, 10 );
+    tz::convolution_options_t options;
+    options.threads = 4;
+    options.border = static_cast< tz::convolution_border_handling_t >( 17 );
+    for( auto method : { tz::CONV_METHOD_DIRECT, tz::CONV_METHOD_FFT } ) {
+        options.method = method;
+        EXPECT_THROW( tz::convolve_rows( a, b, options ), std::invalid_argument );
+        EXPECT_THROW( tz::convolve_cols( a, b, options ), std::invalid_argument );
+    }
+}
+
+TEST( dsp, legacy_convolve_and_double )
+{
+    Eigen::MatrixXf a = random_matrix( 4, 20, 3 );
+    Eigen::MatrixXf h = tz::convolve( a, tz::kernel_deriv_1d_3() );
+    ASSERT_EQ( h.cols(), 18 );
+    EXPECT_FLOAT_EQ( h( 1, 4 ), a( 1, 6 ) - a( 1, 4 ));
+
+    Eigen::MatrixXd d = a.cast< double >();
+    Eigen::MatrixXd hd = tz::convolve_rows( d, tz::kernel_deriv_1d_3< double >() );
+    EXPECT_LT( (hd.cast< float >() - h).cwiseAbs().maxCoeff(), 1e-6f );
+}
+
+TEST( dsp, separable )
+{
+    auto a = random_matrix( 30, 25, 11 );
+    Eigen::VectorXf rk = random_matrix( 3, 1, 12 );
+    Eigen::VectorXf ck = random_matrix( 4, 1, 13 );
+    tz::convolution_options_t options;
+    options.border = tz::CONV_BORDER_WRAP;
+    auto h = tz::convolve_separable( a, rk, ck, options );
+
+    /* Directly in 2D. */
+    Eigen::MatrixXf expected( a.rows(), a.cols() );
+    for( Eigen::Index r = 0; r < a.rows(); r = r + 1 ) {
+        for( Eigen::Index c = 0; c < a.cols(); c = c + 1 ) {
+            double sum = 0.0;
+            for( Eigen::Index i = 0; i < ck.size(); i = i + 1 ) {
+                for( Eigen::Index j = 0; j < rk.size(); j = j + 1 ) {
+                    auto rr = tz::impl::border_index( r + (ck.size() - 1) / 2 - i, a.rows(), options.border );
+                    auto cc = tz::impl::border_index( c + (rk.size() - 1) / 2 - j, a.cols(), options.border );
+                    sum = sum + double( ck( i )) * rk( j ) * a( rr, cc );
+                }
+            }
+            expected( r, c ) = float( sum );
+        }
+    }
+    expect_near( h, expected, 1e-4f );
+}
+
+TEST( dsp, cols_spectrum )
+{
+    auto a = random_matrix( 12, 5, 17 );
+    auto f = tz::cols_spectrum( a, 2 );
+    ASSERT_EQ( f.rows(), 12 );
+    for( Eigen::Index c = 0; c < a.cols(); c = c + 1 ) {
+        for( Eigen::Index k = 0; k < a.rows(); k = k + 1 ) {
+            std::complex< double > sum( 0.0, 0.0 );
+            for( Eigen::Index t = 0; t < a.rows(); t = t + 1 ) {
+                sum = sum + std::polar( double( a( t, c )), -2.0 * M_PI * double( k * t ) / double( a.rows() ));
+            }
+            EXPECT_NEAR( f( k, c ).real(), sum.real(), 1e-4 );
+            EXPECT_NEAR( f( k, c ).imag(), sum.imag(), 1e-4 );
+        }
+    }
+}
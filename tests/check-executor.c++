@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+#include <tanz/executor.h++>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+TEST( executor, runs_everything_before_destruction )
+{
+    std::atomic< int > done( 0 );
+    {
+        tz::work_stealing_pool_t pool( 3 );
+        EXPECT_EQ( pool.thread_count(), 3u );
+        for( int k = 0; k < 1000; k = k + 1 ) {
+            pool.submit(
+                [ &pool, &done, k ]()
+                {
+                    if( k % 10 == 0 ) {
+                        /* From a worker, into its own queue. */
+                        pool.submit( [ &done ]() { done += 1; } );
+                    }
+                    done += 1;
+                } );
+        }
+    }
+    EXPECT_EQ( done, 1100 );
+}
+
+TEST( executor, higher_priorities_first )
+{
+    tz::work_stealing_pool_t pool( 1 );
+    std::mutex mtx;
+    std::vector< int > order;
+    std::atomic< bool > started( false );
+    std::atomic< bool > release( false );
+
+    /* Keeps the only worker busy while the others are queued. */
+    pool.submit(
+        [ & ]()
+        {
+            started = true;
+            while( not release ) {
+                std::this_thread::sleep_for( std::chrono::milliseconds( 1 ));
+            }
+        } );
+    while( not started ) {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ));
+    }
+    auto record =
+        [ & ]( int x )
+        {
+            return [ &, x ]()
+            {
+                std::lock_guard< std::mutex > lock( mtx );
+                order.push_back( x );
+            };
+        };
+    pool.submit( record( 0 ), tz::EXECUTOR_PRIORITY_LOW );
+    pool.submit( record( 1 ), tz::EXECUTOR_PRIORITY_NORMAL );
+    pool.submit( record( 2 ), tz::EXECUTOR_PRIORITY_HIGH );
+    pool.submit( record( 3 ), tz::EXECUTOR_PRIORITY_NORMAL );
+    EXPECT_EQ( pool.queued(), 4u );
+    release = true;
+    for( ;; ) {
+        {
+            std::lock_guard< std::mutex > lock( mtx );
+            if( order.size() == 4 ) {
+                break;
+            }
+        }
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ));
+    }
+    std::lock_guard< std::mutex > lock( mtx );
+    EXPECT_EQ( order, std::vector< int >( { 2, 1, 3, 0 } ));
+}
+
+TEST( executor, parallel_for )
+{
+    std::vector< std::atomic< int > > calls( 1000 );
+    tz::parallel_for( calls.size(), 4, [ & ]( size_t k ) { calls[ k ] += 1; } );
+    for( auto & c : calls ) {
+        EXPECT_EQ( c.load(), 1 );
+    }
+
+    /* From inside the only worker of a pool, the helpers never start
+       before the calling task is done. */
+    tz::work_stealing_pool_t pool( 1 );
+    std::atomic< int > sum( 0 );
+    std::atomic< bool > finished( false );
+    pool.submit(
+        [ & ]()
+        {
+            tz::parallel_for( 100, 8, [ & ]( size_t k ) { sum += int( k ); }, pool );
+            finished = true;
+        } );
+    while( not finished ) {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ));
+    }
+    EXPECT_EQ( sum.load(), 4950 );
+}
+
+TEST( executor, parallel_for_rethrows )
+{
+    std::atomic< int > running( 0 );
+    std::atomic< int > calls( 0 );
+    EXPECT_THROW(
+        tz::parallel_for(
+            1000, 4,
+            [ & ]( size_t k )
+            {
+                running += 1;
+                calls += 1;
+                std::this_thread::sleep_for( std::chrono::microseconds( 100 ));
+                running -= 1;
+                if( k == 3 ) {
+                    throw std::runtime_error( "block 3" );
+                }
+            } ),
+        std::runtime_error );
+    EXPECT_EQ( running.load(), 0 ); // nothing left behind
+    EXPECT_LT( calls.load(), 1000 );
+}
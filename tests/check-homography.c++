@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
 #include <tanz/homography.h++>
+#include <algorithm>
+#include <atomic>
+#include <random>
 
 TEST( homography, identity )
 {
@@ -68,3 +71,106 @@ TEST( homography, random )
                                    {r0, r1, r2, r3, r4, r5} );
     EXPECT_TRUE( h.isApprox( correct ) );
 }
+
+namespace {
+
+struct synthetic_t {
+    Eigen::Matrix3d h;
+    std::vector< Eigen::Vector2d > left;
+    std::vector< Eigen::Vector2d > right;
+    std::vector< bool > outlier;
+};
+
+synthetic_t
+synthetic_correspondences( size_t n, double outlier_ratio, double noise, unsigned seed )
+{
+    std::mt19937 rng( seed );
+    std::uniform_real_distribution< double > position( 0.0, 1000.0 );
+    std::normal_distribution< double > jitter( 0.0, noise );
+    std::bernoulli_distribution is_outlier( outlier_ratio );
+
+    synthetic_t s;
+    s.h <<
+        0.9, 0.1, 30.0,
+        -0.05, 1.1, -20.0,
+        1e-4, -5e-5, 1.0;
+    for( size_t k = 0; k < n; k = k + 1 ) {
+        Eigen::Vector2d r( position( rng ), position( rng ));
+        Eigen::Vector2d l = (s.h * r.homogeneous()).hnormalized();
+        bool out = is_outlier( rng );
+        if( out ) {
+            l = Eigen::Vector2d( position( rng ), position( rng ));
+        } else {
+            l += Eigen::Vector2d( jitter( rng ), jitter( rng ));
+        }
+        s.left.push_back( l );
+        s.right.push_back( r );
+        s.outlier.push_back( out );
+    }
+    return s;
+}
+}
+
+TEST( homography, robust_estimation )
+{
+    auto s = synthetic_correspondences( 500, 0.4, 0.3, 1 );
+    tz::ransac_options_t options;
+    options.threshold = 2.0;
+    for( size_t threads : { 1, 3 } ) {
+        options.threads = threads;
+        auto result = tz::estimate_homography_2d( s.left, s.right, options );
+        EXPECT_LT( (result.homography - s.h).norm() / s.h.norm(), 1e-3 );
+        size_t wrong = 0;
+        for( auto k : result.inliers ) {
+            wrong = wrong + (s.outlier[ k ] ? 1 : 0);
+        }
+        size_t outliers = std::count( s.outlier.begin(), s.outlier.end(), true );
+        EXPECT_LE( wrong, 2u );
+        EXPECT_GE( result.inliers.size(), 500 - outliers - 2 );
+        EXPECT_LT( result.hypotheses, options.max_hypotheses );
+    }
+
+    options.threads = 1;
+    auto a = tz::estimate_homography_2d( s.left, s.right, options );
+    auto b = tz::estimate_homography_2d( s.left, s.right, options );
+    EXPECT_EQ( a.inliers, b.inliers );
+    EXPECT_EQ( a.hypotheses, b.hypotheses );
+}
+
+TEST( homography, robust_estimation_failures )
+{
+    std::vector< Eigen::Vector2d > three( 3, Eigen::Vector2d::Zero() );
+    EXPECT_THROW( tz::estimate_homography_2d( three, three ), std::domain_error );
+
+    /* All on one line: every sample is degenerate. */
+    std::vector< Eigen::Vector2d > line;
+    for( int k = 0; k < 20; k = k + 1 ) {
+        line.emplace_back( k, 2 * k );
+    }
+    tz::ransac_options_t options;
+    options.max_hypotheses = 100;
+    EXPECT_THROW( tz::estimate_homography_2d( line, line, options ), std::domain_error );
+}
+
+TEST( homography, ransac_rethrows )
+/* An exception in any thread ends up with the caller, the search
+   stops early and nothing is left running. */
+{
+    tz::ransac_options_t options;
+    options.threads = 4;
+    options.max_hypotheses = 100000;
+    std::atomic< size_t > solved( 0 );
+    auto solve =
+        [ & ]( std::array< size_t, 4 > const & sample, int & model )
+        {
+            solved += 1;
+            if( sample[ 0 ] == 7 ) {
+                throw std::runtime_error( "solver failed" );
+            }
+            model = int( sample[ 0 ] );
+            return true;
+        };
+    auto count = []( int, size_t ) { return size_t( 0 ); };
+    EXPECT_THROW( ( tz::ransac< 4, int >( 100, options, solve, count )), std::runtime_error );
+    EXPECT_LT( solved.load(), options.max_hypotheses );
+}
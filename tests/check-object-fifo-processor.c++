@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+#include <tanz/object-fifo-processor.h++>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+template< typename processor_t >
+std::thread
+feed( processor_t & proc, int n )
+{
+    return std::thread(
+        [ &proc, n ]()
+        {
+            try {
+                for( int k = 0; k < n; k = k + 1 ) {
+                    proc.write_blockingly( k );
+                }
+            } catch( tz::fifo_is_closed const & ) {
+            }
+            proc.close();
+        });
+}
+
+template< typename processor_t >
+auto
+drain( processor_t & proc )
+{
+    std::vector< typename processor_t::output_type > out;
+    try {
+        for( ;; ) {
+            out.push_back( proc.read_blockingly() );
+        }
+    } catch( tz::fifo_is_closed const & ) {
+    }
+    return out;
+}
+}
+
+TEST( object_fifo_processor, no_stages )
+{
+    auto proc = tz::make_object_fifo_processor< int >( 4 );
+    auto feeder = feed( proc, 100 );
+    auto out = drain( proc );
+    feeder.join();
+    proc.wait();
+
+    ASSERT_EQ( out.size(), 100 );
+    for( int k = 0; k < 100; k = k + 1 ) {
+        EXPECT_EQ( out[ k ], k );
+    }
+    EXPECT_TRUE( proc.statistics().empty() );
+}
+
+TEST( object_fifo_processor, ordered_stages )
+{
+    constexpr int n = 2000;
+    auto proc =
+        tz::make_object_fifo_processor< int >( 4 )
+        .then( 4,
+               []( int x )
+               {
+                   if( x % 7 == 0 ) {
+                       std::this_thread::yield();
+                   }
+                   return 2 * x;
+               })
+        .then( 3,
+               []( int x ) { return std::to_string( x ); },
+               tz::FIFO_ORDER_KEEP,
+               2 );
+
+    auto feeder = feed( proc, n );
+    auto out = drain( proc );
+    feeder.join();
+    proc.wait();
+
+    ASSERT_EQ( out.size(), n );
+    for( int k = 0; k < n; k = k + 1 ) {
+        EXPECT_EQ( out[ k ], std::to_string( 2 * k ));
+    }
+
+    auto stats = proc.statistics();
+    ASSERT_EQ( stats.size(), 2 );
+    EXPECT_EQ( stats[ 0 ].workers, 4 );
+    EXPECT_EQ( stats[ 1 ].workers, 3 );
+    EXPECT_EQ( stats[ 0 ].processed, n );
+    EXPECT_EQ( stats[ 1 ].processed, n );
+    EXPECT_EQ( stats[ 0 ].queue_depth, 0 );
+    EXPECT_GT( stats[ 0 ].busy_time, 0.0 );
+}
+
+TEST( object_fifo_processor, unordered_ring_backend )
+{
+    constexpr int n = 2000;
+    auto proc =
+        tz::make_object_fifo_processor< int, tz::fifo_backend_mpmc_ring >( 8 )
+        .then( 3, []( int x ) { return int64_t( x ) * x; } );
+
+    auto feeder = feed( proc, n );
+    auto out = drain( proc );
+    feeder.join();
+    proc.wait();
+
+    ASSERT_EQ( out.size(), n );
+    std::sort( out.begin(), out.end() );
+    for( int k = 0; k < n; k = k + 1 ) {
+        EXPECT_EQ( out[ k ], int64_t( k ) * k );
+    }
+}
+
+TEST( object_fifo_processor, worker_exception_shuts_down )
+{
+    auto proc =
+        tz::make_object_fifo_processor< int >( 4 )
+        .then( 2, []( int x ) { return x + 1; } )
+        .then( 2,
+               []( int x )
+               {
+                   if( x == 50 ) {
+                       throw std::runtime_error( "fifty" );
+                   }
+                   return x;
+               });
+
+    auto feeder = feed( proc, 100000 );
+    auto out = drain( proc );
+    feeder.join();
+
+    EXPECT_LT( out.size(), 100000 );
+    EXPECT_THROW( proc.wait(), std::runtime_error );
+}
+
+TEST( object_fifo_processor, cancelled_from_downstream )
+{
+    auto proc =
+        tz::make_object_fifo_processor< int >( 2 )
+        .then( 2, []( int x ) { return x; } )
+        .then( 2, []( int x ) { return x; } );
+
+    auto feeder = feed( proc, 100000 );
+    for( int k = 0; k < 10; k = k + 1 ) {
+        proc.read_blockingly();
+    }
+    proc.output_fifo()->close();
+    feeder.join(); // terminates, since the close travels upstream
+    proc.wait();
+    EXPECT_TRUE( proc.input_fifo()->closed() );
+}
+
+TEST( object_fifo_processor, slow_element_bounds_reordering )
+/* While one worker is stuck on element 10 the others would finish
+   everything after it.  Only what fits the window may be held back. */
+{
+    constexpr int n = 500;
+    constexpr size_t depth = 4;
+    auto proc =
+        tz::make_object_fifo_processor< int >( 64 )
+        .then( 4,
+               []( int x )
+               {
+                   if( x == 10 ) {
+                       std::this_thread::sleep_for( std::chrono::milliseconds( 100 ));
+                   }
+                   return x;
+               },
+               tz::FIFO_ORDER_KEEP,
+               depth );
+
+    auto feeder = feed( proc, n );
+    auto out = drain( proc );
+    feeder.join();
+    proc.wait();
+
+    ASSERT_EQ( out.size(), n );
+    for( int k = 0; k < n; k = k + 1 ) {
+        EXPECT_EQ( out[ k ], k );
+    }
+    auto stats = proc.statistics();
+    ASSERT_EQ( stats.size(), 1 );
+    EXPECT_GT( stats[ 0 ].reorder_peak, 0 );
+    EXPECT_LT( stats[ 0 ].reorder_peak, depth );
+}
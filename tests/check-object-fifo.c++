@@ -1,5 +1,9 @@
 #include <gtest/gtest.h>
 #include <tanz/object-fifo.h++>
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
 
 TEST( object_fifo, io )
 {
@@ -194,3 +198,381 @@ TEST( fifo_guard, some_tests )
     }
 
 }
+
+TEST( object_fifo, move_and_batch )
+{
+    using fifo_t = tz::object_fifo< std::unique_ptr< int > >;
+
+    fifo_t fifo( 4 );
+    fifo.write_blockingly( std::make_unique< int >( 1 ));
+    fifo.write_overwrite( std::make_unique< int >( 2 ));
+
+    std::vector< std::unique_ptr< int > > in;
+    in.push_back( std::make_unique< int >( 3 ));
+    in.push_back( std::make_unique< int >( 4 ));
+    fifo.write_batch( std::make_move_iterator( in.begin()),
+                      std::make_move_iterator( in.end()));
+    EXPECT_TRUE( fifo.full() );
+
+    std::vector< std::unique_ptr< int > > out;
+    EXPECT_EQ( fifo.read_batch( std::back_inserter( out ), 3 ), 3 );
+    EXPECT_EQ( fifo.read_batch( std::back_inserter( out ), 3 ), 1 );
+    ASSERT_EQ( out.size(), 4 );
+    for( int k = 0; k < 4; k = k + 1 ) {
+        EXPECT_EQ( *out[ k ], k + 1 );
+    }
+
+    fifo.close();
+    EXPECT_THROW( fifo.read_batch( std::back_inserter( out ), 3 ), tz::fifo_is_closed );
+}
+
+namespace {
+
+template< typename backend >
+void
+check_ring_io()
+{
+    using fifo_t = tz::object_fifo< double, backend >;
+
+    EXPECT_THROW( fifo_t( 0 ), tz::fifo_max_size_must_be_positive );
+
+    fifo_t fifo( 2 );
+
+    EXPECT_FALSE( fifo.closed() );
+    EXPECT_TRUE( fifo.empty());
+    EXPECT_FALSE( fifo.full() );
+
+    fifo.write_blockingly( 1.0 );
+    EXPECT_FALSE( fifo.empty() );
+    EXPECT_FALSE( fifo.full() );
+
+    EXPECT_EQ( fifo.read_blockingly(), 1.0 );
+    EXPECT_TRUE( fifo.empty() );
+
+    fifo.write_blockingly( 2.0 );
+    fifo.write_blockingly( 3.0 );
+    EXPECT_TRUE( fifo.full() );
+    EXPECT_EQ( fifo.queue_state(), std::make_tuple( size_t( 1 ), size_t( 2 ), false ));
+
+    EXPECT_EQ( fifo.read_blockingly(), 2.0 );
+    EXPECT_EQ( fifo.read_timeout( 0.001 ), std::optional< double >( 3.0 ));
+    EXPECT_FALSE( fifo.read_timeout( 0.001 ));
+
+    fifo.write_blockingly( 4.0 );
+    fifo.close();
+    EXPECT_TRUE( fifo.closed() );
+    EXPECT_THROW( fifo.write_blockingly( 5.0 ), tz::fifo_is_closed );
+    EXPECT_EQ( fifo.read_blockingly(), 4.0 );
+    EXPECT_THROW( fifo.read_blockingly(), tz::fifo_is_closed );
+    EXPECT_THROW( fifo.read_timeout( 0.001 ), tz::fifo_is_closed );
+}
+
+template< typename backend >
+void
+check_ring_batch_threaded()
+{
+    using fifo_t = tz::object_fifo< std::unique_ptr< size_t >, backend >;
+    constexpr size_t n = 10000;
+
+    auto fifo = std::make_shared< fifo_t >( 7 );
+
+    std::thread producer(
+        [ fifo ]()
+        {
+            tz::fifo_guard_writing< std::unique_ptr< size_t >, backend > out( fifo );
+            std::vector< std::unique_ptr< size_t > > chunk;
+            for( size_t k = 0; k < n; k = k + 1 ) {
+                chunk.push_back( std::make_unique< size_t >( k ));
+                if( chunk.size() == 5 ) {
+                    out.write_batch( std::make_move_iterator( chunk.begin()),
+                                     std::make_move_iterator( chunk.end()));
+                    chunk.clear();
+                }
+            }
+            out.write_batch( std::make_move_iterator( chunk.begin()),
+                             std::make_move_iterator( chunk.end()));
+        });
+
+    tz::fifo_guard_reading< std::unique_ptr< size_t >, backend > in( fifo );
+    std::vector< std::unique_ptr< size_t > > received;
+    try {
+        for( ;; ) {
+            in.read_batch( std::back_inserter( received ), 3 );
+        }
+    } catch( tz::fifo_is_closed const & ) {
+    }
+    producer.join();
+
+    ASSERT_EQ( received.size(), n );
+    for( size_t k = 0; k < n; k = k + 1 ) {
+        EXPECT_EQ( *received[ k ], k );
+    }
+}
+}
+
+TEST( object_fifo, spsc_ring_io )
+{
+    check_ring_io< tz::fifo_backend_spsc_ring >();
+}
+
+TEST( object_fifo, mpmc_ring_io )
+{
+    check_ring_io< tz::fifo_backend_mpmc_ring >();
+}
+
+namespace {
+template< typename backend >
+void
+check_overwrite_drops_newest()
+{
+    tz::object_fifo< int, backend > fifo( 3 );
+
+    fifo.write_overwrite( 1 );
+    fifo.write_overwrite( 2 );
+    fifo.write_overwrite( 3 );
+    fifo.write_overwrite( 4 );
+    fifo.write_overwrite( 5 );
+    EXPECT_TRUE( fifo.full() );
+    EXPECT_EQ( fifo.read_blockingly(), 1 );
+    EXPECT_EQ( fifo.read_blockingly(), 2 );
+    EXPECT_EQ( fifo.read_blockingly(), 5 );
+    EXPECT_TRUE( fifo.empty() );
+
+    tz::object_fifo< int, backend > single( 1 );
+    single.write_overwrite( 1 );
+    single.write_overwrite( 2 );
+    EXPECT_EQ( single.read_blockingly(), 2 );
+    EXPECT_TRUE( single.empty() );
+}
+
+template< typename F >
+concept overwritable = requires( F & f ) { f.write_overwrite( 1 ); };
+}
+
+TEST( object_fifo, overwrite_drops_newest )
+{
+    check_overwrite_drops_newest< tz::fifo_backend_locked >();
+    check_overwrite_drops_newest< tz::fifo_backend_mpmc_ring >();
+    static_assert( not overwritable< tz::object_fifo< int, tz::fifo_backend_spsc_ring > > );
+}
+
+TEST( object_fifo, mpmc_ring_overwrite_threaded )
+/* Readers racing with the replacement of the newest element never
+   see an element twice or out of order. */
+{
+    constexpr int n = 20000;
+    tz::object_fifo< int, tz::fifo_backend_mpmc_ring > fifo( 4 );
+    std::atomic< int > count( 0 );
+    std::vector< std::thread > readers;
+    for( int k = 0; k < 2; k = k + 1 ) {
+        readers.emplace_back(
+            [ & ]()
+            {
+                int previous = -1;
+                try {
+                    for( ;; ) {
+                        auto x = fifo.read_blockingly();
+                        EXPECT_GT( x, previous );
+                        EXPECT_LT( x, n );
+                        previous = x;
+                        count += 1;
+                    }
+                } catch( tz::fifo_is_closed const & ) {
+                }
+            } );
+    }
+    for( int k = 0; k < n; k = k + 1 ) {
+        fifo.write_overwrite( k );
+    }
+    fifo.close();
+    for( auto & t : readers ) {
+        t.join();
+    }
+    EXPECT_GT( count.load(), 0 );
+    EXPECT_LE( count.load(), n );
+}
+
+namespace {
+
+std::atomic< int > live_tokens( 0 );
+
+struct token_t
+/* Counts live objects and carries a heap allocated payload, so
+   reading a destroyed element shows up. */
+{
+    int writer = -1;
+    int k = -1;
+    std::string payload;
+
+    token_t( int writer_, int k_ )
+        : writer( writer_ ), k( k_ ),
+          payload( std::string( 40, char( 'a' + writer_ )) + std::to_string( k_ ))
+    {
+        live_tokens += 1;
+    }
+
+    token_t( token_t const & x )
+        : writer( x.writer ), k( x.k ), payload( x.payload )
+    {
+        live_tokens += 1;
+    }
+
+    token_t( token_t && x ) noexcept
+        : writer( x.writer ), k( x.k ), payload( std::move( x.payload ))
+    {
+        live_tokens += 1;
+    }
+
+    token_t & operator = ( token_t const & ) = default;
+    token_t & operator = ( token_t && ) = default;
+
+    ~token_t()
+    {
+        live_tokens -= 1;
+    }
+
+    bool
+    intact() const
+    {
+        return payload == std::string( 40, char( 'a' + writer )) + std::to_string( k );
+    }
+};
+}
+
+TEST( object_fifo, mpmc_ring_overwrite_stress )
+/* Several writers overwrite while several readers take elements out
+   of a ring with hardly any space.  Readers must only see intact
+   elements, per writer in order, and nothing may leak or stick. */
+{
+    constexpr int writers = 3;
+    constexpr int readers = 3;
+    constexpr int n = 20000;
+    for( size_t capacity : { 1, 2 } ) {
+        {
+            tz::object_fifo< token_t, tz::fifo_backend_mpmc_ring > fifo( capacity );
+            std::atomic< int > received( 0 );
+            std::vector< std::thread > threads;
+            for( int r = 0; r < readers; r = r + 1 ) {
+                threads.emplace_back(
+                    [ & ]()
+                    {
+                        std::vector< int > previous( writers, -1 );
+                        try {
+                            for( ;; ) {
+                                auto x = fifo.read_blockingly();
+                                ASSERT_TRUE( x.intact() );
+                                EXPECT_GT( x.k, previous[ x.writer ] );
+                                previous[ x.writer ] = x.k;
+                                received += 1;
+                            }
+                        } catch( tz::fifo_is_closed const & ) {
+                        }
+                    } );
+            }
+            std::vector< std::thread > producers;
+            for( int w = 0; w < writers; w = w + 1 ) {
+                producers.emplace_back(
+                    [ &fifo, w ]()
+                    {
+                        for( int k = 0; k < n; k = k + 1 ) {
+                            fifo.write_overwrite( token_t( w, k ));
+                        }
+                    } );
+            }
+            for( auto & t : producers ) {
+                t.join();
+            }
+
+            /* Still usable: nothing looks published forever. */
+            while( not fifo.empty() ) {
+                std::this_thread::yield();
+            }
+            fifo.write_blockingly( token_t( 0, n ));
+            fifo.close();
+            for( auto & t : threads ) {
+                t.join();
+            }
+            EXPECT_GT( received.load(), 0 );
+            EXPECT_LE( received.load(), writers * n + 1 );
+        }
+        EXPECT_EQ( live_tokens.load(), 0 ) << "capacity " << capacity;
+    }
+}
+
+TEST( object_fifo, spsc_ring_batch_threaded )
+{
+    check_ring_batch_threaded< tz::fifo_backend_spsc_ring >();
+}
+
+TEST( object_fifo, mpmc_ring_batch_threaded )
+{
+    check_ring_batch_threaded< tz::fifo_backend_mpmc_ring >();
+}
+
+TEST( object_fifo, mpmc_ring_many_to_many )
+{
+    using fifo_t = tz::object_fifo< uint64_t, tz::fifo_backend_mpmc_ring >;
+    constexpr uint64_t n = 20000;
+    constexpr uint64_t producers = 4;
+    constexpr uint64_t consumers = 3;
+
+    fifo_t fifo( 16 );
+    std::atomic< uint64_t > sum( 0 );
+    std::atomic< uint64_t > count( 0 );
+
+    std::vector< std::thread > readers;
+    for( uint64_t c = 0; c < consumers; c = c + 1 ) {
+        readers.emplace_back(
+            [ & ]()
+            {
+                try {
+                    for( ;; ) {
+                        sum += fifo.read_blockingly();
+                        count += 1;
+                    }
+                } catch( tz::fifo_is_closed const & ) {
+                }
+            });
+    }
+
+    std::vector< std::thread > writers;
+    for( uint64_t p = 0; p < producers; p = p + 1 ) {
+        writers.emplace_back(
+            [ & ]()
+            {
+                for( uint64_t k = 1; k <= n; k = k + 1 ) {
+                    fifo.write_blockingly( k );
+                }
+            });
+    }
+    for( auto & t : writers ) {
+        t.join();
+    }
+    fifo.close();
+    for( auto & t : readers ) {
+        t.join();
+    }
+
+    EXPECT_EQ( count.load(), n * producers );
+    EXPECT_EQ( sum.load(), producers * n * (n + 1) / 2 );
+}
+
+TEST( object_fifo, ring_wakes_blocked_reader_on_close )
+{
+    auto fifo = std::make_shared< tz::object_fifo< int, tz::fifo_backend_spsc_ring >>( 1 );
+    std::atomic< bool > closed_seen( false );
+
+    std::thread reader(
+        [ fifo, &closed_seen ]()
+        {
+            try {
+                fifo->read_blockingly();
+            } catch( tz::fifo_is_closed const & ) {
+                closed_seen = true;
+            }
+        });
+    std::this_thread::sleep_for( std::chrono::milliseconds( 5 ));
+    fifo->close();
+    reader.join();
+    EXPECT_TRUE( closed_seen );
+}
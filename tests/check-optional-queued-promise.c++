@@ -1,6 +1,7 @@
 #include <chrono>
 #include <gtest/gtest.h>
 #include <tanz/optional-queued-promise.h++>
+#include <atomic>
 #include <string>
 #include <thread>
 
@@ -79,3 +80,110 @@ TEST( optional_queued_promise, queued_run )
     EXPECT_EQ( oqp.state(), p_t::SET );
     EXPECT_EQ( *oqp, "def" );
 }
+
+TEST( optional_queued_promise, superseded_computations_are_stopped )
+{
+    using p_t = tz::optional_threaded_t< int >;
+    tz::work_stealing_pool_t pool( 1 );
+    std::atomic< bool > first_started( false );
+    std::atomic< bool > first_stopped( false );
+    std::atomic< bool > never_run( true );
+    p_t oqp( pool, tz::EXECUTOR_PRIORITY_HIGH );
+
+    oqp =
+        [ & ]( std::stop_token token )
+        {
+            first_started = true;
+            while( not token.stop_requested() ) {
+                std::this_thread::sleep_for( std::chrono::milliseconds( 1 ));
+            }
+            first_stopped = true;
+            return 1;
+        };
+    while( not first_started ) {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ));
+    }
+    oqp = [ & ]() { never_run = false; return 2; };
+    oqp = []() { return 3; };
+    while( oqp.state() != p_t::SET ) {
+        oqp.update();
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ));
+    }
+    EXPECT_TRUE( first_stopped );
+    EXPECT_TRUE( never_run );
+    EXPECT_EQ( *oqp, 3 );
+}
+
+TEST( optional_queued_promise, move_assignment_stops_pending_computation )
+{
+    using p_t = tz::optional_threaded_t< int >;
+    tz::work_stealing_pool_t pool( 1 );
+    std::atomic< bool > first_started( false );
+    std::atomic< bool > first_stopped( false );
+    p_t oqp( pool );
+
+    oqp =
+        [ & ]( std::stop_token token )
+        {
+            first_started = true;
+            while( not token.stop_requested() ) {
+                std::this_thread::sleep_for( std::chrono::milliseconds( 1 ));
+            }
+            first_stopped = true;
+            return 1;
+        };
+    while( not first_started ) {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ));
+    }
+    p_t other( pool );
+    other = []() { return 2; };
+    oqp = std::move( other );
+    EXPECT_EQ( other.state(), p_t::UNSET );
+    while( oqp.state() != p_t::SET ) {
+        oqp.update();
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ));
+    }
+    EXPECT_TRUE( first_stopped );
+    EXPECT_EQ( *oqp, 2 );
+}
+
+namespace {
+
+struct detached_t {
+    struct promise_type {
+        detached_t get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+detached_t
+add_later( tz::optional_threaded_t< int > & a,
+           std::promise< std::optional< int > > & out )
+{
+    auto x = co_await a;
+    out.set_value( x ? std::optional< int >( *x + 1 ) : std::nullopt );
+}
+}
+
+TEST( optional_queued_promise, co_await )
+{
+    tz::optional_threaded_t< int > a;
+    std::promise< std::optional< int > > result;
+    auto future = result.get_future();
+    a = []() {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 5 ));
+        return 41;
+    };
+    add_later( a, result );
+    EXPECT_EQ( future.get(), std::optional< int >( 42 ));
+
+    /* Already SET, does not suspend. */
+    a.update();
+    EXPECT_EQ( a.state(), tz::optional_threaded_t< int >::SET );
+    std::promise< std::optional< int > > again;
+    add_later( a, again );
+    EXPECT_EQ( again.get_future().get(), std::optional< int >( 42 ));
+}
@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+#include <tanz/propagation-nodes.h++>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace {
+
+using int_to_int_t = tz::computation_node_t::domain_t< int >::codomain_t< int >;
+using pair_to_int_t = tz::computation_node_t::domain_t< int, int >::codomain_t< int >;
+
+std::shared_ptr< int_to_int_t >
+make_computation( std::atomic< int > & calls, int factor, int offset )
+{
+    auto c = std::make_shared< int_to_int_t >();
+    c->set_simple_processor(
+        [ &calls, factor, offset ]( int x ) -> int_to_int_t::output_type
+        {
+            calls += 1;
+            return std::make_tuple( std::optional< int >( factor * x + offset ));
+        } );
+    return c;
+}
+
+struct diamond_t {
+    /* source -> left, right -> join -> sum */
+    std::atomic< int > left_calls{ 0 };
+    std::atomic< int > right_calls{ 0 };
+    std::atomic< int > sum_calls{ 0 };
+
+    std::shared_ptr< tz::data_node_t< int > > source = tz::make_data_node< int >();
+    std::shared_ptr< int_to_int_t > left = make_computation( left_calls, 1, 1 );
+    std::shared_ptr< int_to_int_t > right = make_computation( right_calls, 2, 0 );
+    std::shared_ptr< pair_to_int_t > sum = std::make_shared< pair_to_int_t >();
+
+    diamond_t()
+    {
+        tz::connect_full( source, left->input() );
+        tz::connect_full( source, right->input() );
+        tz::connect_slot( left->output(), sum->input(), std::index_sequence< 0 >(), std::index_sequence< 0 >() );
+        tz::connect_slot( right->output(), sum->input(), std::index_sequence< 0 >(), std::index_sequence< 1 >() );
+        sum->set_simple_processor(
+            [ this ]( int a, int b ) -> pair_to_int_t::output_type
+            {
+                sum_calls += 1;
+                return std::make_tuple( std::optional< int >( a + b ));
+            } );
+    }
+
+    std::optional< int >
+    result() const
+    {
+        return sum->output()->ref_optional< 0 >();
+    }
+};
+}
+
+
+TEST( propagation_nodes, immediate_propagation )
+{
+    diamond_t d;
+    (*d.source)( 3 );
+    EXPECT_EQ( d.result(), std::optional< int >( 4 + 6 ));
+    EXPECT_EQ( d.sum_calls, 1 );
+    (*d.source)( 5 );
+    EXPECT_EQ( d.result(), std::optional< int >( 6 + 10 ));
+    EXPECT_EQ( d.sum_calls, 2 );
+}
+
+TEST( propagation_nodes, transaction_evaluates_each_node_once )
+{
+    diamond_t d;
+    tz::propagation_scheduler_t scheduler;
+    {
+        auto tx = scheduler.transaction();
+        (*d.source)( 3 );
+        EXPECT_FALSE( d.result() );
+        tx.commit();
+    }
+    EXPECT_EQ( d.result(), std::optional< int >( 10 ));
+    EXPECT_EQ( d.left_calls, 1 );
+    EXPECT_EQ( d.right_calls, 1 );
+    EXPECT_EQ( d.sum_calls, 1 );
+
+    scheduler.batch( [ & ]() { (*d.source)( 5 ); } );
+    EXPECT_EQ( d.result(), std::optional< int >( 6 + 10 ));
+    EXPECT_EQ( d.sum_calls, 2 );
+}
+
+TEST( propagation_nodes, several_slots_in_one_transaction )
+{
+    std::atomic< int > calls( 0 );
+    auto c = std::make_shared< pair_to_int_t >();
+    c->set_simple_processor(
+        [ &calls ]( int a, int b ) -> pair_to_int_t::output_type
+        {
+            calls += 1;
+            return std::make_tuple( std::optional< int >( a * b ));
+        } );
+
+    tz::propagation_scheduler_t scheduler;
+    scheduler.batch(
+        [ & ]()
+        {
+            c->input()->set_slot_direct< 0 >( 6 );
+            c->input()->set_slot_direct< 1 >( 7 );
+            c->input()->set_slot_direct< 0 >( 3 );
+        } );
+    EXPECT_EQ( calls, 1 );
+    EXPECT_EQ( c->output()->ref_optional< 0 >(), std::optional< int >( 21 ));
+}
+
+TEST( propagation_nodes, parallel_processors )
+{
+    constexpr int n = 8;
+    auto source = tz::make_data_node< int >();
+    std::vector< std::shared_ptr< int_to_int_t > > workers;
+    std::atomic< int > running( 0 );
+    std::atomic< int > most_running( 0 );
+    for( int k = 0; k < n; k = k + 1 ) {
+        auto c = std::make_shared< int_to_int_t >();
+        c->set_simple_processor(
+            [ &, k ]( int x ) -> int_to_int_t::output_type
+            {
+                auto now = running += 1;
+                auto seen = most_running.load();
+                while( (now > seen) and not most_running.compare_exchange_weak( seen, now )) {
+                }
+                std::this_thread::sleep_for( std::chrono::milliseconds( 20 ));
+                running -= 1;
+                return std::make_tuple( std::optional< int >( x + k ));
+            } );
+        tz::connect_full( source, c->input() );
+        workers.push_back( c );
+    }
+
+    tz::propagation_scheduler_t scheduler( 4 );
+    auto evaluations = scheduler.evaluations();
+    scheduler.batch( [ & ]() { (*source)( 100 ); } );
+    for( int k = 0; k < n; k = k + 1 ) {
+        EXPECT_EQ( workers[ k ]->output()->ref_optional< 0 >(), std::optional< int >( 100 + k ));
+    }
+    EXPECT_GT( most_running, 1 );
+    EXPECT_LE( most_running, 4 );
+    /* source, n inputs and n outputs */
+    EXPECT_EQ( scheduler.evaluations() - evaluations, 1u + 2 * n );
+}
+
+TEST( propagation_nodes, cycles_are_detected )
+{
+    auto a = tz::make_data_node< int >();
+    auto b = tz::make_data_node< int >();
+    tz::connect_full( a, b );
+    tz::connect_full( b, a );
+
+    tz::propagation_scheduler_t scheduler;
+    auto tx = scheduler.transaction();
+    (*a)( 1 );
+    EXPECT_THROW( tx.commit(), std::logic_error );
+}
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+#include <tanz/record-log.h++>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+
+namespace {
+
+using record_t = std::vector< uint32_t >;
+
+struct greedy_t {};
+/* Stands in for a record whose decoding runs out of memory. */
+
+tz::deserialiser_t &
+operator >> ( tz::deserialiser_t &, greedy_t & )
+{
+    throw std::bad_alloc();
+}
+
+record_t
+example_record( uint64_t n )
+{
+    return record_t( n % 17, static_cast< uint32_t >( n ));
+}
+
+std::string
+write_example( std::string const & name, uint64_t count, bool close = true )
+{
+    auto path = testing::TempDir() + name;
+    std::remove( path.c_str());
+    tz::record_log_options_t options;
+    options.chunk_size = 1000;
+    tz::record_log_writer_t log( path, options );
+    for( uint64_t n = 0; n < count; n = n + 1 ) {
+        EXPECT_EQ( log.append( tz::record_log_time_t( 10 * n ), example_record( n )), n );
+    }
+    if( close ) {
+        log.close();
+    } else {
+        log.flush();
+        /* Crash: the destructor would write the index. */
+        std::filesystem::copy_file( path, path + ".crashed",
+                                    std::filesystem::copy_options::overwrite_existing );
+    }
+    return close ? path : path + ".crashed";
+}
+}
+
+
+TEST( record_log, crc32c )
+{
+    char const text[] = "123456789";
+    EXPECT_EQ( tz::crc32c( std::as_bytes( std::span( text, 9 ))), 0xe3069283u );
+}
+
+TEST( record_log, roundtrip_and_random_access )
+{
+    auto path = write_example( "tanz-record-log-roundtrip", 2000 );
+    tz::record_log_reader_t log( path );
+    EXPECT_FALSE( log.recovered() );
+    ASSERT_EQ( log.size(), 2000u );
+    EXPECT_GT( log.chunks().size(), 10u );
+
+    for( uint64_t n : { 0, 1, 999, 1234, 1999 } ) {
+        EXPECT_EQ( log.read< record_t >( n ), example_record( n ));
+        EXPECT_EQ( log.record( n ).time, tz::record_log_time_t( 10 * n ));
+    }
+    EXPECT_THROW( log.record( 2000 ), std::out_of_range );
+
+    EXPECT_EQ( log.lower_bound( tz::record_log_time_t( -5 )), 0u );
+    EXPECT_EQ( log.lower_bound( tz::record_log_time_t( 10 * 700 )), 700u );
+    EXPECT_EQ( log.lower_bound( tz::record_log_time_t( 10 * 700 + 1 )), 701u );
+    EXPECT_EQ( log.lower_bound( tz::record_log_time_t( 100000 )), 2000u );
+}
+
+TEST( record_log, parallel_decoding )
+{
+    auto path = write_example( "tanz-record-log-parallel", 5000 );
+    tz::record_log_reader_t log( path );
+    auto all = log.read_range< record_t >( 0, log.size(), 4 );
+    ASSERT_EQ( all.size(), 5000u );
+    for( uint64_t n = 0; n < all.size(); n = n + 1 ) {
+        ASSERT_EQ( all[ n ], example_record( n ));
+    }
+
+    auto part = log.read_range< record_t >( 123, 4321, 3 );
+    ASSERT_EQ( part.size(), 4321u - 123u );
+    EXPECT_EQ( part.front(), example_record( 123 ));
+    EXPECT_EQ( part.back(), example_record( 4320 ));
+}
+
+TEST( record_log, recovers_after_crash )
+{
+    auto path = write_example( "tanz-record-log-crash", 3000, false );
+    auto complete = std::filesystem::file_size( path );
+    /* Tear the last chunk apart. */
+    std::filesystem::resize_file( path, complete - 7 );
+
+    uint64_t survived;
+    {
+        tz::record_log_reader_t log( path );
+        EXPECT_TRUE( log.recovered() );
+        survived = log.size();
+        EXPECT_LT( survived, 3000u );
+        EXPECT_GT( survived, 2800u );
+        EXPECT_EQ( log.read< record_t >( survived - 1 ), example_record( survived - 1 ));
+    }
+
+    {
+        tz::record_log_writer_t writer( path );
+        EXPECT_EQ( writer.size(), survived );
+        for( uint64_t n = survived; n < 3000; n = n + 1 ) {
+            writer.append( tz::record_log_time_t( 10 * n ), example_record( n ));
+        }
+    }
+
+    tz::record_log_reader_t log( path );
+    EXPECT_FALSE( log.recovered() );
+    ASSERT_EQ( log.size(), 3000u );
+    auto all = log.read_range< record_t >( 0, 3000, 2 );
+    for( uint64_t n = 0; n < all.size(); n = n + 1 ) {
+        ASSERT_EQ( all[ n ], example_record( n ));
+    }
+}
+
+TEST( record_log, detects_corruption_and_limits )
+{
+    auto path = write_example( "tanz-record-log-corrupt", 500 );
+    {
+        tz::record_log_limits_t limits;
+        limits.max_record_size = 16;
+        tz::record_log_reader_t log( path, limits );
+        EXPECT_THROW( log.read< record_t >( 16 ), tz::record_log_error );
+    }
+    {
+        std::fstream file( path, std::ios::in | std::ios::out | std::ios::binary );
+        file.seekp( 100 );
+        file.put( 'X' );
+    }
+    tz::record_log_reader_t log( path );
+    EXPECT_THROW( log.read< record_t >( 0 ), tz::record_log_error );
+    EXPECT_THROW( log.read_range< record_t >( 0, 500, 2 ), tz::record_log_error );
+
+    tz::record_log_options_t options;
+    options.limits.max_record_size = 8;
+    auto limited = testing::TempDir() + "tanz-record-log-limit";
+    std::remove( limited.c_str());
+    tz::record_log_writer_t writer( limited, options );
+    EXPECT_THROW( writer.append( tz::record_log_time_t( 0 ), example_record( 5 )), tz::record_log_error );
+}
+
+TEST( record_log, rejects_crafted_lengths )
+/* The records pass the CRC, only their length prefixes lie. */
+{
+    auto path = testing::TempDir() + "tanz-record-log-crafted";
+    std::remove( path.c_str());
+    {
+        tz::record_log_writer_t writer( path );
+        for( auto len : { uint64_t( 1 ) << 28, uint64_t( 1 ) << 36, ~uint64_t( 0 ) } ) {
+            tz::memory_sink_t sink;
+            auto ser = tz::make_serialiser( sink );
+            ser << len << uint64_t( 1 ) << uint64_t( 2 );
+            writer.append_bytes( tz::record_log_time_t( 0 ), sink.bytes() );
+        }
+    }
+
+    tz::record_log_reader_t log( path );
+    ASSERT_EQ( log.size(), 3 );
+    for( uint64_t n = 0; n < 3; n = n + 1 ) {
+        EXPECT_THROW( (log.read< std::map< uint32_t, uint32_t > >( n )), std::runtime_error );
+        EXPECT_THROW( log.read< std::vector< std::vector< uint8_t > > >( n ), std::runtime_error );
+        EXPECT_THROW( log.read< record_t >( n ), std::runtime_error );
+    }
+    EXPECT_THROW( log.read_range< std::vector< std::vector< uint8_t > > >( 0, 3, 2 ), std::runtime_error );
+    EXPECT_THROW( log.read< greedy_t >( 0 ), tz::record_log_error );
+    std::remove( path.c_str());
+}
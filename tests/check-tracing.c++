@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include <tanz/tracing.h++>
+#include <thread>
+#include <vector>
+
+
+TEST( tracing, histogram_buckets )
+{
+    for( uint64_t v : { 0ull, 1ull, 63ull, 64ull, 65ull, 1000ull, 123456789ull, ~0ull } ) {
+        auto b = tz::trace_histogram_t::bucket_of( v );
+        ASSERT_LT( b, tz::trace_histogram_t::bucket_count );
+        EXPECT_LE( tz::trace_histogram_t::bucket_start( b ), v );
+        if( b + 1 < tz::trace_histogram_t::bucket_count ) {
+            EXPECT_GT( tz::trace_histogram_t::bucket_start( b + 1 ), v );
+        }
+    }
+    EXPECT_EQ( tz::trace_histogram_t::bucket_of( 63 ) + 1, tz::trace_histogram_t::bucket_of( 64 ));
+}
+
+TEST( tracing, histogram_percentiles )
+{
+    tz::trace_histogram_t h;
+    for( uint64_t v = 1; v <= 10000; v = v + 1 ) {
+        h.add( v );
+    }
+    EXPECT_EQ( h.count(), 10000u );
+    EXPECT_EQ( h.min(), 1u );
+    EXPECT_EQ( h.max(), 10000u );
+    EXPECT_DOUBLE_EQ( h.mean(), 5000.5 );
+    EXPECT_NEAR( h.percentile( 0.5 ), 5000, 5000 * 0.03 );
+    EXPECT_NEAR( h.percentile( 0.99 ), 9900, 9900 * 0.03 );
+    EXPECT_EQ( h.percentile( 0.0 ), 1.0 );
+    EXPECT_EQ( h.percentile( 1.0 ), 10000.0 );
+
+    tz::trace_histogram_t g;
+    g.add( 20000 );
+    h.merge( g );
+    EXPECT_EQ( h.count(), 10001u );
+    EXPECT_EQ( h.max(), 20000u );
+}
+
+TEST( tracing, collects_from_threads )
+{
+    {
+        /* Without a collector nothing is recorded. */
+        tz::trace_span_t span( "not recorded" );
+    }
+
+    tz::trace_collector_t collector;
+    EXPECT_THROW( tz::trace_collector_t(), std::logic_error );
+
+    std::vector< std::thread > threads;
+    for( size_t t = 0; t < 4; t = t + 1 ) {
+        threads.emplace_back( []() {
+            for( int k = 0; k < 1000; k = k + 1 ) {
+                tz::trace_span_t outer( "outer" );
+                if( k % 10 == 0 ) {
+                    tz::trace_cpu_span_t inner( "inner" );
+                }
+            }
+        });
+    }
+    for( auto & t : threads ) {
+        t.join();
+    }
+
+    auto stats = collector.statistics();
+    EXPECT_EQ( collector.dropped(), 0u );
+    uint64_t outer = 0;
+    uint64_t inner = 0;
+    for( auto const & s : stats ) {
+        EXPECT_NE( s.label, "not recorded" );
+        if( s.label == "outer" ) {
+            outer = s.wall.count();
+            EXPECT_EQ( s.cpu.count(), 0u );
+        }
+        if( s.label == "inner" ) {
+            inner = s.wall.count();
+            EXPECT_EQ( s.cpu.count(), inner );
+        }
+    }
+    EXPECT_EQ( outer, 4000u );
+    EXPECT_EQ( inner, 400u );
+}
+
+TEST( tracing, dump_roundtrip )
+{
+    tz::memory_sink_t sink;
+    auto ser = tz::make_serialiser( sink );
+    {
+        tz::trace_collector_options_t options;
+        options.dump = &ser;
+        tz::trace_collector_t collector( options );
+        for( int k = 0; k < 100; k = k + 1 ) {
+            tz::trace_span_t span( "a" );
+            tz::trace_cpu_span_t cpu_span( "b" );
+        }
+        collector.drain();
+        tz::trace_span_t span( "c" );
+    }
+
+    auto des = tz::make_deserialiser( sink.bytes() );
+    auto dump = tz::read_trace_dump( des );
+    EXPECT_EQ( dump.labels, std::vector< std::string >( { "b", "a", "c" } ));
+    ASSERT_EQ( dump.records.size(), 201u );
+    size_t with_cpu = 0;
+    for( auto const & r : dump.records ) {
+        EXPECT_GE( r.wall.count(), 0 );
+        if( r.cpu.count() >= 0 ) {
+            with_cpu = with_cpu + 1;
+            EXPECT_EQ( dump.labels[ r.label ], "b" );
+            EXPECT_GE( r.task_duration().cpu_time, 0.0f );
+        }
+    }
+    EXPECT_EQ( with_cpu, 100u );
+    EXPECT_LE( dump.records.front().start, dump.records.back().start );
+}
@@ -2,6 +2,7 @@
 #include <tanz/union-find.h++>
 #include <random>
 #include <ciso646>
+#include <thread>
 
 TEST( union_finder_t, empty )
 {
@@ -188,3 +189,89 @@ TEST( union_finder_t, random_seventyeight )
     }
     EXPECT_EQ( uf.classes().size(), 78 );
 }
+
+TEST( union_finder_t, long_chain_does_not_recurse )
+{
+    /* Linking every root below the next one by hand gives a chain of
+       depth l, which the recursive find overflowed on. */
+    constexpr size_t l = 3000000;
+    tz::union_finder_t uf( l );
+    for( size_t k = 0; k + 1 < l; k = k + 1 ) {
+        uf.index_to_rep[ k ].root = k + 1;
+    }
+    EXPECT_EQ( uf.find( 0 ), l - 1 );
+    EXPECT_EQ( uf.classes().size(), 1 );
+}
+
+TEST( union_finder_t, labels )
+{
+    tz::union_finder_t uf( 7 );
+    uf.add_relation( 5, 1 );
+    uf.add_relation( 6, 3 );
+    uf.add_relation( 3, 1 );
+    uf.add_relation( 4, 2 );
+    auto labels = uf.labels();
+
+    ASSERT_EQ( labels.size(), 3 );
+    EXPECT_EQ( labels.labels, std::vector< size_t >( { 0, 1, 2, 1, 2, 1, 1 } ));
+    EXPECT_EQ( labels.offsets, std::vector< size_t >( { 0, 1, 5, 7 } ));
+    EXPECT_EQ( labels.members, std::vector< size_t >( { 0, 1, 3, 5, 6, 2, 4 } ));
+    EXPECT_EQ( labels.members_of( 1 ).size(), 4 );
+}
+
+TEST( concurrent_union_finder_t, matches_sequential )
+{
+    constexpr size_t l = 200000;
+    std::mt19937 gen( 42 );
+    std::uniform_int_distribution< size_t > element( 0, l - 1 );
+
+    std::vector< std::pair< size_t, size_t > > relations( l / 2 );
+    for( auto & r : relations ) {
+        r = { element( gen ), element( gen ) };
+    }
+
+    tz::union_finder_t sequential( l );
+    for( auto const & r : relations ) {
+        sequential.add_relation( r.first, r.second );
+    }
+    auto expected = sequential.labels();
+
+    for( size_t threads : { 1, 2, 4, 8 } ) {
+        tz::concurrent_union_finder_t concurrent( l );
+        concurrent.add_relations( relations, threads );
+        auto labels = concurrent.labels( threads );
+        EXPECT_EQ( labels.labels, expected.labels );
+        EXPECT_EQ( labels.offsets, expected.offsets );
+        EXPECT_EQ( labels.members, expected.members );
+    }
+}
+
+TEST( concurrent_union_finder_t, grid_from_many_threads )
+{
+    /* Rows of a w x h grid, but the last column is not connected. */
+    constexpr size_t w = 300;
+    constexpr size_t h = 200;
+    tz::concurrent_union_finder_t uf( w * h );
+
+    std::vector< std::thread > threads;
+    for( size_t t = 0; t < 4; t = t + 1 ) {
+        threads.emplace_back( [ &uf, t ]() {
+            for( size_t y = t; y < h; y = y + 4 ) {
+                for( size_t x = 0; x + 2 < w; x = x + 1 ) {
+                    uf.add_relation( y * w + x, y * w + x + 1 );
+                }
+                if( y + 1 < h ) {
+                    uf.add_relation( y * w, (y + 1) * w );
+                }
+            }
+        });
+    }
+    for( auto & t : threads ) {
+        t.join();
+    }
+    EXPECT_FALSE( uf.add_relation( 0, w * h - 2 ));
+    auto classes = uf.classes();
+    ASSERT_EQ( classes.size(), 1 + h );
+    EXPECT_EQ( classes[ 0 ].size(), (w - 1) * h );
+    EXPECT_EQ( classes[ 1 ], std::vector< size_t >( { w - 1 } ));
+}